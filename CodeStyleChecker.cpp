@@ -19,6 +19,88 @@
 //    By default this plugin will only run on the main translation unit. Use
 //    `-main-tu-only=false` to make it run on e.g. included header files too.
 //
+//    The layout rules are delegated to clang-format, which is run in-process
+//    on the buffer that is already loaded into the SourceManager. Every
+//    replacement that differs from the original text is reported as a
+//    warning with a FixIt hint. Use `-format-style=<style>` to pick the style
+//    (`file` - the nearest .clang-format, the default; `none` - disabled).
+//
+//    On badly formatted input most of the time goes into rendering thousands
+//    of near-identical warnings. `-summary` only counts the violations per
+//    rule and per file and prints the counts at the end of the TU.
+//    `-max-per-rule=<N>` stops checking a rule after N violations in a TU;
+//    once every rule is capped the traversal of the TU is aborted.
+//    `-compact` replaces Clang's caret/snippet rendering with one-line records
+//    printed at the end of the TU (see CodeStyleCheckerDiagnostics.h), add
+//    `-snippets` to get the source lines back.
+//
+//    `-baseline=<file>` drops the violations whose fingerprint (rule, file,
+//    enclosing declaration, token - but no line numbers) is listed in <file>.
+//    `-write-baseline` writes the fingerprints of the current violations to
+//    that file instead of reporting them.
+//
+//    `-changed-lines=<git diff range>` only checks the lines changed in the
+//    range: declarations that don't overlap a changed line are not traversed,
+//    and clang-format only looks at the changed line spans.
+//
+//    CSC is a CmdlineAfterMainAction plugin: `-plugin CSC` runs it instead
+//    of the compile, `-add-plugin CSC` next to the real compile on the same
+//    AST (-fplugin only loads it).
+//    `-output=<file>` (or `-output=<dir>/`, one <input>.csc per TU) sends the
+//    warnings there as compact records, so that the build log stays clean.
+//
+//    The rules of the former `style-checker` plugin (code_styler.cpp) run in
+//    the same traversal: R3.2 (non-English names), R5.7 (`main` ends with
+//    `return`), R5.8 (gets, strcpy, ...) and the scan of the main file for
+//    control characters outside string literals (R1.1).
+//
+//    R5.4 (diagnostics to stderr), R5.5 (a diagnostic ends with a newline),
+//    R5.6 (the last output of `main` ends the line) and the scanf half of
+//    R5.8 (`%s` without a width) look at the format string of the stdio
+//    calls. Each literal is parsed once per TU, whichever rule asks first,
+//    see CodeStyleCheckerIO.h.
+//
+//    The flow-sensitive rules - R4.6.8 (no fall-through between the cases of
+//    a switch), R5.7 (every path of `main` returns an exit code) and R5.17
+//    (resource handles defined at the start of the function and
+//    initialized) - share the CFG of the function being traversed. It is
+//    built when the first of them needs it and freed when the traversal
+//    leaves the function, see CodeStyleCheckerFlow.h.
+//
+//    The section 4 layout rules (R4.3 pointer declarators, R4.5.1/R4.5.2
+//    function definitions, R4.7.x spacing) are expectations about the gaps
+//    between the tokens the AST points at. They are collected during the
+//    traversal and checked at the end of the TU against one raw token stream
+//    per file, see CodeStyleCheckerLayout.h.
+//
+//    R5.2 (`#define N 8`), R5.3 (`<>` vs `""` includes) and R6.2 (header
+//    guards) are checked from PPCallbacks while the preprocessor runs, see
+//    CodeStyleCheckerPP.h.
+//
+//    A naming warning is emitted once per symbol, after the traversal: its
+//    FixIt renames the declarations and every reference seen in the TU, all
+//    collected during the same walk.
+//
+//    `-index=<file>` records the USR of every misnamed symbol together with
+//    every location that spells its name, per TU. The standalone tool can
+//    then rename the symbols consistently across all files (-apply-fixes).
+//
+//    R5.12 (commented-out code) looks at every comment the lexer skips: a
+//    scan of the characters drops prose, only the rest is lexed as code.
+//
+//    R6.1, R6.3, R6.4 and R6.5 (module headers, direct includes) are about
+//    the whole project. With `-project` (standalone tool only) every TU
+//    records its includes, definitions, prototypes and the header each used
+//    name comes from while it is checked, and the tool evaluates the rules
+//    over all records once every TU is done, see CodeStyleCheckerProject.h.
+//
+//    `-cache=<file>` (standalone tool only) keeps the violations of the AST
+//    and preprocessor rules per raw token stream of the main file. A file
+//    that only differs in whitespace or comments from a cached one is not
+//    parsed: the cached violations are reported at its tokens and only the
+//    buffer rules (R1.1, clang-format) run again, see
+//    CodeStyleCheckerCache.h.
+//
 // USAGE:
 //    1. As a loadable Clang plugin:
 //    Main TU only:
@@ -28,6 +110,10 @@
 //      * clang -cc1 -load <BUILD_DIR>/lib/libCodeStyleChecker.dylib '\'
 //        -plugin CSC -plugin-arg-CSC -main-tu-only=false '\'
 //        test/CodeStyleCheckerVector.cpp
+//    Next to the compile, results in build/csc/<input>.csc:
+//      * clang -c -fplugin=<BUILD_DIR>/lib/libCodeStyleChecker.dylib '\'
+//        -Xclang -add-plugin -Xclang CSC '\'
+//        -fplugin-arg-CSC--output=build/csc/ test/CodeStyleCheckerVector.cpp
 //    2. As a standalone tool:
 //        <BUILD_DIR>/bin/ct-code-style-checker '\'
 //        test/ct-code-style-checker-basic.cpp
@@ -38,285 +124,2167 @@
 
 #include "clang/AST/AST.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Analysis/CFG.h"
+#include "clang/Basic/CharInfo.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Index/USRGeneration.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 
 using namespace clang;
 
 //-----------------------------------------------------------------------------
 // CodeStyleCheckerVisitor implementation
 //-----------------------------------------------------------------------------
-bool CodeStyleCheckerVisitor::VisitTagDecl(TagDecl *Decl)
+CodeStyleCheckerVisitor::CodeStyleCheckerVisitor(
+	ASTContext *Ctx,
+	const CodeStyleCheckerOptions &Opts,
+	CSCDiagnosticConsumer *Compact)
+	: Ctx(Ctx), Opts(Opts), Compact(Compact),
+	  Layout(Ctx->getSourceManager(), Ctx->getLangOpts())
 {
-	// Skip anonymous enums:
-	// Skip anonymous records, e.g. unions:
-	//    * https://en.cppreference.com/w/cpp/language/union
-	if (0 == Decl->getNameAsString().size())
+	ActiveRules = AllCSCRules;
+
+	if (!Opts.Style || Opts.Style->DisableFormat)
 	{
-		return true;
+		ActiveRules &= ~ruleBit(CSCRule::Format);
+	}
+
+	if (Opts.Baseline && llvm::sys::fs::current_path(WorkingDir))
+	{
+		WorkingDir.clear();
 	}
+}
 
-	check_rule_3_6(Decl);
+bool CodeStyleCheckerVisitor::account(CSCRule Rule, SourceLocation Loc)
+{
+	unsigned Idx = static_cast<unsigned>(Rule);
 
-	return true;
+	// Before anything can drop it: a replay goes through account() again
+	if (Recording && (ruleBit(Rule) & CSCResultCache::CachedRules))
+	{
+		record(Rule, Loc);
+	}
+
+	if (Opts.ChangedLines && !is_changed(Loc))
+	{
+		return false;
+	}
+
+	// Known violations are dropped before anything else is done with them
+	if (Opts.Baseline)
+	{
+		uint64_t Fingerprint = fingerprint(Rule, Loc);
+
+		if (Opts.WriteBaseline)
+		{
+			Opts.Baseline->add(Fingerprint);
+			return false;
+		}
+		if (Opts.Baseline->contains(Fingerprint))
+		{
+			return false;
+		}
+	}
+
+	const SourceManager &SM = Ctx->getSourceManager();
+	++TUCounts[Idx];
+	++FileCounts[SM.getFileID(SM.getExpansionLoc(Loc))][Idx];
+
+	if (Opts.MaxPerRule && TUCounts[Idx] >= Opts.MaxPerRule)
+	{
+		ActiveRules &= ~ruleBit(Rule);
+	}
+
+	return !Opts.Summary;
 }
 
-bool CodeStyleCheckerVisitor::VisitFunctionDecl(FunctionDecl *Decl)
+const CSCChangedLines::Intervals *
+CodeStyleCheckerVisitor::changed_lines(FileID FID)
 {
-	// Skip user-defined conversion operators/functions:
-	//    * https://en.cppreference.com/w/cpp/language/cast_operator
-	if (isa<CXXConversionDecl>(Decl))
+	auto It = ChangedLinesCache.find(FID);
+	if (It != ChangedLinesCache.end())
 	{
-		return true;
+		return It->second;
 	}
 
-	check_rule_3_4(Decl);
+	const CSCChangedLines::Intervals *Changed = nullptr;
+	if (OptionalFileEntryRef FE =
+		Ctx->getSourceManager().getFileEntryRefForID(FID))
+	{
+		Changed = Opts.ChangedLines->lookup(FE->getName());
+	}
+	ChangedLinesCache[FID] = Changed;
 
-	return true;
+	return Changed;
 }
 
-bool CodeStyleCheckerVisitor::VisitVarDecl(VarDecl *Decl)
+bool CodeStyleCheckerVisitor::is_changed(SourceRange R)
 {
-	// Skip anonymous function parameter declarations
-	if (isa<ParmVarDecl>(Decl) && (0 == Decl->getNameAsString().size()))
+	if (!Opts.ChangedLines)
 	{
 		return true;
 	}
 
-	// if (constexpr Decl || const Decl)
-	if (Decl->isConstexpr() || Decl->getType().isConstQualified())
-	{
-		check_rule_3_3(Decl);
+	const SourceManager &SM = Ctx->getSourceManager();
 
+	SourceLocation Begin = SM.getExpansionLoc(R.getBegin());
+	SourceLocation End = SM.getExpansionRange(R.getEnd()).getEnd();
+	if (Begin.isInvalid())
+	{
+		// Can't tell - better check it
 		return true;
 	}
 
-	check_rule_3_4(Decl);
+	std::pair<FileID, unsigned> DecomposedBegin = SM.getDecomposedLoc(Begin);
+	const CSCChangedLines::Intervals *Changed =
+		changed_lines(DecomposedBegin.first);
+	if (!Changed)
+	{
+		return false;
+	}
 
-	return true;
+	unsigned First =
+		SM.getLineNumber(DecomposedBegin.first, DecomposedBegin.second);
+	unsigned Last = First;
+	if (End.isValid() && SM.getFileID(End) == DecomposedBegin.first)
+	{
+		Last = SM.getLineNumber(DecomposedBegin.first, SM.getFileOffset(End));
+	}
+
+	return CSCChangedLines::intersects(*Changed, First, Last);
 }
 
-bool CodeStyleCheckerVisitor::VisitEnumConstantDecl(EnumConstantDecl *Decl)
+std::vector<std::pair<unsigned, unsigned>>
+CodeStyleCheckerVisitor::changed_spans(FileID FID)
 {
-	check_rule_3_3(Decl);
+	const SourceManager &SM = Ctx->getSourceManager();
+	std::vector<std::pair<unsigned, unsigned>> Spans;
 
-	return true;
+	if (!Opts.ChangedLines)
+	{
+		Spans.emplace_back(0, SM.getBufferData(FID).size());
+		return Spans;
+	}
+
+	const CSCChangedLines::Intervals *Changed = changed_lines(FID);
+	if (!Changed)
+	{
+		return Spans;
+	}
+
+	for (const CSCChangedLines::Interval &Lines : *Changed)
+	{
+		unsigned Begin =
+			SM.getFileOffset(SM.translateLineCol(FID, Lines.first, 1));
+		unsigned End =
+			SM.getFileOffset(SM.translateLineCol(FID, Lines.second + 1, 1));
+		if (End > Begin)
+		{
+			Spans.emplace_back(Begin, End);
+		}
+	}
+
+	return Spans;
 }
 
-bool CodeStyleCheckerVisitor::VisitFieldDecl(FieldDecl *Decl)
+uint64_t CodeStyleCheckerVisitor::fingerprint(CSCRule Rule,
+	SourceLocation Loc) const
 {
-	// Skip anonymous bit-fields:
-	//  * https://en.cppreference.com/w/c/language/bit_field
-	if (0 == Decl->getNameAsString().size())
+	const SourceManager &SM = Ctx->getSourceManager();
+
+	SourceLocation SpellingLoc = SM.getSpellingLoc(Loc);
+	std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(SpellingLoc);
+	StringRef Rest = SM.getBufferData(Decomposed.first).substr(Decomposed.second);
+
+	// Layout violations point at whitespace - use the text of the line then
+	StringRef Token;
+	if (Rest.empty() || isWhitespace(Rest.front()))
 	{
-		return true;
+		StringRef Buffer = SM.getBufferData(Decomposed.first);
+		size_t Begin = Buffer.rfind('\n', Decomposed.second);
+		Begin = (Begin == StringRef::npos) ? 0 : Begin + 1;
+		Token = Buffer.slice(Begin, Buffer.find('\n', Decomposed.second)).trim();
+	}
+	else
+	{
+		Token = Rest.take_front(
+			Lexer::MeasureTokenLength(SpellingLoc, SM, Ctx->getLangOpts()));
 	}
 
-	return true;
+	// Relative to the working directory, so that the baseline does not
+	// depend on where the project is checked out
+	SmallString<256> File(SM.getFilename(SM.getExpansionLoc(Loc)));
+	if (!WorkingDir.empty() &&
+		llvm::sys::path::replace_path_prefix(File, WorkingDir, ""))
+	{
+		File = llvm::sys::path::relative_path(File);
+	}
+
+	std::string Scope =
+		EnclosingDecl ? EnclosingDecl->getQualifiedNameAsString() : "";
+
+	return CSCBaseline::fingerprint(Rule, File, Scope, Token);
 }
 
-bool CodeStyleCheckerVisitor::VisitStringLiteral(StringLiteral *SL)
+void CodeStyleCheckerVisitor::report(CSCRule Rule,
+	SourceLocation Loc, llvm::ArrayRef<FixItHint> Hints)
 {
-	check_rule_1(SL);
+	DiagnosticsEngine &DiagEngine = Ctx->getDiagnostics();
+	unsigned &DiagID = DiagIDs[static_cast<unsigned>(Rule)];
 
-	return true;
+	if (0 == DiagID)
+	{
+		// The messages come from a table, so the string literal overload of
+		// DiagnosticsEngine::getCustomDiagID can't be used here
+		DiagID = DiagEngine.getDiagnosticIDs()->getCustomDiagID(
+			DiagnosticIDs::Warning, getRuleMessage(Rule));
+
+		if (Compact)
+		{
+			Compact->add_rule(DiagID, Rule);
+		}
+	}
+
+	if (Recording && (ruleBit(Rule) & CSCResultCache::CachedRules))
+	{
+		record_report(Rule, Loc, Hints);
+	}
+
+	// Emitted - and rendered by the diagnostic consumer - at the end of the
+	// block
+	CSCRuleAllocPause Pause;
+	DiagnosticBuilder Diag = DiagEngine.Report(Loc, DiagID);
+	for (const FixItHint &Hint : Hints)
+	{
+		Diag.AddFixItHint(Hint);
+	}
 }
 
-void CodeStyleCheckerVisitor::check_rule_1(StringLiteral *SL)
+void CodeStyleCheckerVisitor::start_recording(CSCResultCache::Entry &Entry,
+	const CSCTokenStream &Toks)
 {
-	StringRef Str = SL->getString();
+	Recording = &Entry;
+	RecordingTokens = &Toks;
+	RecordingValid = true;
+	NextToReport = {};
+}
 
-	bool hasChanged = false;
-	std::string Hint;
+bool CodeStyleCheckerVisitor::stop_recording()
+{
+	if (!Recording)
+	{
+		return false;
+	}
 
-	for (size_t i = 0; i < Str.size(); ++i) {
-		char c = Str[i];
+	// R1.1 must keep skipping these after a replay
+	for (const auto &Literal : FlaggedLiterals)
+	{
+		Recording->Literals.emplace_back(
+			RecordingTokens->position(Literal.first),
+			RecordingTokens->end_position(Literal.second));
+	}
 
-		// printf("%d\n", c);
+	// Replayed comments in these must not be checked
+	for (const auto &Range : SkippedRanges)
+	{
+		Recording->Skipped.emplace_back(
+			RecordingTokens->position(Range.first),
+			RecordingTokens->end_position(Range.second));
+	}
 
-		if ((c < 32 && c != 10 && c != 13) || c == 127) {
-			hasChanged = true;
-		}
-		else
+	// The layout rules are checked again on a hit, against the new layout
+	FileID MainFID = Ctx->getSourceManager().getMainFileID();
+	for (const CSCLayout::Expectation &E : Layout.expectations())
+	{
+		if (E.FID != MainFID)
 		{
-			Hint.push_back(c);
+			RecordingValid = false;
+			break;
 		}
+		Recording->Gaps.push_back({E.Rule, E.Token, E.Check});
 	}
 
-	Hint = "\"" + Hint + "\"";
+	bool Valid = RecordingValid;
+	Recording = nullptr;
+	RecordingTokens = nullptr;
 
-	if (hasChanged)
-	{
-		DiagnosticsEngine &DiagEngine = Ctx->getDiagnostics();
+	return Valid;
+}
 
-		FixItHint FixItHint = FixItHint::CreateReplacement(
-			SourceRange(SL->getBeginLoc(), SL->getEndLoc()),
-			Hint);
+void CodeStyleCheckerVisitor::record(CSCRule Rule, SourceLocation Loc)
+{
+	const SourceManager &SM = Ctx->getSourceManager();
 
-		unsigned DiagID = DiagEngine.getCustomDiagID(
-			DiagnosticsEngine::Warning,
-			"string literal contains invalid characters (including '\\t') (R1.1, R1.2) [CMC-OS]");
-		
-		// DiagEngine.Report(SL->getBeginLoc(), DiagID);
-		DiagEngine.Report(SL->getBeginLoc(), DiagID).AddFixItHint(FixItHint);
+	// A replay reports at the file location, not inside the macro
+	SourceLocation FileLoc = SM.getFileLoc(Loc);
+	if (FileLoc.isInvalid() || !SM.isWrittenInMainFile(FileLoc))
+	{
+		RecordingValid = false;
+		return;
 	}
+
+	Recording->Violations.push_back({Rule,
+		RecordingTokens->position(SM.getFileOffset(FileLoc)), {}});
 }
 
-void CodeStyleCheckerVisitor::check_rule_3_3(NamedDecl *Decl)
+void CodeStyleCheckerVisitor::record_report(CSCRule Rule, SourceLocation Loc,
+	llvm::ArrayRef<FixItHint> Hints)
 {
-	auto Name = Decl->getNameAsString();
-
-	std::string Hint = Name;
-	std::transform(Hint.begin(), Hint.end(), Hint.begin(), ::toupper);;
+	std::vector<CSCResultCache::Violation> &Violations = Recording->Violations;
+	size_t &Next = NextToReport[static_cast<unsigned>(Rule)];
+	while (Next < Violations.size() && Violations[Next].Rule != Rule)
+	{
+		++Next;
+	}
 
-	if (Hint != Name)
+	const SourceManager &SM = Ctx->getSourceManager();
+	SourceLocation FileLoc = SM.getFileLoc(Loc);
+	if (Next == Violations.size() || !SM.isWrittenInMainFile(FileLoc))
 	{
-		FixItHint FixItHint = FixItHint::CreateReplacement(
-			SourceRange(Decl->getLocation(),
-			Decl->getLocation().getLocWithOffset(Name.size() - 1)),
-			Hint);
+		RecordingValid = false;
+		return;
+	}
 
-		DiagnosticsEngine &DiagEngine = Ctx->getDiagnostics();
-		unsigned DiagID = DiagEngine.getCustomDiagID(
-			DiagnosticsEngine::Warning,
-			"consts, constexprs and enums name must be in SCREAMING_SNAKE_CASE (R3.3) [CMC-OS]");
+	// A naming warning points at the first bad character, not at the
+	// declaration it was accounted at
+	CSCResultCache::Violation &V = Violations[Next++];
+	V.Pos = RecordingTokens->position(SM.getFileOffset(FileLoc));
 
-		size_t firstLowerCaseChar = 0;
-		for (size_t i = 0; i < Name.size(); ++i) {
-	        if (islower(Name[i])) {
-	            firstLowerCaseChar = i;
-	            break;
-	        }
-	    }
+	for (const FixItHint &Hint : Hints)
+	{
+		SourceLocation Begin = Hint.RemoveRange.getBegin();
+		SourceLocation End = Hint.RemoveRange.getEnd();
+		if (!Begin.isFileID() || !End.isFileID() ||
+			!SM.isWrittenInMainFile(Begin) || !SM.isWrittenInMainFile(End))
+		{
+			RecordingValid = false;
+			return;
+		}
 
-		DiagEngine.Report(Decl->getLocation().getLocWithOffset(firstLowerCaseChar), DiagID).AddFixItHint(FixItHint);
+		bool TokenRange = Hint.RemoveRange.isTokenRange();
+		unsigned EndOffset = SM.getFileOffset(End);
+		V.Hints.push_back({
+			RecordingTokens->position(SM.getFileOffset(Begin)),
+			TokenRange ? RecordingTokens->position(EndOffset)
+				: RecordingTokens->end_position(EndOffset),
+			TokenRange, Hint.CodeToInsert});
 	}
 }
 
-void CodeStyleCheckerVisitor::check_rule_3_4(NamedDecl *Decl)
+void CodeStyleCheckerVisitor::replay(const CSCResultCache::Entry &Entry,
+	const CSCTokenStream &Toks)
 {
-	auto Name = Decl->getNameAsString();
+	const SourceManager &SM = Ctx->getSourceManager();
+	SourceLocation Start = SM.getLocForStartOfFile(SM.getMainFileID());
 
-	std::string Hint = Name;
-	std::transform(Hint.begin(), Hint.end(), Hint.begin(), ::tolower);;
+	auto ToLoc = [&](CSCResultCache::Position Pos) {
+		return Start.getLocWithOffset(Toks.offset(Pos));
+	};
 
-	if (Hint != Name)
+	for (const auto &Literal : Entry.Literals)
 	{
-		FixItHint FixItHint = FixItHint::CreateReplacement(
-			SourceRange(Decl->getLocation(),
-			Decl->getLocation().getLocWithOffset(Name.size() - 1)),
-			Hint);
+		FlaggedLiterals.emplace_back(Toks.offset(Literal.first),
+			Toks.offset(Literal.second));
+	}
 
-		DiagnosticsEngine &DiagEngine = Ctx->getDiagnostics();
-		unsigned DiagID = DiagEngine.getCustomDiagID(
-			DiagnosticsEngine::Warning,
-			"variable, function and label name must be in snake_case (R3.4) [CMC-OS]");
-
-		size_t firstUpperCaseChar = 0;
-		for (size_t i = 0; i < Name.size(); ++i) {
-	        if (isupper(Name[i])) {
-	            firstUpperCaseChar = i;
-	            break;
-	        }
-	    }
-
-		DiagEngine.Report(Decl->getLocation().getLocWithOffset(firstUpperCaseChar), DiagID).AddFixItHint(FixItHint);
-	}
-}
-
-void CodeStyleCheckerVisitor::check_rule_3_6(NamedDecl *Decl)
-{
-	auto Name = Decl->getNameAsString();
-
-	std::string Hint;
-
-
-	bool hasChanged = false;
-	size_t firstChangedPos = 0;
-
-    for (size_t i = 0, n = Name.size(); i < n; ++i) {
-        if (Name[i] == '_') {
-        	if (!hasChanged)
-        	{
-	            firstChangedPos = i;
-        	}
-            hasChanged = true;
-            continue;
-        }
-        if (i == 0 || Name[i - 1] == '_') {
-            if (!isupper(Name[i])) {
-            	if (!hasChanged)
-	        	{
-		            firstChangedPos = i;
-	        	}
-                hasChanged = true;
-                Hint += toupper(Name[i]);
-            } else {
-                Hint += Name[i];
-            }
-        } else {
-            Hint += Name[i];
-        }
-    }
+	for (const CSCResultCache::GapExpectation &G : Entry.Gaps)
+	{
+		if (is_rule_active(G.Rule))
+		{
+			Layout.expect(G.Rule, SM.getMainFileID(), G.Token, G.Check);
+		}
+	}
 
-	if (hasChanged)
+	// Comments are not in the fingerprint: R5.12 runs on the comments of
+	// this file, which the preprocessor never got to see - except for those
+	// in the blocks it skipped when the entry was recorded. The tokens, and
+	// so the conditionals, are the same as then.
+	StringRef Code = SM.getBufferData(SM.getMainFileID());
+	auto Skipped = Entry.Skipped.begin();
+	for (const auto &Comment : Toks.comments())
 	{
-		auto end_pos = std::remove(Hint.begin(), Hint.end(), '_');
-		Hint.erase(end_pos, Hint.end());
+		while (Skipped != Entry.Skipped.end() &&
+			Toks.offset(Skipped->second) <= Comment.first)
+		{
+			++Skipped;
+		}
+		if (Skipped != Entry.Skipped.end() &&
+			Toks.offset(Skipped->first) <= Comment.first)
+		{
+			continue;
+		}
 
-		FixItHint FixItHint = FixItHint::CreateReplacement(
-			SourceRange(Decl->getLocation(),
-			Decl->getLocation().getLocWithOffset(Name.size())),
-			Hint);
+		check_comment(Start.getLocWithOffset(Comment.first),
+			Code.substr(Comment.first, Comment.second));
+	}
+
+	// The violations are in the order they were accounted, so -max-per-rule
+	// caps the same ones as in the recorded run
+	for (const CSCResultCache::Violation &V : Entry.Violations)
+	{
+		if (!is_rule_active(V.Rule))
+		{
+			continue;
+		}
 
-		DiagnosticsEngine &DiagEngine = Ctx->getDiagnostics();
-		unsigned DiagID = DiagEngine.getCustomDiagID(
-			DiagnosticsEngine::Warning,
-			"type and tag names must be in UpperCamelCase (`_` is not allowed) (R3.6) [CMC-OS]");
+		SourceLocation Loc = ToLoc(V.Pos);
+		if (!account(V.Rule, Loc))
+		{
+			continue;
+		}
 
-		SourceLocation UnderscoreLoc =
-			Decl->getLocation().getLocWithOffset(firstChangedPos);
+		std::vector<FixItHint> Hints;
+		for (const CSCResultCache::Hint &H : V.Hints)
+		{
+			CharSourceRange Range = H.TokenRange
+				? CharSourceRange::getTokenRange(ToLoc(H.Begin), ToLoc(H.End))
+				: CharSourceRange::getCharRange(ToLoc(H.Begin), ToLoc(H.End));
+			Hints.push_back(FixItHint::CreateReplacement(Range, H.Code));
+		}
 
-		DiagEngine.Report(UnderscoreLoc, DiagID).AddFixItHint(FixItHint);
+		report(V.Rule, Loc, Hints);
 	}
 }
 
-//-----------------------------------------------------------------------------
-// FrontendAction
-//-----------------------------------------------------------------------------
-class CSCASTAction : public PluginASTAction
+void CodeStyleCheckerVisitor::print_summary(llvm::raw_ostream &OS) const
 {
-public:
-	std::unique_ptr<ASTConsumer>
-	CreateASTConsumer(
-		CompilerInstance &Compiler,
-		llvm::StringRef InFile) override
+	const SourceManager &SM = Ctx->getSourceManager();
+
+	// DenseMap has no stable order - sort by file name for reproducible output
+	std::vector<std::pair<StringRef, const RuleCounts *>> Files;
+	for (const auto &Entry : FileCounts)
 	{
-		return std::make_unique<CodeStyleCheckerASTConsumer>(
-			&Compiler.getASTContext(),
-			MainTuOnly,
-			Compiler.getSourceManager());
+		Files.emplace_back(
+			SM.getFilename(SM.getLocForStartOfFile(Entry.first)),
+			&Entry.second);
 	}
+	llvm::sort(Files, [](const auto &L, const auto &R) {
+		return L.first < R.first;
+	});
 
-	bool ParseArgs(
-		const CompilerInstance &CI,
-		const std::vector<std::string> &Args) override
+	for (const auto &File : Files)
 	{
-		for (StringRef Arg : Args)
+		OS << File.first << ":";
+		for (unsigned I = 0; I < NumCSCRules; ++I)
 		{
-			if (Arg.starts_with("-main-tu-only="))
-			{
-				MainTuOnly =
-				Arg.substr(strlen("-main-tu-only=")).equals_insensitive("true");
-			}
-			else if (Arg.starts_with("-help"))
+			if ((*File.second)[I] == 0)
 			{
-				PrintHelp(llvm::errs());
-			}
-			else
-			{
-				return false;
+				continue;
 			}
+			OS << " " << getRuleName(static_cast<CSCRule>(I)) << "="
+				<< (*File.second)[I];
+		}
+		OS << "\n";
+	}
+
+	OS << "total:";
+	for (unsigned I = 0; I < NumCSCRules; ++I)
+	{
+		OS << " " << getRuleName(static_cast<CSCRule>(I)) << "=" << TUCounts[I];
+		if (Opts.MaxPerRule && TUCounts[I] >= Opts.MaxPerRule)
+		{
+			OS << " (capped)";
+		}
+	}
+	OS << "\n";
+}
+
+bool CodeStyleCheckerVisitor::TraverseDecl(Decl *D)
+{
+	// A declaration that does not overlap the changed lines can't contain
+	// anything to report - don't even walk into it. -project needs the
+	// names it uses all the same.
+	if (D && Opts.ChangedLines && !Facts && !isa<TranslationUnitDecl>(D) &&
+		!is_changed(D->getSourceRange()))
+	{
+		SkippedDecls = true;
+		return true;
+	}
+
+	if (!D || !isa<FunctionDecl, TagDecl, NamespaceDecl>(D))
+	{
+		return RecursiveASTVisitor::TraverseDecl(D);
+	}
+
+	const NamedDecl *Saved = EnclosingDecl;
+	EnclosingDecl = cast<NamedDecl>(D);
+
+	// The CFG of the body, if a flow rule asks for one, lives until the
+	// traversal leaves the function
+	std::optional<CSCFunctionFlow> FunctionFlow;
+	CSCFunctionFlow *SavedFlow = Flow;
+	const auto *FD = dyn_cast<FunctionDecl>(D);
+	if (FD && FD->doesThisDeclarationHaveABody())
+	{
+		FunctionFlow.emplace(FD, *Ctx);
+		Flow = &*FunctionFlow;
+	}
+
+	bool Result = RecursiveASTVisitor::TraverseDecl(D);
+	EnclosingDecl = Saved;
+	Flow = SavedFlow;
+
+	return Result;
+}
+
+bool CodeStyleCheckerVisitor::VisitTagDecl(TagDecl *Decl)
+{
+	// Skip anonymous enums:
+	// Skip anonymous records, e.g. unions:
+	//    * https://en.cppreference.com/w/cpp/language/union
+	if (0 == Decl->getNameAsString().size())
+	{
+		return true;
+	}
+
+	record_reference(Decl, Decl->getLocation());
+	check_rule_3_2(Decl);
+	check_naming(CSCRule::R3_6, Decl);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitFunctionDecl(FunctionDecl *Decl)
+{
+	// Skip user-defined conversion operators/functions:
+	//    * https://en.cppreference.com/w/cpp/language/cast_operator
+	if (isa<CXXConversionDecl>(Decl))
+	{
+		return true;
+	}
+
+	record_reference(Decl, Decl->getLocation());
+	check_rule_3_2(Decl);
+	check_naming(CSCRule::R3_4, Decl);
+	check_rule_4_3(Decl);
+	check_rule_4_5_1(Decl);
+	check_rule_4_5_2(Decl);
+	check_rule_5_6(Decl);
+	check_rule_5_7(Decl);
+
+	FunctionTypeLoc FTL = Decl->getFunctionTypeLoc();
+	if (FTL && !Decl->isImplicit())
+	{
+		expect_parens(FTL.getLParenLoc(), FTL.getRParenLoc());
+	}
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitVarDecl(VarDecl *Decl)
+{
+	// Skip anonymous function parameter declarations
+	if (isa<ParmVarDecl>(Decl) && (0 == Decl->getNameAsString().size()))
+	{
+		return true;
+	}
+
+	record_reference(Decl, Decl->getLocation());
+	check_rule_3_2(Decl);
+	check_rule_4_3(Decl);
+	check_rule_5_2(Decl);
+	check_rule_5_17(Decl);
+
+	// if (constexpr Decl || const Decl)
+	if (Decl->isConstexpr() || Decl->getType().isConstQualified())
+	{
+		check_naming(CSCRule::R3_3, Decl);
+
+		return !all_rules_capped();
+	}
+
+	check_naming(CSCRule::R3_4, Decl);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitEnumConstantDecl(EnumConstantDecl *Decl)
+{
+	record_reference(Decl, Decl->getLocation());
+	check_rule_3_2(Decl);
+	check_naming(CSCRule::R3_3, Decl);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitFieldDecl(FieldDecl *Decl)
+{
+	// Skip anonymous bit-fields:
+	//  * https://en.cppreference.com/w/c/language/bit_field
+	if (0 == Decl->getNameAsString().size())
+	{
+		return true;
+	}
+
+	check_rule_4_3(Decl);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitStringLiteral(StringLiteral *SL)
+{
+	check_rule_1(SL);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitCallExpr(CallExpr *E)
+{
+	check_rule_5_8(E);
+	check_io_call(E);
+
+	// Overloaded operators and literals have no parentheses
+	if (isa<CXXOperatorCallExpr, UserDefinedLiteral>(E) || !E->getCallee())
+	{
+		return !all_rules_capped();
+	}
+
+	// `(` is the token after the last token of the callee
+	auto Callee = Layout.find(E->getCallee()->IgnoreImplicit()->getEndLoc());
+	auto RParen = Layout.find(E->getRParenLoc());
+	if (Callee && RParen && Callee->first == RParen->first)
+	{
+		const CSCTokenStream &Toks = Layout.tokens(Callee->first);
+		unsigned LParen = Callee->second + 1;
+		if (LParen < RParen->second && Toks[LParen].Kind == tok::l_paren &&
+			Toks[RParen->second].Kind == tok::r_paren)
+		{
+			if (is_rule_active(CSCRule::R4_7_5))
+			{
+				Layout.expect(CSCRule::R4_7_5, Callee->first, LParen,
+					CSCGapCheck::NoGap);
+			}
+			expect_parens(
+				Ctx->getSourceManager().getComposedLoc(Callee->first,
+					Toks[LParen].Offset),
+				E->getRParenLoc());
+		}
+	}
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitBinaryOperator(BinaryOperator *E)
+{
+	// The commas are checked on the tokens, see check_layout()
+	if (E->isCommaOp() || E->isPtrMemOp())
+	{
+		return true;
+	}
+
+	expect_before(CSCRule::R4_7_1, E->getOperatorLoc(), CSCGapCheck::Blank);
+	expect_after(CSCRule::R4_7_1, E->getOperatorLoc(), CSCGapCheck::Blank);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitUnaryOperator(UnaryOperator *E)
+{
+	switch (E->getOpcode())
+	{
+	case UO_Extension:
+	case UO_Real:
+	case UO_Imag:
+	case UO_Coawait:
+		// Keywords
+		return true;
+	default:
+		break;
+	}
+
+	if (E->isPostfix())
+	{
+		expect_before(CSCRule::R4_7_4, E->getOperatorLoc(),
+			CSCGapCheck::NoGap);
+	}
+	else
+	{
+		expect_after(CSCRule::R4_7_4, E->getOperatorLoc(), CSCGapCheck::NoGap);
+	}
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitArraySubscriptExpr(ArraySubscriptExpr *E)
+{
+	if (!is_rule_active(CSCRule::R4_7_2))
+	{
+		return true;
+	}
+
+	// `[` is the token after the last token of the array
+	auto LHS = Layout.find(E->getLHS()->getEndLoc());
+	auto RBracket = Layout.find(E->getRBracketLoc());
+	if (!LHS || !RBracket || LHS->first != RBracket->first)
+	{
+		return !all_rules_capped();
+	}
+
+	const CSCTokenStream &Toks = Layout.tokens(LHS->first);
+	unsigned LBracket = LHS->second + 1;
+	if (LBracket < RBracket->second && Toks[LBracket].Kind == tok::l_square)
+	{
+		Layout.expect(CSCRule::R4_7_2, LHS->first, LBracket,
+			CSCGapCheck::NoGap);
+		Layout.expect(CSCRule::R4_7_2, LHS->first, LBracket + 1,
+			CSCGapCheck::NoBlank);
+		Layout.expect(CSCRule::R4_7_2, LHS->first, RBracket->second,
+			CSCGapCheck::NoBlank);
+	}
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitParenExpr(ParenExpr *E)
+{
+	expect_parens(E->getLParen(), E->getRParen());
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitCStyleCastExpr(CStyleCastExpr *E)
+{
+	expect_parens(E->getLParenLoc(), E->getRParenLoc());
+	expect_after(CSCRule::R4_7_7, E->getRParenLoc(), CSCGapCheck::Blank);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitIfStmt(IfStmt *S)
+{
+	expect_parens(S->getLParenLoc(), S->getRParenLoc());
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitWhileStmt(WhileStmt *S)
+{
+	expect_parens(S->getLParenLoc(), S->getRParenLoc());
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitSwitchStmt(SwitchStmt *S)
+{
+	expect_parens(S->getLParenLoc(), S->getRParenLoc());
+	check_rule_4_6_8(S);
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitForStmt(ForStmt *S)
+{
+	expect_parens(S->getLParenLoc(), S->getRParenLoc());
+
+	if (!is_rule_active(CSCRule::R4_7_3))
+	{
+		return !all_rules_capped();
+	}
+
+	auto LParen = Layout.find(S->getLParenLoc());
+	auto RParen = Layout.find(S->getRParenLoc());
+	if (!LParen || !RParen || LParen->first != RParen->first)
+	{
+		return !all_rules_capped();
+	}
+
+	// The two `;` of the header, not the ones of a lambda or a statement
+	// expression inside it. `for (;;)` needs no spaces.
+	const CSCTokenStream &Toks = Layout.tokens(LParen->first);
+	int Depth = 0;
+	for (unsigned I = LParen->second + 1; I < RParen->second; ++I)
+	{
+		switch (Toks[I].Kind)
+		{
+		case tok::l_paren:
+		case tok::l_brace:
+		case tok::l_square:
+			++Depth;
+			break;
+		case tok::r_paren:
+		case tok::r_brace:
+		case tok::r_square:
+			--Depth;
+			break;
+		case tok::semi:
+			if (Depth == 0 && Toks[I + 1].Kind != tok::semi &&
+				Toks[I + 1].Kind != tok::r_paren)
+			{
+				Layout.expect(CSCRule::R4_7_3, LParen->first, I + 1,
+					CSCGapCheck::Blank);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return !all_rules_capped();
+}
+
+bool CodeStyleCheckerVisitor::VisitDeclRefExpr(DeclRefExpr *E)
+{
+	record_reference(E->getDecl(), E->getLocation());
+	if (Facts)
+	{
+		Facts->record_use(E->getLocation(), E->getDecl());
+	}
+
+	return true;
+}
+
+bool CodeStyleCheckerVisitor::VisitMemberExpr(MemberExpr *E)
+{
+	record_reference(E->getMemberDecl(), E->getMemberLoc());
+
+	// `obj\n    .field` is fine, `obj . field` is not
+	if (!E->isImplicitAccess())
+	{
+		expect_before(CSCRule::R4_7_2, E->getOperatorLoc(),
+			CSCGapCheck::NoBlank);
+		expect_after(CSCRule::R4_7_2, E->getOperatorLoc(), CSCGapCheck::NoGap);
+	}
+
+	return true;
+}
+
+bool CodeStyleCheckerVisitor::VisitTagTypeLoc(TagTypeLoc TL)
+{
+	record_reference(TL.getDecl(), TL.getNameLoc());
+	if (Facts)
+	{
+		Facts->record_use(TL.getNameLoc(), TL.getDecl());
+	}
+
+	return true;
+}
+
+bool CodeStyleCheckerVisitor::VisitTypedefTypeLoc(TypedefTypeLoc TL)
+{
+	if (Facts)
+	{
+		Facts->record_use(TL.getNameLoc(), TL.getTypedefNameDecl());
+	}
+
+	return true;
+}
+
+void CodeStyleCheckerVisitor::record_reference(const NamedDecl *D,
+	SourceLocation Loc)
+{
+	// Nothing can be renamed any more
+	if (!Opts.Index && PendingRenames.empty() &&
+		!(ActiveRules & NamingRules))
+	{
+		return;
+	}
+	if (!D || Loc.isInvalid())
+	{
+		return;
+	}
+
+	References[cast<NamedDecl>(D->getCanonicalDecl())].push_back(Loc);
+}
+
+CSCSymbolIndex::TUSymbols CodeStyleCheckerVisitor::collect_symbols() const
+{
+	const SourceManager &SM = Ctx->getSourceManager();
+
+	// Flagged declarations, sorted by USR so that the index does not depend
+	// on the DenseMap order
+	std::vector<std::pair<std::string, const NamedDecl *>> Flagged;
+	for (const auto &Entry : References)
+	{
+		const NamedDecl *D = Entry.first;
+
+		if (SM.isInSystemHeader(D->getLocation()))
+		{
+			continue;
+		}
+
+		std::optional<CSCRule> Rule = getNamingRule(D);
+		if (!Rule)
+		{
+			continue;
+		}
+
+		std::string Name = D->getNameAsString();
+		if (fixName(*Rule, Name) == Name)
+		{
+			continue;
+		}
+
+		SmallString<128> USR;
+		if (index::generateUSRForDecl(D, USR))
+		{
+			continue;
+		}
+		Flagged.emplace_back(USR.str().str(), D);
+	}
+	llvm::sort(Flagged, [](const auto &L, const auto &R) {
+		return L.first < R.first;
+	});
+
+	CSCSymbolIndex::TUSymbols Result;
+	llvm::DenseMap<FileID, unsigned> FileIndex;
+
+	for (const auto &Entry : Flagged)
+	{
+		const NamedDecl *D = Entry.second;
+		std::string Name = D->getNameAsString();
+
+		CSCSymbolIndex::Symbol Sym;
+		Sym.USR = Entry.first;
+		Sym.NewName = fixName(*getNamingRule(D), Name);
+		Sym.Name = std::move(Name);
+
+		for (SourceLocation Loc : rename_locations(D))
+		{
+			std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+
+			auto It = FileIndex.find(Decomposed.first);
+			if (It == FileIndex.end())
+			{
+				OptionalFileEntryRef FE =
+					SM.getFileEntryRefForID(Decomposed.first);
+				if (!FE)
+				{
+					continue;
+				}
+				It = FileIndex.try_emplace(Decomposed.first,
+					Result.Files.size()).first;
+				Result.Files.push_back(
+					SM.getFileManager().getCanonicalName(*FE).str());
+			}
+			Sym.Refs.push_back({It->second, Decomposed.second});
+		}
+
+		llvm::sort(Sym.Refs);
+		Sym.Refs.erase(std::unique(Sym.Refs.begin(), Sym.Refs.end()),
+			Sym.Refs.end());
+
+		if (!Sym.Refs.empty())
+		{
+			Result.Symbols.push_back(std::move(Sym));
+		}
+	}
+
+	return Result;
+}
+
+void CodeStyleCheckerVisitor::check_rule_1(StringLiteral *SL)
+{
+	if (!is_rule_active(CSCRule::R1))
+	{
+		return;
+	}
+
+	StringRef Str = SL->getString();
+
+	std::string Hint = stripControlChars(Str);
+	bool hasChanged = Hint.size() != Str.size();
+
+	Hint = "\"" + Hint + "\"";
+
+	if (hasChanged)
+	{
+		// A raw control character inside the literal is covered by this
+		// warning, check_control_chars() must not report it again
+		const SourceManager &SM = Ctx->getSourceManager();
+		SourceLocation End = Lexer::getLocForEndOfToken(SL->getEndLoc(), 0,
+			SM, Ctx->getLangOpts());
+		if (SL->getBeginLoc().isFileID() && End.isValid() &&
+			SM.isWrittenInMainFile(SL->getBeginLoc()))
+		{
+			FlaggedLiterals.emplace_back(SM.getFileOffset(SL->getBeginLoc()),
+				SM.getFileOffset(End));
+		}
+
+		if (!account(CSCRule::R1, SL->getBeginLoc()))
+		{
+			return;
+		}
+
+		FixItHint FixItHint = FixItHint::CreateReplacement(
+			SourceRange(SL->getBeginLoc(), SL->getEndLoc()),
+			Hint);
+
+		report(CSCRule::R1, SL->getBeginLoc(), FixItHint);
+	}
+}
+
+void CodeStyleCheckerVisitor::check_rule_3_2(NamedDecl *Decl)
+{
+	if (!is_rule_active(CSCRule::R3_2) || !Decl->getIdentifier())
+	{
+		return;
+	}
+
+	if (isEnglishName(Decl->getName()))
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R3_2, Decl->getLocation()))
+	{
+		return;
+	}
+
+	report(CSCRule::R3_2, Decl->getLocation());
+}
+
+void CodeStyleCheckerVisitor::check_rule_4_3(DeclaratorDecl *Decl)
+{
+	if (!is_rule_active(CSCRule::R4_3) || Decl->isImplicit() ||
+		!Decl->getTypeSourceInfo())
+	{
+		return;
+	}
+
+	// `int *p`, `char **pp`, `int *f(void)`, `void (*fp)(int)`
+	auto Name = Layout.find(Decl->getLocation());
+	for (TypeLoc TL = Decl->getTypeSourceInfo()->getTypeLoc(); !TL.isNull();
+		TL = TL.getNextTypeLoc())
+	{
+		auto PTL = TL.getAs<PointerTypeLoc>();
+		if (!PTL)
+		{
+			continue;
+		}
+
+		auto Star = Layout.find(PTL.getStarLoc());
+		if (!Star || Star->second == 0)
+		{
+			continue;
+		}
+
+		const CSCTokenStream &Toks = Layout.tokens(Star->first);
+		tok::TokenKind Prev = Toks[Star->second - 1].Kind;
+		if (Prev == tok::star)
+		{
+			Layout.expect(CSCRule::R4_3, Star->first, Star->second,
+				CSCGapCheck::NoGap);
+		}
+		else if (Prev != tok::l_paren)
+		{
+			Layout.expect(CSCRule::R4_3, Star->first, Star->second,
+				CSCGapCheck::Blank);
+		}
+
+		// `* const p` is fine, the next star checks its own gap
+		if (Name && *Name == std::make_pair(Star->first, Star->second + 1))
+		{
+			Layout.expect(CSCRule::R4_3, Star->first, Star->second + 1,
+				CSCGapCheck::NoGap);
+		}
+	}
+}
+
+void CodeStyleCheckerVisitor::check_rule_4_5_1(FunctionDecl *Decl)
+{
+	// Methods defined in the class body (and lambdas) are laid out with the
+	// class
+	if (!is_rule_active(CSCRule::R4_5_1) || Decl->isImplicit() ||
+		Decl->isTemplateInstantiation() ||
+		Decl->getLexicalDeclContext()->isRecord() ||
+		!Decl->doesThisDeclarationHaveABody())
+	{
+		return;
+	}
+
+	const auto *Body = dyn_cast_or_null<CompoundStmt>(Decl->getBody());
+	if (!Body)
+	{
+		return;
+	}
+
+	//    char *
+	//    copy_str(const char *instr)
+	//    {
+	//    }
+	SourceLocation Name = Decl->getQualifierLoc()
+		? Decl->getQualifierLoc().getBeginLoc()
+		: Decl->getLocation();
+	Layout.expect_before(CSCRule::R4_5_1, Name, CSCGapCheck::LineStart);
+	if (FunctionTypeLoc FTL = Decl->getFunctionTypeLoc())
+	{
+		Layout.expect_before(CSCRule::R4_5_1, FTL.getLParenLoc(),
+			CSCGapCheck::NoGap);
+	}
+	Layout.expect_before(CSCRule::R4_5_1, Body->getLBracLoc(),
+		CSCGapCheck::LineStart);
+	Layout.expect_before(CSCRule::R4_5_1, Body->getRBracLoc(),
+		CSCGapCheck::LineStart);
+}
+
+void CodeStyleCheckerVisitor::check_rule_4_5_2(FunctionDecl *Decl)
+{
+	// In C++ a method, a constructor or a deduction guide with `(void)`
+	// would only look odd
+	if (!is_rule_active(CSCRule::R4_5_2) || Decl->isImplicit() ||
+		Decl->isTemplateInstantiation() ||
+		isa<CXXMethodDecl, CXXDeductionGuideDecl>(Decl) ||
+		Decl->getNumParams() != 0 || Decl->isVariadic())
+	{
+		return;
+	}
+
+	FunctionTypeLoc FTL = Decl->getFunctionTypeLoc();
+	if (!FTL)
+	{
+		return;
+	}
+
+	// `f()` - `f(void)` has no parameters either
+	auto LParen = Layout.find(FTL.getLParenLoc());
+	if (!LParen)
+	{
+		return;
+	}
+	const CSCTokenStream &Toks = Layout.tokens(LParen->first);
+	if (LParen->second + 1 >= Toks.size() ||
+		Toks[LParen->second + 1].Kind != tok::r_paren)
+	{
+		return;
+	}
+
+	SourceLocation RParen = FTL.getRParenLoc();
+	if (!account(CSCRule::R4_5_2, RParen))
+	{
+		return;
+	}
+
+	report(CSCRule::R4_5_2, RParen,
+		FixItHint::CreateInsertion(RParen, "void"));
+}
+
+void CodeStyleCheckerVisitor::check_rule_4_6_8(SwitchStmt *S)
+{
+	if (!is_rule_active(CSCRule::R4_6_8) || !Flow)
+	{
+		return;
+	}
+
+	const CFG *Graph = Flow->cfg();
+	if (!Graph)
+	{
+		return;
+	}
+
+	for (const SwitchCase *Case :
+		findFallThroughs(S, *Graph, Flow->reachable()))
+	{
+		if (!account(CSCRule::R4_6_8, Case->getKeywordLoc()))
+		{
+			return;
+		}
+
+		report(CSCRule::R4_6_8, Case->getKeywordLoc());
+	}
+}
+
+void CodeStyleCheckerVisitor::expect_before(CSCRule Rule, SourceLocation Loc,
+	CSCGapCheck Check)
+{
+	if (is_rule_active(Rule))
+	{
+		Layout.expect_before(Rule, Loc, Check);
+	}
+}
+
+void CodeStyleCheckerVisitor::expect_after(CSCRule Rule, SourceLocation Loc,
+	CSCGapCheck Check)
+{
+	if (is_rule_active(Rule))
+	{
+		Layout.expect_after(Rule, Loc, Check);
+	}
+}
+
+void CodeStyleCheckerVisitor::expect_parens(SourceLocation LParen,
+	SourceLocation RParen)
+{
+	// A line break after `(` is how long parameter lists are written (R4.5.3)
+	expect_after(CSCRule::R4_7_6, LParen, CSCGapCheck::NoBlank);
+	expect_before(CSCRule::R4_7_6, RParen, CSCGapCheck::NoBlank);
+}
+
+void CodeStyleCheckerVisitor::check_comment(SourceLocation Loc,
+	StringRef Text)
+{
+	if (!is_rule_active(CSCRule::R5_12) ||
+		!isCommentedOutCode(Text, Ctx->getLangOpts()))
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_12, Loc))
+	{
+		return;
+	}
+
+	report(CSCRule::R5_12, Loc);
+}
+
+void CodeStyleCheckerVisitor::skipped_range(SourceRange Range)
+{
+	const SourceManager &SM = Ctx->getSourceManager();
+	if (!SM.isWrittenInMainFile(Range.getBegin()))
+	{
+		return;
+	}
+
+	SkippedRanges.emplace_back(SM.getFileOffset(Range.getBegin()),
+		SM.getFileOffset(Range.getEnd()));
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_2(VarDecl *Decl)
+{
+	if (!is_rule_active(CSCRule::R5_2) || !isIntegerConstant(Decl, *Ctx))
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_2, Decl->getLocation()))
+	{
+		return;
+	}
+
+	report(CSCRule::R5_2, Decl->getLocation());
+}
+
+void CodeStyleCheckerVisitor::check_io_call(CallExpr *E)
+{
+	if ((ActiveRules & IORules) == 0)
+	{
+		return;
+	}
+
+	std::optional<CSCIOCall> IO = classifyIOCall(E);
+	if (!IO || !IO->Text)
+	{
+		return;
+	}
+
+	const CSCFormatString *Format =
+		FormatStrings.get(IO->Text, IO->format_kind());
+	if (!Format)
+	{
+		return;
+	}
+
+	check_rule_5_4(E, *IO, *Format);
+	check_rule_5_5(E, *IO, *Format);
+	check_rule_5_8(*IO, *Format);
+}
+
+std::optional<FixItHint>
+CodeStyleCheckerVisitor::newline_fixit(const StringLiteral *SL)
+{
+	const SourceManager &SM = Ctx->getSourceManager();
+	SourceLocation Last = SL->getStrTokenLoc(SL->getNumConcatenated() - 1);
+	if (Last.isMacroID())
+	{
+		return std::nullopt;
+	}
+
+	// The closing quote of a raw string follows its delimiter
+	unsigned Length = Lexer::MeasureTokenLength(Last, SM, Ctx->getLangOpts());
+	StringRef Token(SM.getCharacterData(Last), Length);
+	if (Length < 2 || !Token.starts_with("\"") || !Token.ends_with("\""))
+	{
+		return std::nullopt;
+	}
+
+	return FixItHint::CreateInsertion(Last.getLocWithOffset(Length - 1),
+		"\\n");
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_4(CallExpr *E, const CSCIOCall &IO,
+	const CSCFormatString &Format)
+{
+	if (!is_rule_active(CSCRule::R5_4) || IO.Stream != CSCStream::Stdout ||
+		IO.Function == CSCIOCall::Scan || !Format.LooksLikeDiagnostic)
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_4, E->getExprLoc()))
+	{
+		return;
+	}
+
+	// printf(...) -> fprintf(stderr, ...). puts adds a newline that fputs
+	// does not, so it is left alone.
+	llvm::SmallVector<FixItHint, 2> Hints;
+	const auto *Callee =
+		dyn_cast<DeclRefExpr>(E->getCallee()->IgnoreImpCasts());
+	if (Callee && Callee->getNameInfo().getAsString() == "printf" &&
+		!Callee->getLocation().isMacroID() &&
+		!E->getArg(0)->getBeginLoc().isMacroID())
+	{
+		Hints.push_back(FixItHint::CreateReplacement(
+			CharSourceRange::getTokenRange(Callee->getLocation()), "fprintf"));
+		Hints.push_back(FixItHint::CreateInsertion(E->getArg(0)->getBeginLoc(),
+			"stderr, "));
+	}
+
+	report(CSCRule::R5_4, E->getExprLoc(), Hints);
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_5(CallExpr *E, const CSCIOCall &IO,
+	const CSCFormatString &Format)
+{
+	if (!is_rule_active(CSCRule::R5_5) || IO.Stream != CSCStream::Stderr ||
+		(IO.Function != CSCIOCall::Print && IO.Function != CSCIOCall::Write) ||
+		!Format.lacks_newline())
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_5, E->getExprLoc()))
+	{
+		return;
+	}
+
+	llvm::SmallVector<FixItHint, 1> Hints;
+	if (std::optional<FixItHint> Hint = newline_fixit(IO.Text))
+	{
+		Hints.push_back(*Hint);
+	}
+	report(CSCRule::R5_5, E->getExprLoc(), Hints);
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_6(FunctionDecl *Decl)
+{
+	if (!is_rule_active(CSCRule::R5_6) || !Decl->isMain() || !Flow ||
+		Flow->function() != Decl)
+	{
+		return;
+	}
+
+	const CFG *Graph = Flow->cfg();
+	if (!Graph)
+	{
+		return;
+	}
+
+	for (const CallExpr *E : findLastOutputs(*Graph, Flow->reachable(),
+		Ctx->getSourceManager()))
+	{
+		// putchar() - character by character processing is exempt. puts()
+		// ends the line itself.
+		std::optional<CSCIOCall> IO = classifyIOCall(E);
+		if (!IO || !IO->Text || (IO->Function != CSCIOCall::Print &&
+			IO->Function != CSCIOCall::Write))
+		{
+			continue;
+		}
+
+		const CSCFormatString *Format =
+			FormatStrings.get(IO->Text, IO->format_kind());
+		if (!Format || !Format->lacks_newline())
+		{
+			continue;
+		}
+
+		if (!account(CSCRule::R5_6, E->getExprLoc()))
+		{
+			return;
+		}
+
+		llvm::SmallVector<FixItHint, 1> Hints;
+		if (std::optional<FixItHint> Hint = newline_fixit(IO->Text))
+		{
+			Hints.push_back(*Hint);
+		}
+		report(CSCRule::R5_6, E->getExprLoc(), Hints);
+	}
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_7(FunctionDecl *Decl)
+{
+	if (!is_rule_active(CSCRule::R5_7) || !Decl->isMain() || !Flow ||
+		Flow->function() != Decl)
+	{
+		return;
+	}
+
+	const CFG *Graph = Flow->cfg();
+	if (!Graph)
+	{
+		return;
+	}
+
+	for (SourceLocation Loc :
+		findMainReturnViolations(Decl, *Graph, Flow->reachable(), *Ctx))
+	{
+		if (!account(CSCRule::R5_7, Loc))
+		{
+			return;
+		}
+
+		report(CSCRule::R5_7, Loc);
+	}
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_8(CallExpr *E)
+{
+	if (!is_rule_active(CSCRule::R5_8))
+	{
+		return;
+	}
+
+	const FunctionDecl *Callee = E->getDirectCallee();
+	if (!Callee || !isForbiddenFunction(Callee))
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_8, E->getExprLoc()))
+	{
+		return;
+	}
+
+	report(CSCRule::R5_8, E->getExprLoc());
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_8(const CSCIOCall &IO,
+	const CSCFormatString &Format)
+{
+	if (!is_rule_active(CSCRule::R5_8) || IO.Function != CSCIOCall::Scan)
+	{
+		return;
+	}
+
+	for (const CSCFormatSpec &Spec : Format.Specs)
+	{
+		if (!Spec.is_unbounded_string())
+		{
+			continue;
+		}
+
+		// The '%' of the conversion inside the literal
+		SourceLocation Loc = IO.Text->getLocationOfByte(Spec.Offset,
+			Ctx->getSourceManager(), Ctx->getLangOpts(), Ctx->getTargetInfo());
+		if (!account(CSCRule::R5_8, Loc))
+		{
+			return;
+		}
+
+		report(CSCRule::R5_8, Loc);
+	}
+}
+
+void CodeStyleCheckerVisitor::check_rule_5_17(VarDecl *Decl)
+{
+	// Only the locals of the function whose flow we have, not those of a
+	// lambda or a block inside it
+	if (!is_rule_active(CSCRule::R5_17) || !Flow ||
+		!Decl->hasLocalStorage() || isa<ParmVarDecl>(Decl) ||
+		Decl->getParentFunctionOrMethod() != Flow->function())
+	{
+		return;
+	}
+
+	QualType Type = Decl->getType();
+	if (!Type->isPointerType() && !Type->isIntegerType())
+	{
+		return;
+	}
+
+	const Expr *Init = Decl->getInit();
+	bool AtStart = isDeclaredAtStart(Decl, Flow->function());
+	bool Resource = isResourceHandleType(Type) ||
+		(Init && isResourceAcquisition(Init));
+
+	// Defined and initialized right - whatever it holds later. Only the
+	// rest needs the CFG to tell `int i;` from `int fd; ... fd = open(...)`.
+	if (!Resource && Init && AtStart)
+	{
+		return;
+	}
+	if (!Resource && !Flow->acquires_resource(Decl))
+	{
+		return;
+	}
+	if (Init && AtStart)
+	{
+		return;
+	}
+
+	if (!account(CSCRule::R5_17, Decl->getLocation()))
+	{
+		return;
+	}
+
+	report(CSCRule::R5_17, Decl->getLocation());
+}
+
+void CodeStyleCheckerVisitor::check_naming(CSCRule Rule, NamedDecl *Decl)
+{
+	if (!is_rule_active(Rule))
+	{
+		return;
+	}
+
+	// One diagnostic per symbol: its FixIt renames all the redeclarations
+	const auto *Canonical = cast<NamedDecl>(Decl->getCanonicalDecl());
+	if (PendingRenameDecls.count(Canonical))
+	{
+		return;
+	}
+
+	const NamingVerdict &Verdict = naming_verdict(Rule, Decl);
+	if (Verdict.Hint.empty())
+	{
+		return;
+	}
+
+	if (!account(Rule, Decl->getLocation()))
+	{
+		return;
+	}
+
+	// The references that follow the declaration are not known yet - the
+	// diagnostic is emitted by report_renames() after the traversal
+	PendingRenameDecls.insert(Canonical);
+	PendingRenames.push_back({Rule, Canonical,
+		Decl->getLocation().getLocWithOffset(Verdict.FirstBad),
+		Verdict.NameLength, Verdict.Hint});
+}
+
+const CodeStyleCheckerVisitor::NamingVerdict &
+CodeStyleCheckerVisitor::naming_verdict(CSCRule Rule, const NamedDecl *Decl)
+{
+	const IdentifierInfo *II = Decl->getIdentifier();
+	NamingVerdict &Verdict = II
+		? NamingVerdicts[{II, static_cast<unsigned>(Rule)}]
+		: UnsharedVerdict;
+	if (II && Verdict.Known)
+	{
+		return Verdict;
+	}
+
+	Verdict = NamingVerdict();
+	Verdict.Known = true;
+
+	std::string Name = Decl->getNameAsString();
+
+	// Changing the case can't make a non-English name right (R3.2)
+	if (!isEnglishName(Name))
+	{
+		return Verdict;
+	}
+
+	size_t FirstBad = 0;
+	std::string Hint = fixName(Rule, Name, &FirstBad);
+	if (Hint != Name)
+	{
+		Verdict.Hint = std::move(Hint);
+		Verdict.FirstBad = FirstBad;
+		Verdict.NameLength = Name.size();
+	}
+
+	return Verdict;
+}
+
+std::vector<SourceLocation>
+CodeStyleCheckerVisitor::rename_locations(const NamedDecl *Canonical) const
+{
+	const SourceManager &SM = Ctx->getSourceManager();
+	std::vector<SourceLocation> Result;
+
+	auto Add = [&](SourceLocation Loc) {
+		// A name spelled inside a macro body can't be renamed from here
+		if (Loc.isMacroID())
+		{
+			if (!SM.isMacroArgExpansion(Loc))
+			{
+				return;
+			}
+			Loc = SM.getSpellingLoc(Loc);
+		}
+		if (Loc.isValid() && !SM.isInSystemHeader(Loc))
+		{
+			Result.push_back(Loc);
+		}
+	};
+
+	// Redeclarations in headers that were not traversed (-main-tu-only)
+	for (const Decl *Redecl : Canonical->redecls())
+	{
+		if (!Redecl->isImplicit())
+		{
+			Add(Redecl->getLocation());
+		}
+	}
+
+	auto It = References.find(Canonical);
+	if (It != References.end())
+	{
+		for (SourceLocation Loc : It->second)
+		{
+			Add(Loc);
+		}
+	}
+
+	llvm::sort(Result, [](SourceLocation L, SourceLocation R) {
+		return L.getRawEncoding() < R.getRawEncoding();
+	});
+	Result.erase(std::unique(Result.begin(), Result.end()), Result.end());
+
+	return Result;
+}
+
+void CodeStyleCheckerVisitor::report_renames(bool ReferencesComplete)
+{
+	for (const PendingRename &Rename : PendingRenames)
+	{
+		std::vector<FixItHint> Hints;
+
+		// After an early exit (-max-per-rule) some references were never
+		// seen, and renaming only the rest would break the code
+		if (ReferencesComplete)
+		{
+			for (SourceLocation Loc : rename_locations(Rename.Decl))
+			{
+				Hints.push_back(FixItHint::CreateReplacement(
+					CharSourceRange::getCharRange(Loc,
+						Loc.getLocWithOffset(Rename.NameLength)),
+					Rename.Hint));
+			}
+		}
+
+		report(Rename.Rule, Rename.Loc, Hints);
+	}
+
+	PendingRenames.clear();
+	PendingRenameDecls.clear();
+}
+
+void CodeStyleCheckerVisitor::check_control_chars(FileID FID)
+{
+	if (!is_rule_active(CSCRule::R1_1))
+	{
+		return;
+	}
+
+	const SourceManager &SM = Ctx->getSourceManager();
+
+	// The buffer is already in the SourceManager, the file is not re-read
+	bool Invalid = false;
+	StringRef Code = SM.getBufferData(FID, &Invalid);
+	if (Invalid)
+	{
+		return;
+	}
+
+	SourceLocation Start = SM.getLocForStartOfFile(FID);
+
+	// Tabs are left to the clang-format check, if it runs
+	bool WithTabs = !Opts.Style || Opts.Style->DisableFormat;
+
+	// With -changed-lines, only the changed line spans are scanned
+	llvm::sort(FlaggedLiterals);
+	for (const auto &Span : changed_spans(FID))
+	{
+		for (unsigned Offset : findControlChars(Code, FlaggedLiterals,
+			WithTabs, Span.first, Span.second))
+		{
+			if (!is_rule_active(CSCRule::R1_1))
+			{
+				return;
+			}
+
+			SourceLocation Loc = Start.getLocWithOffset(Offset);
+			if (!account(CSCRule::R1_1, Loc))
+			{
+				continue;
+			}
+
+			report(CSCRule::R1_1, Loc, FixItHint::CreateRemoval(
+				CharSourceRange::getCharRange(Loc, Loc.getLocWithOffset(1))));
+		}
+	}
+}
+
+void CodeStyleCheckerVisitor::check_formatting(FileID FID,
+	const format::FormatStyle &Style)
+{
+	SourceManager &SM = Ctx->getSourceManager();
+
+	// The buffer is the one the parser has already read - no second file read
+	StringRef Code = SM.getBufferData(FID);
+	StringRef FileName = SM.getFilename(SM.getLocForStartOfFile(FID));
+
+	if (!is_rule_active(CSCRule::Format))
+	{
+		return;
+	}
+
+	// With -changed-lines, clang-format only looks at the changed line spans
+	std::vector<tooling::Range> Ranges;
+	for (const auto &Span : changed_spans(FID))
+	{
+		Ranges.emplace_back(Span.first, Span.second - Span.first);
+	}
+	if (Ranges.empty())
+	{
+		return;
+	}
+
+	tooling::Replacements Replaces;
+	{
+		CSCRuleAllocPause Pause;
+		Replaces = format::reformat(Style, Code, Ranges, FileName);
+	}
+
+	if (Replaces.empty())
+	{
+		return;
+	}
+
+	SourceLocation FileStart = SM.getLocForStartOfFile(FID);
+
+	for (const tooling::Replacement &R : Replaces)
+	{
+		// clang-format also emits replacements that rewrite whitespace with
+		// the very same whitespace - these are not violations.
+		if (Code.substr(R.getOffset(), R.getLength()) == R.getReplacementText())
+		{
+			continue;
+		}
+
+		SourceLocation Begin = FileStart.getLocWithOffset(R.getOffset());
+
+		if (!is_rule_active(CSCRule::Format))
+		{
+			break;
+		}
+		if (!account(CSCRule::Format, Begin))
+		{
+			continue;
+		}
+
+		SourceLocation End = Begin.getLocWithOffset(R.getLength());
+
+		FixItHint FixItHint = FixItHint::CreateReplacement(
+			CharSourceRange::getCharRange(Begin, End),
+			R.getReplacementText());
+
+		report(CSCRule::Format, Begin, FixItHint);
+	}
+}
+
+void CodeStyleCheckerVisitor::check_layout(FileID FID)
+{
+	if (!(ActiveRules & LayoutRules))
+	{
+		return;
+	}
+
+	// R4.7.3 holds for every comma, whatever it separates - no AST needed.
+	// With -changed-lines, only the commas on the changed lines.
+	if (is_rule_active(CSCRule::R4_7_3))
+	{
+		const CSCTokenStream &Toks = Layout.tokens(FID);
+		unsigned I = 0;
+		for (const auto &Span : changed_spans(FID))
+		{
+			while (I < Toks.size() && Toks[I].Offset < Span.first)
+			{
+				++I;
+			}
+			for (; I + 1 < Toks.size() && Toks[I].Offset < Span.second; ++I)
+			{
+				if (Toks[I].Kind == tok::comma)
+				{
+					Layout.expect(CSCRule::R4_7_3, FID, I + 1,
+						CSCGapCheck::Blank);
+				}
+			}
+		}
+	}
+
+	const SourceManager &SM = Ctx->getSourceManager();
+	Layout.check([&](const CSCLayout::Expectation &E,
+		const CSCTokenStream &Toks) {
+		if (!is_rule_active(E.Rule))
+		{
+			return;
+		}
+
+		SourceLocation Start = SM.getLocForStartOfFile(E.FID);
+		StringRef Gap = Toks.gap_text(E.Token);
+		unsigned TokenOffset = Toks[E.Token].Offset;
+		SourceLocation TokenLoc = Start.getLocWithOffset(TokenOffset);
+		SourceLocation GapLoc =
+			Start.getLocWithOffset(TokenOffset - Gap.size());
+		CSCTokenStream::Gap Kind = Toks.gap(E.Token);
+
+		// A missing space is reported at the token, an extra one where it
+		// starts. Gaps with comments get no FixIt.
+		SourceLocation Loc = TokenLoc;
+		FixItHint Hint;
+		switch (E.Check)
+		{
+		case CSCGapCheck::NoGap:
+		case CSCGapCheck::NoBlank:
+			Loc = GapLoc;
+			if (Kind == CSCTokenStream::Gap::Blank)
+			{
+				Hint = FixItHint::CreateRemoval(
+					CharSourceRange::getCharRange(GapLoc, TokenLoc));
+			}
+			break;
+		case CSCGapCheck::Blank:
+			Hint = FixItHint::CreateInsertion(TokenLoc, " ");
+			break;
+		case CSCGapCheck::LineStart:
+		{
+			size_t LastBreak = Gap.find_last_of("\n\r");
+			if (Kind == CSCTokenStream::Gap::Comment)
+			{
+				break;
+			}
+			if (LastBreak == StringRef::npos)
+			{
+				// On the line of the previous token
+				Hint = FixItHint::CreateReplacement(
+					CharSourceRange::getCharRange(GapLoc, TokenLoc), "\n");
+			}
+			else
+			{
+				// Indented
+				Hint = FixItHint::CreateRemoval(CharSourceRange::getCharRange(
+					GapLoc.getLocWithOffset(LastBreak + 1), TokenLoc));
+			}
+			break;
+		}
+		}
+
+		if (!account(E.Rule, Loc))
+		{
+			return;
+		}
+
+		if (Hint.isNull())
+		{
+			report(E.Rule, Loc);
+		}
+		else
+		{
+			report(E.Rule, Loc, Hint);
+		}
+	});
+}
+
+//-----------------------------------------------------------------------------
+// CodeStyleCheckerASTConsumer implementation
+//-----------------------------------------------------------------------------
+bool CodeStyleCheckerASTConsumer::replay_cached(llvm::StringRef Config)
+{
+	// These need the AST (-index, -project) or filter by something that is
+	// not in the token stream
+	if (!Opts.Cache || !Opts.MainTUOnly || Opts.Baseline ||
+		Opts.ChangedLines || Opts.Index || Opts.Project)
+	{
+		return false;
+	}
+
+	// Only lexed, the preprocessor has not entered the file yet
+	CacheTokens = &Visitor.tokens(SM.getMainFileID());
+	CacheKey = CSCResultCache::key(*CacheTokens, Config);
+
+	// A user header that changed makes it a miss
+	if (std::shared_ptr<const CSCResultCache::Entry> Entry = Opts.Cache->lookup(
+		CacheKey, SM.getFileManager().getVirtualFileSystem()))
+	{
+		end_phase(CSCPhase::Parse);
+		{
+			CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+			Visitor.replay(*Entry, *CacheTokens);
+		}
+		end_phase(CSCPhase::Check);
+		report_buffer_rules();
+		return true;
+	}
+
+	Visitor.start_recording(CacheEntry, *CacheTokens);
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// FrontendAction
+//-----------------------------------------------------------------------------
+namespace
+{
+
+// What the plugin arguments set up, and whatever Opts points into. Shared
+// by the action and its consumers: an action added next to the compile
+// (-add-plugin) is destroyed as soon as it has created its consumer, so the
+// consumer keeps the state alive and finishes the TU itself.
+struct CSCPluginState
+{
+	CodeStyleCheckerOptions Opts;
+	std::string FormatStyleName = "file";
+	std::string OutputPath;
+	std::unique_ptr<llvm::raw_fd_ostream> Output;
+	std::unique_ptr<format::FormatStyle> Style;
+	std::string BaselinePath;
+	CSCBaseline Baseline;
+	CSCChangedLines ChangedLines;
+	std::string IndexPath;
+	CSCSymbolIndex Index;
+
+	// Loads the style once per compiler process. The .clang-format file is
+	// looked up starting from the directory of InFile.
+	void load_style(llvm::StringRef InFile)
+	{
+		if (!FormatStyleName.empty() && !Style)
+		{
+			llvm::Expected<format::FormatStyle> StyleOrErr =
+				format::getStyle(FormatStyleName, InFile, "none");
+
+			if (!StyleOrErr)
+			{
+				llvm::errs() << "CSC: cannot load format style: "
+					<< llvm::toString(StyleOrErr.takeError()) << "\n";
+				FormatStyleName.clear();
+			}
+			else
+			{
+				Style = std::make_unique<format::FormatStyle>(*StyleOrErr);
+			}
+		}
+		Opts.Style = Style.get();
+	}
+
+	// Opens the side file of the TU of InFile. On failure the warnings go to
+	// the build log - the compile itself must not fail because of it.
+	void open_output(llvm::StringRef InFile)
+	{
+		SmallString<256> Path(OutputPath);
+		if (llvm::sys::path::is_separator(OutputPath.back()) ||
+			llvm::sys::fs::is_directory(OutputPath))
+		{
+			llvm::sys::path::append(Path,
+				llvm::sys::path::filename(InFile) + ".csc");
+		}
+
+		std::error_code EC;
+		Output = std::make_unique<llvm::raw_fd_ostream>(Path, EC,
+			llvm::sys::fs::OF_Text);
+		if (EC)
+		{
+			llvm::errs() << "CSC: cannot write '" << Path << "': "
+				<< EC.message() << "\n";
+			Output.reset();
+			return;
+		}
+
+		Opts.Output = Output.get();
+	}
+
+	// Closes the side file and writes the baseline and the index once the
+	// TU has been checked
+	void finish()
+	{
+		Opts.Output = nullptr;
+		Output.reset();
+
+		if (Opts.WriteBaseline)
+		{
+			if (llvm::Error E = Baseline.merge_into(BaselinePath))
+			{
+				llvm::errs() << "CSC: " << llvm::toString(std::move(E))
+					<< "\n";
+			}
+		}
+
+		// Only replaces the records of the current TU
+		if (Opts.Index)
+		{
+			if (llvm::Error E = Index.merge_into(IndexPath))
+			{
+				llvm::errs() << "CSC: " << llvm::toString(std::move(E))
+					<< "\n";
+			}
+		}
+	}
+};
+
+// A base of CSCPluginConsumer, so that the state is constructed before and
+// destroyed after the consumer that refers to it
+struct CSCPluginStateHolder
+{
+	std::shared_ptr<CSCPluginState> State;
+};
+
+class CSCPluginConsumer
+	: private CSCPluginStateHolder, public CodeStyleCheckerASTConsumer
+{
+public:
+	CSCPluginConsumer(
+		std::shared_ptr<CSCPluginState> PluginState,
+		CompilerInstance &Compiler)
+		: CSCPluginStateHolder{std::move(PluginState)},
+		CodeStyleCheckerASTConsumer(&Compiler.getASTContext(), State->Opts,
+			Compiler.getSourceManager()) {}
+
+	void HandleTranslationUnit(ASTContext &Ctx) override
+	{
+		CodeStyleCheckerASTConsumer::HandleTranslationUnit(Ctx);
+		State->finish();
+	}
+};
+
+} // namespace
+
+class CSCASTAction : public PluginASTAction
+{
+public:
+	std::unique_ptr<ASTConsumer>
+	CreateASTConsumer(
+		CompilerInstance &Compiler,
+		llvm::StringRef InFile) override
+	{
+		State->load_style(InFile);
+
+		if (!State->OutputPath.empty())
+		{
+			State->open_output(InFile);
+		}
+
+		auto Consumer = std::make_unique<CSCPluginConsumer>(State, Compiler);
+
+		// Macros, includes and header guards are checked while the
+		// preprocessor runs, on the tokens it lexes anyway
+		Compiler.getPreprocessor().addPPCallbacks(
+			Consumer->create_pp_callbacks(Compiler.getPreprocessor()));
+
+		return Consumer;
+	}
+
+	// With -add-plugin CSC (-fplugin loads it, -Xclang -add-plugin -Xclang
+	// CSC adds it) the checker runs next to the real compile, sharing its
+	// AST: a normal build only pays for the traversal. `-plugin CSC` runs it
+	// instead of the compile.
+	ActionType getActionType() override
+	{
+		return CmdlineAfterMainAction;
+	}
+
+	bool ParseArgs(
+		const CompilerInstance &CI,
+		const std::vector<std::string> &Args) override
+	{
+		CodeStyleCheckerOptions &Opts = State->Opts;
+
+		for (StringRef Arg : Args)
+		{
+			if (Arg.starts_with("-main-tu-only="))
+			{
+				Opts.MainTUOnly =
+				Arg.substr(strlen("-main-tu-only=")).equals_insensitive("true");
+			}
+			else if (Arg == "-summary")
+			{
+				Opts.Summary = true;
+			}
+			else if (Arg == "-compact")
+			{
+				Opts.Compact = true;
+			}
+			else if (Arg == "-snippets")
+			{
+				Opts.Snippets = true;
+			}
+			else if (Arg.starts_with("-output="))
+			{
+				State->OutputPath = Arg.substr(strlen("-output=")).str();
+			}
+			else if (Arg.starts_with("-max-per-rule="))
+			{
+				if (Arg.substr(strlen("-max-per-rule=")).getAsInteger(10,
+					Opts.MaxPerRule))
+				{
+					llvm::errs() << "CSC: invalid value for -max-per-rule\n";
+					return false;
+				}
+			}
+			else if (Arg.starts_with("-format-style="))
+			{
+				State->FormatStyleName =
+					Arg.substr(strlen("-format-style=")).str();
+				if (State->FormatStyleName == "none")
+				{
+					State->FormatStyleName.clear();
+				}
+			}
+			else if (Arg.starts_with("-baseline="))
+			{
+				State->BaselinePath = Arg.substr(strlen("-baseline=")).str();
+			}
+			else if (Arg == "-write-baseline")
+			{
+				Opts.WriteBaseline = true;
+			}
+			else if (Arg.starts_with("-index="))
+			{
+				// Read when the TU is merged into it, see finish()
+				State->IndexPath = Arg.substr(strlen("-index=")).str();
+				Opts.Index = &State->Index;
+			}
+			else if (Arg.starts_with("-changed-lines="))
+			{
+				llvm::Expected<CSCChangedLines> Lines =
+					CSCChangedLines::fromGitDiff(
+						Arg.substr(strlen("-changed-lines=")));
+				if (!Lines)
+				{
+					llvm::errs() << "CSC: " << llvm::toString(Lines.takeError())
+						<< "\n";
+					return false;
+				}
+				State->ChangedLines = std::move(*Lines);
+				Opts.ChangedLines = &State->ChangedLines;
+			}
+			else if (Arg.starts_with("-help"))
+			{
+				PrintHelp(llvm::errs());
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		if (!State->BaselinePath.empty())
+		{
+			// With -write-baseline every compiler process merges the
+			// fingerprints of its TU into the file once the TU is checked
+			if (!Opts.WriteBaseline)
+			{
+				if (llvm::Error E = State->Baseline.load(State->BaselinePath))
+				{
+					llvm::errs() << "CSC: " << llvm::toString(std::move(E))
+						<< "\n";
+					return false;
+				}
+			}
+			Opts.Baseline = &State->Baseline;
+		}
+		else if (Opts.WriteBaseline)
+		{
+			llvm::errs() << "CSC: -write-baseline requires -baseline=<file>\n";
+			return false;
 		}
 
 		return true;
@@ -324,11 +2292,33 @@ public:
 
 	void PrintHelp(llvm::raw_ostream &ros)
 	{
-		ros << "Help for CodeStyleChecker plugin goes here\n";
+		ros << "Help for CodeStyleChecker plugin goes here\n"
+			<< "  -main-tu-only=<bool>  only check the main file (default: true)\n"
+			<< "  -format-style=<style> style for the clang-format check "
+			   "(default: file, none - disabled)\n"
+			<< "  -summary              print per-rule counts instead of "
+			   "the warnings\n"
+			<< "  -max-per-rule=<N>     stop checking a rule after N "
+			   "violations per TU\n"
+			<< "  -compact              print sorted one-line records at the "
+			   "end of the TU\n"
+			<< "  -snippets             with -compact, also print the source "
+			   "line\n"
+			<< "  -output=<file|dir/>   write the warnings to <file> (or to "
+			   "<dir>/<input>.csc)\n"
+			<< "                        instead of the build log\n"
+			<< "  -baseline=<file>      don't report the violations listed in "
+			   "<file>\n"
+			<< "  -write-baseline       add the violations to the -baseline "
+			   "file instead\n"
+			<< "  -changed-lines=<git diff range> only check the lines "
+			   "changed in the range\n"
+			<< "  -index=<file>         record the misnamed symbols and their "
+			   "references in <file>\n";
 	}
 
 private:
-	bool MainTuOnly = true;
+	std::shared_ptr<CSCPluginState> State = std::make_shared<CSCPluginState>();
 };
 
 //-----------------------------------------------------------------------------
@@ -13,6 +13,98 @@
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Format/Format.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeStyleCheckerBaseline.h"
+#include "CodeStyleCheckerCache.h"
+#include "CodeStyleCheckerChangedLines.h"
+#include "CodeStyleCheckerDiagnostics.h"
+#include "CodeStyleCheckerFlow.h"
+#include "CodeStyleCheckerIndex.h"
+#include "CodeStyleCheckerIO.h"
+#include "CodeStyleCheckerLayout.h"
+#include "CodeStyleCheckerMemory.h"
+#include "CodeStyleCheckerMetrics.h"
+#include "CodeStyleCheckerPP.h"
+#include "CodeStyleCheckerProject.h"
+#include "CodeStyleCheckerRules.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Options
+//-----------------------------------------------------------------------------
+struct CodeStyleCheckerOptions
+{
+	// Should this plugin be only run on the main translation unit?
+	bool MainTUOnly = true;
+	// Style used by the in-process formatter check (nullptr = disabled)
+	const clang::format::FormatStyle *Style = nullptr;
+	// Only count the violations per rule and per file, print the counts at
+	// the end of the TU instead of the diagnostics
+	bool Summary = false;
+	// Stop checking a rule in a TU once it has this many violations (0 - no cap)
+	unsigned MaxPerRule = 0;
+	// Print the warnings as sorted one-line records at the end of the TU
+	// (see CSCDiagnosticConsumer) instead of through the text printer
+	bool Compact = false;
+	// In the compact mode, also print the source line and a caret
+	bool Snippets = false;
+	// Where the warnings (as compact records) and the summary go instead of
+	// the build log (nullptr - stderr/stdout as usual)
+	llvm::raw_ostream *Output = nullptr;
+	// Known violations. Matching violations are dropped as soon as they are
+	// detected (nullptr - no baseline).
+	CSCBaseline *Baseline = nullptr;
+	// Record the fingerprint of every violation in Baseline instead of
+	// reporting it
+	bool WriteBaseline = false;
+	// Only check these lines: declarations that don't overlap them are not
+	// traversed at all (nullptr - check everything)
+	const CSCChangedLines *ChangedLines = nullptr;
+	// Receives the symbols that violate the naming rules together with all
+	// their references, for renaming them across TUs (nullptr - disabled)
+	CSCSymbolIndex *Index = nullptr;
+	// Results of the AST and preprocessor rules by token fingerprint, a hit
+	// skips the parse (nullptr - disabled). Only used when nothing above
+	// filters by file or line: -main-tu-only, no -baseline, -changed-lines,
+	// -index or -project.
+	CSCResultCache *Cache = nullptr;
+	// Receives the facts of every TU for the project rules, checked once
+	// all TUs are done (nullptr - no -project)
+	CSCProject *Project = nullptr;
+	// Receives the memory record of every TU (nullptr - no -mem-report)
+	CSCMemoryReport *MemReport = nullptr;
+	// The counters of the worker checking the TU, updated as it finishes
+	// (nullptr - no -progress or -metrics)
+	CSCWorkerCounters *Counters = nullptr;
+	// Stand-ins for stderr and stdout in the workers of the standalone tool
+	// (-j). They are flushed after every TU, so that the output of two TUs
+	// never interleaves (nullptr - the real streams).
+	llvm::raw_ostream *Errs = nullptr;
+	llvm::raw_ostream *Outs = nullptr;
+
+	// Where the compact records go
+	llvm::raw_ostream &diag_stream() const
+	{
+		return Output ? *Output : Errs ? *Errs : llvm::errs();
+	}
+	// Where the summary and the memory records go
+	llvm::raw_ostream &report_stream() const
+	{
+		return Output ? *Output : Outs ? *Outs : llvm::outs();
+	}
+};
 
 //-----------------------------------------------------------------------------
 // RecursiveASTVisitor
@@ -21,7 +113,18 @@ class CodeStyleCheckerVisitor
 	: public clang::RecursiveASTVisitor<CodeStyleCheckerVisitor>
 {
 public:
-	explicit CodeStyleCheckerVisitor(clang::ASTContext *Ctx) : Ctx(Ctx) {}
+	explicit CodeStyleCheckerVisitor(
+		clang::ASTContext *Ctx,
+		const CodeStyleCheckerOptions &Opts,
+		CSCDiagnosticConsumer *Compact = nullptr);
+
+	// Keeps track of the enclosing declaration and of the CFG of the
+	// function being traversed
+	bool TraverseDecl(clang::Decl *D);
+	// True if -changed-lines made TraverseDecl skip a declaration: the
+	// references inside it are not known
+	bool skipped_decls() const { return SkippedDecls; }
+
     bool VisitTagDecl(clang::TagDecl *Decl);
 	bool VisitFunctionDecl(clang::FunctionDecl *Decl);
 	bool VisitVarDecl(clang::VarDecl *Decl);
@@ -30,14 +133,286 @@ public:
     // bool VisitLabelDecl(clang::LabelDecl *Decl); Currently NOT working
 
     bool VisitStringLiteral(clang::StringLiteral *SL);
+	bool VisitCallExpr(clang::CallExpr *E);
+
+	// Layout (R4.7): the tokens of these are checked by check_layout()
+	bool VisitBinaryOperator(clang::BinaryOperator *E);
+	bool VisitUnaryOperator(clang::UnaryOperator *E);
+	bool VisitArraySubscriptExpr(clang::ArraySubscriptExpr *E);
+	bool VisitParenExpr(clang::ParenExpr *E);
+	bool VisitCStyleCastExpr(clang::CStyleCastExpr *E);
+	bool VisitIfStmt(clang::IfStmt *S);
+	bool VisitWhileStmt(clang::WhileStmt *S);
+	bool VisitForStmt(clang::ForStmt *S);
+	bool VisitSwitchStmt(clang::SwitchStmt *S);
+
+	// References to the declarations checked by the naming rules
+	bool VisitDeclRefExpr(clang::DeclRefExpr *E);
+	bool VisitMemberExpr(clang::MemberExpr *E);
+	bool VisitTagTypeLoc(clang::TagTypeLoc TL);
+	// -project: the headers the names used come from
+	bool VisitTypedefTypeLoc(clang::TypedefTypeLoc TL);
+
+	// Scans the buffer of FID for control characters. The ones inside the
+	// string literals already reported by R1 are skipped.
+	void check_control_chars(clang::FileID FID);
+
+	// Runs clang-format in-process on the buffer of FID and reports every
+	// replacement that actually changes the text.
+	void check_formatting(clang::FileID FID,
+		const clang::format::FormatStyle &Style);
+
+	// R5.12 for the comment Text at Loc. Called by CSCPPCallbacks as the
+	// lexer skips the comment, and on a cache hit for the comments of the
+	// token stream.
+	void check_comment(clang::SourceLocation Loc, llvm::StringRef Text);
+	// A block the preprocessor skipped (`#if 0`). Its comments are never
+	// lexed, so a cache hit must not check them either.
+	void skipped_range(clang::SourceRange Range);
+
+	// Checks the gaps the traversal (or a cache replay) expects something of,
+	// plus the commas of FID (R4.7.3), and reports the section 4 violations
+	// with a FixIt that fixes the gap
+	void check_layout(clang::FileID FID);
+
+	// The raw tokens of FID, lexed once per TU and shared by the layout rules
+	// and -cache
+	const CSCTokenStream &tokens(clang::FileID FID)
+	{
+		return Layout.tokens(FID);
+	}
+
+	// Every violation, from the traversal or from CSCPPCallbacks, goes through
+	// account() and then report()
+	bool is_rule_active(CSCRule Rule) const
+	{
+		return ActiveRules & ruleBit(Rule);
+	}
+	// Accounts one violation of Rule at Loc. Returns true if the violation
+	// has to be reported as a diagnostic (i.e. not in -summary mode).
+	bool account(CSCRule Rule, clang::SourceLocation Loc);
+	// Emits the diagnostic of a violation of Rule at Loc, with Hints
+	void report(CSCRule Rule, clang::SourceLocation Loc,
+		llvm::ArrayRef<clang::FixItHint> Hints = std::nullopt);
+
+	// -cache: from now on every violation of CSCResultCache::CachedRules in
+	// the main file is also recorded in Entry, at its position in Toks
+	void start_recording(CSCResultCache::Entry &Entry,
+		const CSCTokenStream &Toks);
+	// Returns false if a violation could not be recorded (e.g. it was in a
+	// header) and Entry must not be cached
+	bool stop_recording();
+	// Reports the violations of a cache hit at the tokens of Toks, as if the
+	// traversal and the preprocessor had found them
+	void replay(const CSCResultCache::Entry &Entry,
+		const CSCTokenStream &Toks);
+
+	// True once every rule checked during the traversal has reached
+	// -max-per-rule. There is nothing left to traverse in this TU then.
+	bool all_rules_capped() const
+	{
+		// The index needs every reference, the project facts every use,
+		// even with all rules capped
+		return !Opts.Index && !Facts &&
+			(ActiveRules & TraversalRules) == 0;
+	}
+
+	// -project: the names used during the traversal go to Facts
+	void set_facts(CSCFactsCollector *Collector) { Facts = Collector; }
+
+	// Emits the naming diagnostics held back during the traversal. Each one
+	// carries a FixIt for every location that spells the name - unless
+	// ReferencesComplete is false (the traversal was cut short or skipped
+	// declarations).
+	void report_renames(bool ReferencesComplete);
+
+	// The symbols of this TU that violate a naming rule, with every location
+	// that spells their names (see CSCSymbolIndex)
+	CSCSymbolIndex::TUSymbols collect_symbols() const;
+
+	// Prints the per-file, per-rule violation counts of this TU
+	void print_summary(llvm::raw_ostream &OS) const;
+	// The violations of Rule accounted in this TU so far
+	unsigned violations(CSCRule Rule) const
+	{
+		return TUCounts[static_cast<unsigned>(Rule)];
+	}
+
+	// The heap allocations of the rule code in this TU, for -mem-report. The
+	// callers count into it with a CSCRuleAllocScope.
+	CSCAllocStats &rule_allocs() { return RuleAllocs; }
 
 private:
+	using RuleCounts = std::array<unsigned, NumCSCRules>;
+
+	// Rules that are checked as CSCLayout expectations
+	static constexpr CSCRuleMask LayoutRules =
+		ruleBit(CSCRule::R4_3) | ruleBit(CSCRule::R4_5_1) |
+		ruleBit(CSCRule::R4_7_1) | ruleBit(CSCRule::R4_7_2) |
+		ruleBit(CSCRule::R4_7_3) | ruleBit(CSCRule::R4_7_4) |
+		ruleBit(CSCRule::R4_7_5) | ruleBit(CSCRule::R4_7_6) |
+		ruleBit(CSCRule::R4_7_7);
+	// Rules that look at the stdio calls
+	static constexpr CSCRuleMask IORules =
+		ruleBit(CSCRule::R5_4) | ruleBit(CSCRule::R5_5) |
+		ruleBit(CSCRule::R5_6) | ruleBit(CSCRule::R5_8);
+	// Rules that are checked by the Visit* methods
+	static constexpr CSCRuleMask TraversalRules =
+		ruleBit(CSCRule::R1) | ruleBit(CSCRule::R3_2) |
+		ruleBit(CSCRule::R3_3) | ruleBit(CSCRule::R3_4) |
+		ruleBit(CSCRule::R3_6) | LayoutRules | ruleBit(CSCRule::R4_5_2) |
+		ruleBit(CSCRule::R4_6_8) | ruleBit(CSCRule::R5_2) |
+		IORules | ruleBit(CSCRule::R5_7) | ruleBit(CSCRule::R5_17);
+	static constexpr CSCRuleMask NamingRules =
+		ruleBit(CSCRule::R3_3) | ruleBit(CSCRule::R3_4) | ruleBit(CSCRule::R3_6);
+
+	// A naming violation waiting for the references of its declaration
+	struct PendingRename
+	{
+		CSCRule Rule;
+		const clang::NamedDecl *Decl;	// canonical
+		clang::SourceLocation Loc;		// where the diagnostic points
+		unsigned NameLength;
+		std::string Hint;
+	};
+
+	// What a naming rule says about a name
+	struct NamingVerdict
+	{
+		bool Known = false;
+		// The name fixed, empty if it is fine (or can't be fixed, R3.2)
+		std::string Hint;
+		unsigned FirstBad = 0;
+		unsigned NameLength = 0;
+	};
+
 	clang::ASTContext *Ctx;
+	const CodeStyleCheckerOptions &Opts;
+	// The compact consumer, if installed (-compact)
+	CSCDiagnosticConsumer *Compact;
+	// Custom DiagIDs of the rules, created on first use
+	std::array<unsigned, NumCSCRules> DiagIDs = {};
+
+	CSCAllocStats RuleAllocs;
+
+	// Bit N is set while rule N is enabled and below its cap
+	CSCRuleMask ActiveRules = 0;
+	RuleCounts TUCounts = {};
+	llvm::DenseMap<clang::FileID, RuleCounts> FileCounts;
+
+	// Innermost function, tag or namespace being traversed
+	const clang::NamedDecl *EnclosingDecl = nullptr;
+	// The control flow of the innermost function body being traversed
+	// (nullptr - none), owned by TraverseDecl
+	CSCFunctionFlow *Flow = nullptr;
+	// -project: the facts of this TU (nullptr - disabled), owned by the
+	// Preprocessor
+	CSCFactsCollector *Facts = nullptr;
+	bool SkippedDecls = false;
+	// Fingerprints use file names relative to this directory
+	llvm::SmallString<256> WorkingDir;
+	// Locations that spell the name of a declaration, by canonical
+	// declaration. Filled during the traversal while a naming rule is active.
+	llvm::DenseMap<const clang::NamedDecl *, std::vector<clang::SourceLocation>>
+		References;
+
+	// -changed-lines intervals of every file seen so far
+	llvm::DenseMap<clang::FileID, const CSCChangedLines::Intervals *>
+		ChangedLinesCache;
+
+	// The token streams and the expectations of the section 4 rules
+	CSCLayout Layout;
+	// The parsed format strings of the stdio calls
+	CSCFormatStrings FormatStrings;
+
+	// Main file offsets [begin, end) of the string literals that violate R1
+	std::vector<std::pair<unsigned, unsigned>> FlaggedLiterals;
+	// Main file offsets [begin, end) of the blocks the preprocessor skipped,
+	// in file order
+	std::vector<std::pair<unsigned, unsigned>> SkippedRanges;
+
+	// Naming violations in the order they were found, one per symbol
+	std::vector<PendingRename> PendingRenames;
+	llvm::DenseSet<const clang::NamedDecl *> PendingRenameDecls;
+	// Verdicts by identifier and rule: the same few names are declared
+	// over and over, only the first declaration looks at the spelling
+	llvm::DenseMap<std::pair<const clang::IdentifierInfo *, unsigned>,
+		NamingVerdict> NamingVerdicts;
+	// The verdict for a name that is not an identifier (operators and such)
+	NamingVerdict UnsharedVerdict;
+
+	// -cache: the entry being recorded (nullptr - not recording)
+	CSCResultCache::Entry *Recording = nullptr;
+	const CSCTokenStream *RecordingTokens = nullptr;
+	bool RecordingValid = true;
+	// Per rule, the first recorded violation not reported yet. Each
+	// accounted violation is reported once, in the order of account() (the
+	// naming ones only after the traversal).
+	std::array<size_t, NumCSCRules> NextToReport = {};
+
+	// Appends a violation of Rule at Loc to Recording
+	void record(CSCRule Rule, clang::SourceLocation Loc);
+	// Stores where the diagnostic of the next recorded violation of Rule
+	// points and its FixIts
+	void record_report(CSCRule Rule, clang::SourceLocation Loc,
+		llvm::ArrayRef<clang::FixItHint> Hints);
+
+	// Remembers that the name of D is spelled at Loc
+	void record_reference(const clang::NamedDecl *D, clang::SourceLocation Loc);
+
+	// Changed lines of FID, nullptr if FID has no changes
+	const CSCChangedLines::Intervals *changed_lines(clang::FileID FID);
+	// Whether R overlaps the changed lines (always true without
+	// -changed-lines)
+	bool is_changed(clang::SourceRange R);
+	// File offsets [begin, end) of the changed lines of FID, in order - the
+	// whole buffer without -changed-lines
+	std::vector<std::pair<unsigned, unsigned>> changed_spans(
+		clang::FileID FID);
+	// Fingerprint of a violation of Rule at Loc, see CSCBaseline
+	uint64_t fingerprint(CSCRule Rule, clang::SourceLocation Loc) const;
+	// Every location that spells the name of Canonical and can be rewritten,
+	// sorted and unique
+	std::vector<clang::SourceLocation>
+	rename_locations(const clang::NamedDecl *Canonical) const;
 
     void check_rule_1(clang::StringLiteral *SL);
-    void check_rule_3_3(clang::NamedDecl *SL);
-    void check_rule_3_4(clang::NamedDecl *SL);
-    void check_rule_3_6(clang::NamedDecl *SL);
+	void check_rule_3_2(clang::NamedDecl *Decl);
+	// Rule is one of 3.3, 3.4 or 3.6
+	void check_naming(CSCRule Rule, clang::NamedDecl *Decl);
+	// The verdict of Rule on the name of Decl, valid until the next call
+	const NamingVerdict &naming_verdict(CSCRule Rule,
+		const clang::NamedDecl *Decl);
+	// The star of every pointer declarator of Decl
+	void check_rule_4_3(clang::DeclaratorDecl *Decl);
+	void check_rule_4_5_1(clang::FunctionDecl *Decl);
+	void check_rule_4_5_2(clang::FunctionDecl *Decl);
+	void check_rule_4_6_8(clang::SwitchStmt *S);
+	// Files a layout expectation if Rule is active
+	void expect_before(CSCRule Rule, clang::SourceLocation Loc,
+		CSCGapCheck Check);
+	void expect_after(CSCRule Rule, clang::SourceLocation Loc,
+		CSCGapCheck Check);
+	// R4.7.6 for a pair of parentheses
+	void expect_parens(clang::SourceLocation LParen,
+		clang::SourceLocation RParen);
+	// `const int N = 8;` - the #define half of R5.2 is in CSCPPCallbacks
+	void check_rule_5_2(clang::VarDecl *Decl);
+	// R5.4, R5.5 and the scanf half of R5.8 for a stdio call
+	void check_io_call(clang::CallExpr *E);
+	void check_rule_5_4(clang::CallExpr *E, const CSCIOCall &IO,
+		const CSCFormatString &Format);
+	void check_rule_5_5(clang::CallExpr *E, const CSCIOCall &IO,
+		const CSCFormatString &Format);
+	void check_rule_5_6(clang::FunctionDecl *Decl);
+	void check_rule_5_7(clang::FunctionDecl *Decl);
+	void check_rule_5_8(clang::CallExpr *E);
+	void check_rule_5_8(const CSCIOCall &IO, const CSCFormatString &Format);
+	// Adds "\n" at the end of SL, std::nullopt if it can't be done safely
+	// (a macro, a raw or prefixed string)
+	std::optional<clang::FixItHint>
+	newline_fixit(const clang::StringLiteral *SL);
+	void check_rule_5_17(clang::VarDecl *Decl);
 };
 
 //-----------------------------------------------------------------------------
@@ -48,41 +423,224 @@ class CodeStyleCheckerASTConsumer : public clang::ASTConsumer
 public:
 	explicit CodeStyleCheckerASTConsumer(
 		clang::ASTContext *Context,
-		bool MainFileOnly,
+		const CodeStyleCheckerOptions &Opts,
 		clang::SourceManager &SM)
-		: Visitor(Context), SM(SM), MainTUOnly(MainFileOnly) {}
+		: Compact((Opts.Compact || Opts.Output)
+			? CSCDiagnosticConsumer::install(Context->getDiagnostics(),
+				Opts.diag_stream(), Opts.Snippets)
+			: nullptr),
+		Visitor(Context, Opts, Compact), Context(Context), SM(SM),
+		Opts(Opts) {}
 
-	void HandleTranslationUnit(clang::ASTContext &Ctx)
+	// The callbacks for the preprocessor-only rules, reporting through the
+	// visitor. The caller registers them with PP.
+	std::unique_ptr<CSCPPCallbacks> create_pp_callbacks(clang::Preprocessor &PP)
 	{
-		if (!MainTUOnly)
+		auto Callbacks = std::make_unique<CSCPPCallbacks>(PP, Visitor, Opts);
+		PPChecks = Callbacks.get();
+		// Lives as long as PP, which owns the callbacks
+		PP.addCommentHandler(PPChecks);
+		if (Opts.Project)
 		{
-			Visitor.TraverseDecl(Ctx.getTranslationUnitDecl());
+			auto Collector =
+				std::make_unique<CSCFactsCollector>(PP.getSourceManager());
+			Facts = Collector.get();
+			Visitor.set_facts(Facts);
+			PP.addPPCallbacks(std::move(Collector));
 		}
-		else
+		return Callbacks;
+	}
+
+	void HandleTranslationUnit(clang::ASTContext &Ctx)
+	{
+		end_phase(CSCPhase::Parse);
+
+		// The rules and their bookkeeping count as rule allocations. The
+		// output and the clang code they call into don't, see
+		// CSCRuleAllocPause.
 		{
-			// Only visit declarations declared in the input TU
-			auto Decls = Ctx.getTranslationUnitDecl()->decls();
-			for (auto &Decl : Decls)
+			CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+			bool Complete = true;
+
+			if (!Opts.MainTUOnly)
 			{
-				// Ignore declarations out of the main translation unit.
-				//
-				// SourceManager::isInMainFile method takes into account locations
-				// expansion like macro expansion scenario and checks expansion
-				// location instead if spelling location if required.
-				if (!SM.isInMainFile(Decl->getLocation()))
+				Complete = Visitor.TraverseDecl(Ctx.getTranslationUnitDecl());
+			}
+			else
+			{
+				// Only visit declarations declared in the input TU
+				auto Decls = Ctx.getTranslationUnitDecl()->decls();
+				for (auto &Decl : Decls)
 				{
-					continue;
+					// Ignore declarations out of the main translation unit.
+					//
+					// SourceManager::isInMainFile method takes into account
+					// locations expansion like macro expansion scenario and
+					// checks expansion location instead if spelling location
+					// if required.
+					if (!SM.isInMainFile(Decl->getLocation()))
+					{
+						continue;
+					}
+					// Every rule hit -max-per-rule - the rest of the TU can't
+					// produce anything new.
+					if (!Visitor.TraverseDecl(Decl))
+					{
+						Complete = false;
+						break;
+					}
 				}
-				Visitor.TraverseDecl(Decl);
+			}
+
+			if (PPChecks)
+			{
+				PPChecks->check_main_file();
+			}
+
+			// All references are known only now - unless some declarations
+			// were not traversed at all
+			Visitor.report_renames(Complete && !Visitor.skipped_decls());
+
+			if (Facts)
+			{
+				Facts->collect(Ctx, !Opts.MainTUOnly);
+				Opts.Project->add(Facts->take());
+			}
+
+			// Errors can hide violations, such a run is not cached
+			if (CacheTokens && Visitor.stop_recording() &&
+				!Ctx.getDiagnostics().hasErrorOccurred())
+			{
+				CacheEntry.Headers = CSCResultCache::headers(SM);
+				Opts.Cache->insert(CacheKey, std::move(CacheEntry));
 			}
 		}
+
+		end_phase(CSCPhase::Check);
+		report_buffer_rules();
 	}
 
+	// -cache: looks the token fingerprint of the main file up, together
+	// with Config (see CSCResultCache::key). On a hit the cached violations
+	// are reported and the buffer rules are run - the caller must not parse
+	// the TU then. On a miss the parse is recorded. Returns true on a hit.
+	bool replay_cached(llvm::StringRef Config);
+
 private:
+	// Owned by the DiagnosticsEngine
+	CSCDiagnosticConsumer *Compact;
+	// Owned by the Preprocessor (nullptr - not registered)
+	CSCPPCallbacks *PPChecks = nullptr;
+	// Owned by the Preprocessor (nullptr - no -project)
+	CSCFactsCollector *Facts = nullptr;
 	CodeStyleCheckerVisitor Visitor;
+	clang::ASTContext *Context;
 	clang::SourceManager &SM;
-	// Should this plugin be only run on the main translation unit?
-	bool MainTUOnly = true;
+	const CodeStyleCheckerOptions &Opts;
+
+	// -cache: the tokens of the main file (nullptr - cache not used)
+	const CSCTokenStream *CacheTokens = nullptr;
+	uint64_t CacheKey = 0;
+	CSCResultCache::Entry CacheEntry;
+
+	// -progress, -metrics: when the current phase of the TU started. The
+	// consumer is created as the TU starts to be parsed.
+	std::chrono::steady_clock::time_point PhaseStart =
+		std::chrono::steady_clock::now();
+
+	void end_phase(CSCPhase Phase)
+	{
+		if (Opts.Counters)
+		{
+			auto Now = std::chrono::steady_clock::now();
+			Opts.Counters->add_time(Phase, Now - PhaseStart);
+			PhaseStart = Now;
+		}
+	}
+
+	// The rules that read the buffer itself, the index and the output - the
+	// part of the TU that runs both after a parse and after a cache hit
+	void report_buffer_rules()
+	{
+		{
+			CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+			Visitor.check_control_chars(SM.getMainFileID());
+			Visitor.check_layout(SM.getMainFileID());
+
+			// The formatter only ever looks at the main file: headers are
+			// checked when they are compiled (or formatted) on their own.
+			if (Opts.Style && !Opts.Style->DisableFormat)
+			{
+				Visitor.check_formatting(SM.getMainFileID(), *Opts.Style);
+			}
+		}
+
+		if (Opts.Index)
+		{
+			if (clang::OptionalFileEntryRef MainFile =
+				SM.getFileEntryRefForID(SM.getMainFileID()))
+			{
+				Opts.Index->update(
+					SM.getFileManager().getCanonicalName(*MainFile),
+					Visitor.collect_symbols());
+			}
+		}
+
+		if (Opts.MemReport)
+		{
+			report_memory();
+		}
+
+		if (Opts.Summary)
+		{
+			Visitor.print_summary(Opts.report_stream());
+		}
+
+		if (Compact)
+		{
+			Compact->flush();
+		}
+
+		if (Opts.Counters)
+		{
+			count_tu();
+		}
+	}
+
+	void count_tu()
+	{
+		end_phase(CSCPhase::Report);
+
+		CSCWorkerCounters &C = *Opts.Counters;
+		for (unsigned I = 0; I < NumCSCRules; ++I)
+		{
+			if (unsigned N = Visitor.violations(static_cast<CSCRule>(I)))
+			{
+				C.add(C.Violations[I], N);
+			}
+		}
+		C.add(C.Bytes, SM.getBufferData(SM.getMainFileID()).size());
+		C.add(C.TUs, 1);
+	}
+
+	void report_memory()
+	{
+		CSCMemoryReport::TU Record;
+		Record.File =
+			SM.getFilename(SM.getLocForStartOfFile(SM.getMainFileID())).str();
+		Record.ASTBytes = Context->getASTAllocatedMemory() +
+			Context->getSideTableAllocatedMemory();
+
+		clang::SourceManager::MemoryBufferSizes Buffers =
+			SM.getMemoryBufferSizes();
+		Record.SourceBytes = Buffers.malloc_bytes + Buffers.mmap_bytes;
+
+		Record.RuleAllocs = Visitor.rule_allocs();
+		Record.PeakRSS = getPeakRSS();
+
+		Opts.MemReport->add(std::move(Record), Opts.report_stream());
+	}
 };
 
 #endif
\ No newline at end of file
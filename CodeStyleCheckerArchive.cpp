@@ -0,0 +1,401 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerArchive.cpp
+//
+// DESCRIPTION:
+//    Implements CSCArchive
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerArchive.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <optional>
+
+#if LLVM_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace llvm;
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+static Error malformed(StringRef Name, const char *What)
+{
+	return createStringError(inconvertibleErrorCode(),
+		"malformed archive '%s': %s", Name.str().c_str(), What);
+}
+
+#if LLVM_ENABLE_ZLIB
+// WindowBits selects the framing: -MAX_WBITS for the raw deflate streams of
+// zip, 16 + MAX_WBITS for gzip
+static Expected<std::string> decompress(StringRef Name, StringRef Data,
+	int WindowBits, size_t SizeHint)
+{
+	z_stream Stream = {};
+	if (inflateInit2(&Stream, WindowBits) != Z_OK)
+	{
+		return malformed(Name, "cannot initialize zlib");
+	}
+
+	Stream.next_in =
+		reinterpret_cast<Bytef *>(const_cast<char *>(Data.data()));
+	Stream.avail_in = Data.size();
+
+	std::string Out(std::max<size_t>(SizeHint, 4096), '\0');
+	size_t Written = 0;
+	int Ret = Z_OK;
+	while (Ret == Z_OK)
+	{
+		if (Written == Out.size())
+		{
+			Out.resize(Out.size() * 2);
+		}
+		Stream.next_out = reinterpret_cast<Bytef *>(&Out[Written]);
+		Stream.avail_out = Out.size() - Written;
+
+		Ret = inflate(&Stream, Z_NO_FLUSH);
+		Written = Out.size() - Stream.avail_out;
+	}
+	inflateEnd(&Stream);
+
+	if (Ret != Z_STREAM_END)
+	{
+		return malformed(Name, "corrupt compressed data");
+	}
+
+	Out.resize(Written);
+	return Out;
+}
+#endif
+
+// A NUL-terminated tar header field
+static StringRef tarField(StringRef Header, size_t Offset, size_t Length)
+{
+	return Header.substr(Offset, Length).take_until(
+		[](char C) { return C == '\0'; });
+}
+
+// The `path` of a pax extended header, whose records are
+// "<length> <key>=<value>\n"
+static std::optional<StringRef> paxPath(StringRef Records)
+{
+	while (!Records.empty())
+	{
+		StringRef LengthField =
+			Records.take_until([](char C) { return C == ' '; });
+		size_t Length = 0;
+		if (LengthField.getAsInteger(10, Length) ||
+			Length <= LengthField.size() + 1 || Length > Records.size())
+		{
+			break;
+		}
+
+		StringRef Record = Records.take_front(Length)
+			.drop_front(LengthField.size() + 1)
+			.drop_back();
+		Records = Records.drop_front(Length);
+
+		auto [Key, Value] = Record.split('=');
+		if (Key == "path")
+		{
+			return Value;
+		}
+	}
+
+	return std::nullopt;
+}
+
+static uint16_t read16(StringRef Data, size_t Offset)
+{
+	return support::endian::read16le(Data.data() + Offset);
+}
+
+static uint32_t read32(StringRef Data, size_t Offset)
+{
+	return support::endian::read32le(Data.data() + Offset);
+}
+
+//-----------------------------------------------------------------------------
+// CSCArchive implementation
+//-----------------------------------------------------------------------------
+bool CSCArchive::isArchive(StringRef Path)
+{
+	return Path.ends_with_insensitive(".tar") ||
+		Path.ends_with_insensitive(".tar.gz") ||
+		Path.ends_with_insensitive(".tgz") ||
+		Path.ends_with_insensitive(".zip");
+}
+
+Error CSCArchive::load(StringRef Path)
+{
+	ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr = MemoryBuffer::getFile(
+		Path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+
+	if (std::error_code EC = BufOrErr.getError())
+	{
+		return createStringError(EC, "cannot read archive '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	Members.clear();
+
+	StringRef Data = (*BufOrErr)->getBuffer();
+	if (Path.ends_with_insensitive(".zip"))
+	{
+		return load_zip(Path, Data);
+	}
+
+	if (Path.ends_with_insensitive(".gz") || Path.ends_with_insensitive(".tgz"))
+	{
+#if LLVM_ENABLE_ZLIB
+		Expected<std::string> Tar =
+			decompress(Path, Data, 16 + MAX_WBITS, Data.size() * 4);
+		if (!Tar)
+		{
+			return Tar.takeError();
+		}
+		return load_tar(Path, *Tar);
+#else
+		return createStringError(inconvertibleErrorCode(),
+			"cannot read archive '%s': LLVM was built without zlib",
+			Path.str().c_str());
+#endif
+	}
+
+	return load_tar(Path, Data);
+}
+
+Error CSCArchive::load_tar(StringRef Name, StringRef Data)
+{
+	constexpr size_t BlockSize = 512;
+
+	// Set by a GNU long name or a pax header, for the member that follows
+	std::string NextPath;
+
+	while (Data.size() >= BlockSize)
+	{
+		StringRef Header = Data.take_front(BlockSize);
+
+		// The archive ends with zero blocks
+		if (Header.find_first_not_of('\0') == StringRef::npos)
+		{
+			break;
+		}
+
+		uint64_t Size = 0;
+		if (tarField(Header, 124, 12).trim(' ').getAsInteger(8, Size))
+		{
+			return malformed(Name, "bad member size");
+		}
+
+		Data = Data.drop_front(BlockSize);
+		if (Size > Data.size())
+		{
+			return malformed(Name, "truncated member");
+		}
+
+		StringRef Contents = Data.take_front(Size);
+		Data = Data.drop_front(std::min<uint64_t>(alignTo(Size, BlockSize),
+			Data.size()));
+
+		switch (Header[156])
+		{
+		case 'L':
+			NextPath =
+				Contents.take_until([](char C) { return C == '\0'; }).str();
+			break;
+		case 'x':
+			if (std::optional<StringRef> Path = paxPath(Contents))
+			{
+				NextPath = Path->str();
+			}
+			break;
+		case '0':
+		case '7':
+		case '\0':
+		{
+			std::string Path = std::move(NextPath);
+			NextPath.clear();
+			if (Path.empty())
+			{
+				Path = tarField(Header, 0, 100).str();
+
+				// Only POSIX ustar has the prefix field, GNU tar stores
+				// other data there
+				StringRef Prefix = tarField(Header, 345, 155);
+				if (Header.substr(257, 6) == StringRef("ustar\0", 6) &&
+					!Prefix.empty())
+				{
+					Path = (Prefix + "/" + Path).str();
+				}
+			}
+			add(Path, Contents);
+			break;
+		}
+		default:
+			// Directories, links, devices
+			NextPath.clear();
+			break;
+		}
+	}
+
+	return Error::success();
+}
+
+Error CSCArchive::load_zip(StringRef Name, StringRef Data)
+{
+	// The end of central directory record, followed by an archive comment
+	size_t End = Data.rfind(StringRef("PK\x05\x06", 4));
+	if (End == StringRef::npos || End + 22 > Data.size())
+	{
+		return malformed(Name, "no zip central directory");
+	}
+
+	uint16_t Count = read16(Data, End + 10);
+	size_t Pos = read32(Data, End + 16);
+
+	for (uint16_t I = 0; I < Count; ++I)
+	{
+		if (Pos + 46 > Data.size() ||
+			Data.substr(Pos, 4) != StringRef("PK\x01\x02", 4))
+		{
+			return malformed(Name, "bad zip central directory entry");
+		}
+
+		uint16_t Method = read16(Data, Pos + 10);
+		uint32_t CompressedSize = read32(Data, Pos + 20);
+		uint32_t Size = read32(Data, Pos + 24);
+		uint16_t NameLength = read16(Data, Pos + 28);
+		size_t LocalHeader = read32(Data, Pos + 42);
+		StringRef Path = Data.substr(Pos + 46, NameLength);
+
+		Pos += 46 + NameLength + read16(Data, Pos + 30) + read16(Data, Pos + 32);
+
+		if (Path.ends_with("/"))
+		{
+			continue;
+		}
+
+		if (LocalHeader + 30 > Data.size() ||
+			Data.substr(LocalHeader, 4) != StringRef("PK\x03\x04", 4))
+		{
+			return malformed(Name, "bad zip local header");
+		}
+
+		// The local extra field may differ from the central one
+		size_t Start = LocalHeader + 30 + read16(Data, LocalHeader + 26) +
+			read16(Data, LocalHeader + 28);
+		if (Start + CompressedSize > Data.size())
+		{
+			return malformed(Name, "truncated member");
+		}
+		StringRef Compressed = Data.substr(Start, CompressedSize);
+
+		switch (Method)
+		{
+		case 0:
+			add(Path, Compressed);
+			break;
+		case 8:
+		{
+#if LLVM_ENABLE_ZLIB
+			Expected<std::string> Contents =
+				decompress(Name, Compressed, -MAX_WBITS, Size);
+			if (!Contents)
+			{
+				return Contents.takeError();
+			}
+			add(Path, *Contents);
+			break;
+#else
+			(void)Size;
+			return createStringError(inconvertibleErrorCode(),
+				"cannot read archive '%s': LLVM was built without zlib",
+				Name.str().c_str());
+#endif
+		}
+		default:
+			return createStringError(inconvertibleErrorCode(),
+				"cannot read archive '%s': '%s' uses compression method %u",
+				Name.str().c_str(), Path.str().c_str(), Method);
+		}
+	}
+
+	return Error::success();
+}
+
+void CSCArchive::add(StringRef Path, StringRef Contents)
+{
+	// Zip tools on Windows write backslashes
+	std::string Normalized = Path.str();
+	std::replace(Normalized.begin(), Normalized.end(), '\\', '/');
+
+	if (StringRef(Normalized).starts_with("/"))
+	{
+		return;
+	}
+
+	SmallVector<StringRef, 8> Components;
+	StringRef(Normalized).split(Components, '/', -1, /*KeepEmpty=*/false);
+
+	std::string Clean;
+	for (StringRef Component : Components)
+	{
+		if (Component == ".")
+		{
+			continue;
+		}
+		if (Component == ".." || Component.contains(':'))
+		{
+			return;
+		}
+		if (!Clean.empty())
+		{
+			Clean += '/';
+		}
+		Clean += Component;
+	}
+
+	if (Clean.empty())
+	{
+		return;
+	}
+
+	Members.push_back({Clean, MemoryBuffer::getMemBufferCopy(Contents, Clean)});
+}
+
+std::vector<std::string> CSCArchive::mount(vfs::InMemoryFileSystem &FS,
+	StringRef Root)
+{
+	std::vector<std::string> Paths;
+	StringSet<> Mounted;
+
+	// A later member replaces an earlier one with the same path, as when
+	// the archive is extracted
+	for (Member &M : llvm::reverse(Members))
+	{
+		SmallString<256> Path(Root);
+		sys::path::append(Path, M.Path);
+
+		if (!Mounted.insert(Path).second ||
+			!FS.addFile(Path, /*ModificationTime=*/0, std::move(M.Contents)))
+		{
+			continue;
+		}
+		Paths.push_back(Path.str().str());
+	}
+
+	Members.clear();
+	std::reverse(Paths.begin(), Paths.end());
+	return Paths;
+}
@@ -0,0 +1,63 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerArchive.h
+//
+// DESCRIPTION:
+//    Declares CSCArchive - the files of a tar or zip archive, read into
+//    memory without extracting anything to disk
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_ARCHIVE_H
+#define CLANG_TUTOR_CSC_ARCHIVE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Archive
+//-----------------------------------------------------------------------------
+// Supported formats:
+//    * .tar (ustar, GNU long names, pax path records)
+//    * .tar.gz, .tgz and deflated .zip members - only if LLVM was built with
+//      zlib (LLVM_ENABLE_ZLIB)
+//    * stored .zip members
+// Only regular files are kept. Members with absolute paths or `..` are
+// skipped, so that nothing can be mounted outside the archive root.
+class CSCArchive
+{
+public:
+	struct Member
+	{
+		std::string Path;	// relative to the archive root, '/'-separated
+		std::unique_ptr<llvm::MemoryBuffer> Contents;
+	};
+
+	// Whether Path names an archive of a supported format (by extension)
+	static bool isArchive(llvm::StringRef Path);
+
+	llvm::Error load(llvm::StringRef Path);
+
+	const std::vector<Member> &members() const { return Members; }
+
+	// Moves every member into FS as Root/<member path>. Returns the paths of
+	// the added files, in archive order.
+	std::vector<std::string> mount(llvm::vfs::InMemoryFileSystem &FS,
+		llvm::StringRef Root);
+
+private:
+	std::vector<Member> Members;
+
+	llvm::Error load_tar(llvm::StringRef Name, llvm::StringRef Data);
+	llvm::Error load_zip(llvm::StringRef Name, llvm::StringRef Data);
+	// Keeps the member if its path is safe to mount
+	void add(llvm::StringRef Path, llvm::StringRef Contents);
+};
+
+#endif
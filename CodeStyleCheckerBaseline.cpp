@@ -0,0 +1,146 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerBaseline.cpp
+//
+// DESCRIPTION:
+//    Implements CSCBaseline
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerBaseline.h"
+
+#include "CodeStyleCheckerLock.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <tuple>
+
+//-----------------------------------------------------------------------------
+// CSCBaseline implementation
+//-----------------------------------------------------------------------------
+uint64_t CSCBaseline::fingerprint(
+	CSCRule Rule,
+	llvm::StringRef File,
+	llvm::StringRef EnclosingDecl,
+	llvm::StringRef Token)
+{
+	// xxh3 is stable across runs and platforms, unlike llvm::hash_value
+	llvm::SmallString<256> Key;
+	Key += getRuleName(Rule);
+	Key.push_back('\0');
+	Key += File;
+	Key.push_back('\0');
+	Key += EnclosingDecl;
+	Key.push_back('\0');
+	Key += Token;
+
+	return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Key.str()));
+}
+
+llvm::Error CSCBaseline::load(llvm::StringRef Path)
+{
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufOrErr =
+		llvm::MemoryBuffer::getFile(Path, /*IsText=*/true);
+
+	if (std::error_code EC = BufOrErr.getError())
+	{
+		return llvm::createStringError(EC, "cannot read baseline '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	Fingerprints.clear();
+
+	llvm::StringRef Contents = (*BufOrErr)->getBuffer();
+	while (!Contents.empty())
+	{
+		llvm::StringRef Line;
+		std::tie(Line, Contents) = Contents.split('\n');
+		Line = Line.trim();
+
+		if (Line.empty() || Line.starts_with("#"))
+		{
+			continue;
+		}
+
+		uint64_t Fingerprint = 0;
+		if (Line.getAsInteger(16, Fingerprint))
+		{
+			return llvm::createStringError(llvm::inconvertibleErrorCode(),
+				"malformed line in baseline '%s': %s", Path.str().c_str(),
+				Line.str().c_str());
+		}
+		Fingerprints.push_back(Fingerprint);
+	}
+
+	// Hand-edited files may be out of order
+	sort_unique();
+
+	return llvm::Error::success();
+}
+
+llvm::Error CSCBaseline::write(llvm::StringRef Path)
+{
+	sort_unique();
+
+	// writeToOutput() writes a temporary file next to Path and renames it
+	llvm::Error E = llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+	{
+		OS << "# CMC-OS code style baseline: fingerprints of known "
+			"violations\n";
+		for (uint64_t Fingerprint : Fingerprints)
+		{
+			OS << llvm::format_hex_no_prefix(Fingerprint, 16) << '\n';
+		}
+		return llvm::Error::success();
+	});
+
+	if (E)
+	{
+		return llvm::createStringError(llvm::inconvertibleErrorCode(),
+			"cannot write baseline '%s': %s", Path.str().c_str(),
+			llvm::toString(std::move(E)).c_str());
+	}
+
+	return llvm::Error::success();
+}
+
+llvm::Error CSCBaseline::merge_into(llvm::StringRef Path)
+{
+	return lockedUpdate(Path, [&]() -> llvm::Error
+	{
+		// What the TUs checked since this process started have added
+		if (llvm::sys::fs::exists(Path))
+		{
+			CSCBaseline OnDisk;
+			if (llvm::Error E = OnDisk.load(Path))
+			{
+				return E;
+			}
+			Fingerprints.insert(Fingerprints.end(),
+				OnDisk.Fingerprints.begin(), OnDisk.Fingerprints.end());
+		}
+
+		return write(Path);
+	});
+}
+
+bool CSCBaseline::contains(uint64_t Fingerprint) const
+{
+	return std::binary_search(Fingerprints.begin(), Fingerprints.end(),
+		Fingerprint);
+}
+
+void CSCBaseline::sort_unique()
+{
+	llvm::sort(Fingerprints);
+	Fingerprints.erase(std::unique(Fingerprints.begin(), Fingerprints.end()),
+		Fingerprints.end());
+}
@@ -0,0 +1,69 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerBaseline.h
+//
+// DESCRIPTION:
+//    Declares CSCBaseline - the set of known violations that are not
+//    reported again
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_BASELINE_H
+#define CLANG_TUTOR_CSC_BASELINE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include "CodeStyleCheckerRules.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Baseline
+//-----------------------------------------------------------------------------
+// A violation is identified by a 64-bit fingerprint of
+//   (rule, file, enclosing declaration, token text)
+// No line or column takes part in it, so the baseline survives code being
+// moved around. The file is a sorted list of fingerprints, one hex number per
+// line; lines starting with '#' are comments.
+class CSCBaseline
+{
+public:
+	static uint64_t fingerprint(
+		CSCRule Rule,
+		llvm::StringRef File,
+		llvm::StringRef EnclosingDecl,
+		llvm::StringRef Token);
+
+	// Replaces the contents with the fingerprints from Path
+	llvm::Error load(llvm::StringRef Path);
+	// Replaces Path with the fingerprints (sorted, without duplicates). The
+	// file is replaced atomically: a reader sees the old or the new one.
+	llvm::Error write(llvm::StringRef Path);
+	// Adds the fingerprints to those already in Path, if any. Every compiler
+	// process of a parallel build does this for its own TU, so the
+	// read-merge-write is serialized by a lock on Path.lock.
+	llvm::Error merge_into(llvm::StringRef Path);
+
+	// O(log n) lookup. Only valid while nothing is being added.
+	bool contains(uint64_t Fingerprint) const;
+	// Records a fingerprint for write(). Safe to call from several threads.
+	void add(uint64_t Fingerprint)
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+		Fingerprints.push_back(Fingerprint);
+	}
+
+	bool empty() const { return Fingerprints.empty(); }
+
+private:
+	// Sorted and unique, except between add() and write() or merge_into()
+	std::vector<uint64_t> Fingerprints;
+	std::mutex Lock;
+
+	void sort_unique();
+};
+
+#endif
@@ -0,0 +1,398 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerCache.cpp
+//
+// DESCRIPTION:
+//    Implements CSCResultCache
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerCache.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <optional>
+#include <tuple>
+
+static const char CacheHeader[] = "csc-cache 4";
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+static llvm::Error malformed(llvm::StringRef Path, llvm::StringRef Line)
+{
+	return llvm::createStringError(llvm::inconvertibleErrorCode(),
+		"malformed line in cache '%s': %s", Path.str().c_str(),
+		Line.str().c_str());
+}
+
+// FixIts are stored one per line
+static std::string escape(llvm::StringRef Code)
+{
+	std::string Result;
+	for (char C : Code)
+	{
+		switch (C)
+		{
+		case '\\': Result += "\\\\"; break;
+		case '\n': Result += "\\n"; break;
+		case '\r': Result += "\\r"; break;
+		default: Result += C; break;
+		}
+	}
+	return Result;
+}
+
+static std::string unescape(llvm::StringRef Code)
+{
+	std::string Result;
+	for (size_t I = 0; I < Code.size(); ++I)
+	{
+		if (Code[I] != '\\' || I + 1 == Code.size())
+		{
+			Result += Code[I];
+			continue;
+		}
+		switch (Code[++I])
+		{
+		case 'n': Result += '\n'; break;
+		case 'r': Result += '\r'; break;
+		default: Result += Code[I]; break;
+		}
+	}
+	return Result;
+}
+
+static bool parsePosition(llvm::StringRef Text, CSCResultCache::Position &Pos)
+{
+	llvm::StringRef Token, Delta;
+	std::tie(Token, Delta) = Text.split(':');
+	return !Token.getAsInteger(10, Pos.Token) &&
+		!Delta.getAsInteger(10, Pos.Delta);
+}
+
+static llvm::raw_ostream &operator<<(llvm::raw_ostream &OS,
+	const CSCResultCache::Position &Pos)
+{
+	return OS << Pos.Token << ':' << Pos.Delta;
+}
+
+//-----------------------------------------------------------------------------
+// CSCResultCache implementation
+//-----------------------------------------------------------------------------
+uint64_t CSCResultCache::key(const CSCTokenStream &Toks,
+	llvm::StringRef Config)
+{
+	llvm::SmallString<256> Key(Config);
+	Key.push_back('\0');
+	Key += llvm::utohexstr(Toks.fingerprint());
+
+	return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Key.str()));
+}
+
+std::vector<CSCResultCache::Header> CSCResultCache::headers(
+	const clang::SourceManager &SM)
+{
+	std::vector<Header> Result;
+	llvm::StringSet<> Seen;
+
+	for (unsigned I = 0, E = SM.local_sloc_entry_size(); I < E; ++I)
+	{
+		const clang::SrcMgr::SLocEntry &SLoc = SM.getLocalSLocEntry(I);
+		if (!SLoc.isFile() ||
+			clang::SrcMgr::isSystem(SLoc.getFile().getFileCharacteristic()))
+		{
+			continue;
+		}
+
+		const clang::SrcMgr::ContentCache &Content =
+			SLoc.getFile().getContentCache();
+		clang::OptionalFileEntryRef FE = Content.OrigEntry;
+		std::optional<llvm::MemoryBufferRef> Buffer =
+			Content.getBufferIfLoaded();
+		if (!FE || !Buffer ||
+			&FE->getFileEntry() == SM.getFileEntryForID(SM.getMainFileID()))
+		{
+			continue;
+		}
+
+		llvm::SmallString<256> Path(FE->getName());
+		SM.getFileManager().makeAbsolutePath(Path);
+		if (!Seen.insert(Path).second)
+		{
+			continue;
+		}
+
+		Result.push_back({Path.str().str(),
+			llvm::xxh3_64bits(llvm::arrayRefFromStringRef(
+				Buffer->getBuffer()))});
+	}
+
+	llvm::sort(Result, [](const Header &L, const Header &R) {
+		return L.Path < R.Path;
+	});
+
+	return Result;
+}
+
+std::shared_ptr<const CSCResultCache::Entry> CSCResultCache::lookup(
+	uint64_t Key, llvm::vfs::FileSystem &FS) const
+{
+	std::shared_ptr<const Entry> Result;
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+
+		auto It = Entries.find(Key);
+		if (It == Entries.end())
+		{
+			return nullptr;
+		}
+		Result = It->second;
+	}
+
+	// The headers are read outside of the lock
+	for (const Header &H : Result->Headers)
+	{
+		llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+			FS.getBufferForFile(H.Path);
+		if (!Buffer || llvm::xxh3_64bits(llvm::arrayRefFromStringRef(
+			(*Buffer)->getBuffer())) != H.Hash)
+		{
+			return nullptr;
+		}
+	}
+
+	return Result;
+}
+
+void CSCResultCache::insert(uint64_t Key, Entry E)
+{
+	std::lock_guard<std::mutex> Guard(Lock);
+
+	// Two workers may have parsed files with the same tokens and headers -
+	// keep the first. An entry whose headers changed is replaced.
+	std::shared_ptr<const Entry> &Slot = Entries[Key];
+	if (!Slot || Slot->Headers != E.Headers)
+	{
+		Slot = std::make_shared<const Entry>(std::move(E));
+	}
+}
+
+llvm::Error CSCResultCache::load(llvm::StringRef Path)
+{
+	Entries.clear();
+
+	if (!llvm::sys::fs::exists(Path))
+	{
+		return llvm::Error::success();
+	}
+
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufOrErr =
+		llvm::MemoryBuffer::getFile(Path, /*IsText=*/true);
+	if (std::error_code EC = BufOrErr.getError())
+	{
+		return llvm::createStringError(EC, "cannot read cache '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	llvm::StringRef Contents = (*BufOrErr)->getBuffer();
+	llvm::StringRef Line;
+
+	std::tie(Line, Contents) = Contents.split('\n');
+	if (Line.rtrim() != CacheHeader)
+	{
+		// Written by another version - start over
+		return llvm::Error::success();
+	}
+
+	std::shared_ptr<Entry> E;
+
+	while (!Contents.empty())
+	{
+		std::tie(Line, Contents) = Contents.split('\n');
+		Line = Line.rtrim("\r");
+
+		if (Line.empty())
+		{
+			continue;
+		}
+		if (Line.size() < 2 || Line[1] != ' ')
+		{
+			return malformed(Path, Line);
+		}
+
+		llvm::SmallVector<llvm::StringRef, 4> Fields;
+		Line.drop_front(2).split(Fields, ' ', /*MaxSplit=*/3);
+
+		switch (Line[0])
+		{
+		case 'E':
+		{
+			uint64_t Key = 0;
+			if (Fields.size() != 1 || Fields[0].getAsInteger(16, Key))
+			{
+				return malformed(Path, Line);
+			}
+			E = std::make_shared<Entry>();
+			Entries[Key] = E;
+			break;
+		}
+
+		case 'I':
+		{
+			// The path may contain spaces - it takes the rest of the line
+			Header H;
+			llvm::StringRef Hash, HeaderPath;
+			std::tie(Hash, HeaderPath) = Line.drop_front(2).split(' ');
+			if (!E || HeaderPath.empty() || Hash.getAsInteger(16, H.Hash))
+			{
+				return malformed(Path, Line);
+			}
+			H.Path = HeaderPath.str();
+			E->Headers.push_back(std::move(H));
+			break;
+		}
+
+		case 'L':
+		{
+			std::pair<Position, Position> Literal;
+			if (!E || Fields.size() != 2 ||
+				!parsePosition(Fields[0], Literal.first) ||
+				!parsePosition(Fields[1], Literal.second))
+			{
+				return malformed(Path, Line);
+			}
+			E->Literals.push_back(Literal);
+			break;
+		}
+
+		case 'K':
+		{
+			std::pair<Position, Position> Range;
+			if (!E || Fields.size() != 2 ||
+				!parsePosition(Fields[0], Range.first) ||
+				!parsePosition(Fields[1], Range.second))
+			{
+				return malformed(Path, Line);
+			}
+			E->Skipped.push_back(Range);
+			break;
+		}
+
+		case 'V':
+		{
+			unsigned Rule = 0;
+			Violation V;
+			if (!E || Fields.size() != 2 || Fields[0].getAsInteger(10, Rule) ||
+				Rule >= NumCSCRules || !parsePosition(Fields[1], V.Pos))
+			{
+				return malformed(Path, Line);
+			}
+			V.Rule = static_cast<CSCRule>(Rule);
+			E->Violations.push_back(std::move(V));
+			break;
+		}
+
+		case 'H':
+		{
+			Hint H;
+			if (!E || E->Violations.empty() || Fields.size() < 3 ||
+				!parsePosition(Fields[0], H.Begin) ||
+				!parsePosition(Fields[1], H.End) ||
+				(Fields[2] != "c" && Fields[2] != "t"))
+			{
+				return malformed(Path, Line);
+			}
+			H.TokenRange = Fields[2] == "t";
+			if (Fields.size() == 4)
+			{
+				H.Code = unescape(Fields[3]);
+			}
+			E->Violations.back().Hints.push_back(std::move(H));
+			break;
+		}
+
+		case 'G':
+		{
+			unsigned Rule = 0;
+			unsigned Check = 0;
+			GapExpectation G;
+			if (!E || Fields.size() != 3 || Fields[0].getAsInteger(10, Rule) ||
+				Rule >= NumCSCRules || Fields[1].getAsInteger(10, G.Token) ||
+				Fields[2].getAsInteger(10, Check) ||
+				Check > static_cast<unsigned>(CSCGapCheck::LineStart))
+			{
+				return malformed(Path, Line);
+			}
+			G.Rule = static_cast<CSCRule>(Rule);
+			G.Check = static_cast<CSCGapCheck>(Check);
+			E->Gaps.push_back(G);
+			break;
+		}
+
+		default:
+			return malformed(Path, Line);
+		}
+	}
+
+	return llvm::Error::success();
+}
+
+llvm::Error CSCResultCache::write(llvm::StringRef Path) const
+{
+	std::error_code EC;
+	llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::OF_Text);
+
+	if (EC)
+	{
+		return llvm::createStringError(EC, "cannot write cache '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	OS << CacheHeader << '\n';
+	for (const auto &Cached : Entries)
+	{
+		const Entry &E = *Cached.second;
+
+		OS << "E " << llvm::format_hex_no_prefix(Cached.first, 16) << '\n';
+		for (const Header &H : E.Headers)
+		{
+			OS << "I " << llvm::format_hex_no_prefix(H.Hash, 16) << ' '
+				<< H.Path << '\n';
+		}
+		for (const auto &Literal : E.Literals)
+		{
+			OS << "L " << Literal.first << ' ' << Literal.second << '\n';
+		}
+		for (const auto &Range : E.Skipped)
+		{
+			OS << "K " << Range.first << ' ' << Range.second << '\n';
+		}
+		for (const Violation &V : E.Violations)
+		{
+			OS << "V " << static_cast<unsigned>(V.Rule) << ' ' << V.Pos << '\n';
+			for (const Hint &H : V.Hints)
+			{
+				OS << "H " << H.Begin << ' ' << H.End << ' '
+					<< (H.TokenRange ? 't' : 'c') << ' ' << escape(H.Code)
+					<< '\n';
+			}
+		}
+		for (const GapExpectation &G : E.Gaps)
+		{
+			OS << "G " << static_cast<unsigned>(G.Rule) << ' ' << G.Token << ' '
+				<< static_cast<unsigned>(G.Check) << '\n';
+		}
+	}
+
+	return llvm::Error::success();
+}
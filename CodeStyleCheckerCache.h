@@ -0,0 +1,152 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerCache.h
+//
+// DESCRIPTION:
+//    Declares CSCResultCache - the results of the AST and preprocessor rules,
+//    keyed by a whitespace- and comment-insensitive fingerprint of the tokens
+//    of the main file
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_CACHE_H
+#define CLANG_TUTOR_CSC_CACHE_H
+
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include "CodeStyleCheckerLayout.h"
+#include "CodeStyleCheckerRules.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Result cache
+//-----------------------------------------------------------------------------
+// A resubmission often differs from the previous attempt only in indentation,
+// line breaks or comments. The rules that look at the AST or at the
+// preprocessor can't tell these apart, so their violations are cached by the
+// raw token stream of the main file: on a hit the TU is not parsed, the
+// cached violations are reported at the corresponding tokens of the new file
+// and only the rules that read the buffer itself (R1.1, Format) are re-run.
+//
+// What the cached rules find also depends on the user headers the TU
+// includes (R5.8 through a macro, R4.6.8 through a noreturn declaration,
+// ...). An entry keeps the content hash of each of them, and a header that
+// changed (or went missing) makes the lookup a miss.
+//
+// The section 4 layout rules do depend on the whitespace, so it is their
+// expectations that are cached (see CSCLayout), not their violations. They
+// are checked again against the new file.
+//
+// Locations are stored as (token, delta) pairs - an offset into the N-th
+// token - so that they survive any change of the whitespace between tokens.
+//
+// On disk it is a line-based file:
+//
+//    csc-cache 4
+//    E <key>
+//    I <content hash> <path>                    (a user header of the TU)
+//    L <token>:<delta> <token>:<delta>           (R1 literal, [begin, end))
+//    K <token>:<delta> <token>:<delta>           (skipped block, [begin, end))
+//    V <rule #> <token>:<delta>
+//    H <token>:<delta> <token>:<delta> <c|t> <replacement, escaped>
+//    G <rule #> <token> <CSCGapCheck #>
+//
+// H lines are the FixIts of the preceding V, c/t - a char or a token range.
+class CSCResultCache
+{
+public:
+	// The rules whose violations are cached. The others are re-run.
+	static constexpr CSCRuleMask CachedRules =
+		ruleBit(CSCRule::R1) | ruleBit(CSCRule::R3_2) |
+		ruleBit(CSCRule::R3_3) | ruleBit(CSCRule::R3_4) |
+		ruleBit(CSCRule::R3_6) | ruleBit(CSCRule::R4_5_2) |
+		ruleBit(CSCRule::R4_6_8) | ruleBit(CSCRule::R5_2) |
+		ruleBit(CSCRule::R5_3) | ruleBit(CSCRule::R5_4) |
+		ruleBit(CSCRule::R5_5) | ruleBit(CSCRule::R5_6) |
+		ruleBit(CSCRule::R5_7) | ruleBit(CSCRule::R5_8) |
+		ruleBit(CSCRule::R5_17) | ruleBit(CSCRule::R6_2);
+
+	using Position = CSCTokenStream::Position;
+
+	struct Hint
+	{
+		Position Begin;
+		Position End;
+		bool TokenRange = false;
+		std::string Code;
+	};
+
+	struct Violation
+	{
+		CSCRule Rule;
+		Position Pos;
+		std::vector<Hint> Hints;
+	};
+
+	// A CSCLayout expectation about the gap before token Token
+	struct GapExpectation
+	{
+		CSCRule Rule;
+		unsigned Token;
+		CSCGapCheck Check;
+	};
+
+	// A non-system header the TU included
+	struct Header
+	{
+		std::string Path;	// absolute
+		uint64_t Hash;		// of the contents
+
+		bool operator==(const Header &Other) const
+		{
+			return Path == Other.Path && Hash == Other.Hash;
+		}
+	};
+
+	struct Entry
+	{
+		std::vector<Header> Headers;
+		std::vector<std::pair<Position, Position>> Literals;
+		// The conditional blocks the preprocessor skipped, in file order
+		std::vector<std::pair<Position, Position>> Skipped;
+		std::vector<Violation> Violations;
+		std::vector<GapExpectation> Gaps;
+	};
+
+	// Key of an entry: the token fingerprint plus Config - everything else
+	// that can change what the cached rules find (flags, options)
+	static uint64_t key(const CSCTokenStream &Toks, llvm::StringRef Config);
+
+	// A missing file is an empty cache
+	llvm::Error load(llvm::StringRef Path);
+	llvm::Error write(llvm::StringRef Path) const;
+
+	// The non-system headers entered while SM parsed its TU, sorted
+	static std::vector<Header> headers(const clang::SourceManager &SM);
+
+	// Both are safe to call from several threads. lookup() returns nullptr
+	// if one of the headers of the entry has changed in FS. An entry is
+	// never changed once inserted; insert() replaces the entry of Key only
+	// if its headers differ, and the replayed one stays alive until the TU
+	// drops it.
+	std::shared_ptr<const Entry> lookup(uint64_t Key,
+		llvm::vfs::FileSystem &FS) const;
+	void insert(uint64_t Key, Entry E);
+
+private:
+	// Ordered, so that the file on disk does not depend on the TU order
+	std::map<uint64_t, std::shared_ptr<const Entry>> Entries;
+	mutable std::mutex Lock;
+};
+
+#endif
@@ -0,0 +1,308 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerChangedLines.cpp
+//
+// DESCRIPTION:
+//    Implements CSCChangedLines. Only the hunk headers of the diff are looked
+//    at:
+//
+//      +++ b/path/to/file.c
+//      @@ -12,3 +12,4 @@
+//
+//    (the path is C-quoted if it has unusual characters)
+//    where "+12,4" means that 4 lines starting with line 12 are new or
+//    modified. A hunk that only removes lines ("+12,0") marks line 12, the
+//    line the removed ones were glued to.
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerChangedLines.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+
+#include <algorithm>
+#include <optional>
+#include <tuple>
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+// Runs git with Args and returns what it printed on stdout
+static llvm::Expected<std::string> runGit(llvm::ArrayRef<llvm::StringRef> Args)
+{
+	llvm::ErrorOr<std::string> Git = llvm::sys::findProgramByName("git");
+	if (!Git)
+	{
+		return llvm::createStringError(Git.getError(), "git not found in PATH");
+	}
+
+	llvm::SmallString<128> OutPath;
+	if (std::error_code EC =
+		llvm::sys::fs::createTemporaryFile("csc-git", "txt", OutPath))
+	{
+		return llvm::createStringError(EC, "cannot create a temporary file");
+	}
+	llvm::FileRemover OutRemover(OutPath);
+
+	llvm::SmallVector<llvm::StringRef, 8> Argv = {*Git};
+	Argv.append(Args.begin(), Args.end());
+
+	std::optional<llvm::StringRef> Redirects[] = {
+		std::nullopt, llvm::StringRef(OutPath), std::nullopt};
+
+	std::string ErrMsg;
+	int RC = llvm::sys::ExecuteAndWait(*Git, Argv, std::nullopt, Redirects,
+		/*SecondsToWait=*/0, /*MemoryLimit=*/0, &ErrMsg);
+
+	if (RC != 0)
+	{
+		return llvm::createStringError(llvm::inconvertibleErrorCode(),
+			"'git %s' failed: %s", Args.front().str().c_str(),
+			ErrMsg.empty() ? "non-zero exit status" : ErrMsg.c_str());
+	}
+
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Out =
+		llvm::MemoryBuffer::getFile(OutPath);
+	if (!Out)
+	{
+		return llvm::createStringError(Out.getError(),
+			"cannot read the output of git");
+	}
+
+	return (*Out)->getBuffer().str();
+}
+
+// Parses "<start>[,<count>]" of a hunk header
+static bool parseRange(llvm::StringRef Text, unsigned &Start, unsigned &Count)
+{
+	llvm::StringRef StartText, CountText;
+	std::tie(StartText, CountText) = Text.split(',');
+
+	Count = 1;
+	if (StartText.getAsInteger(10, Start))
+	{
+		return false;
+	}
+
+	return CountText.empty() || !CountText.getAsInteger(10, Count);
+}
+
+// Undoes the C-style quoting git applies to paths with spaces, quotes,
+// control or non-ASCII characters: "b/caf\303\251 menu.c"
+static std::string unquotePath(llvm::StringRef Path)
+{
+	if (Path.size() < 2 || !Path.starts_with("\"") || !Path.ends_with("\""))
+	{
+		return Path.str();
+	}
+	Path = Path.drop_front().drop_back();
+
+	// \<letter> and what it stands for
+	static const llvm::StringRef Letters = "abtnvfr";
+	static const llvm::StringRef Chars = "\a\b\t\n\v\f\r";
+
+	std::string Result;
+	for (size_t I = 0; I < Path.size(); ++I)
+	{
+		if (Path[I] != '\\' || I + 1 == Path.size())
+		{
+			Result += Path[I];
+			continue;
+		}
+
+		char C = Path[++I];
+		size_t Letter = Letters.find(C);
+		if (Letter != llvm::StringRef::npos)
+		{
+			Result += Chars[Letter];
+		}
+		else if (C >= '0' && C <= '7')
+		{
+			// Three octal digits - one byte of a UTF-8 sequence
+			unsigned Byte = 0;
+			size_t End = std::min(I + 3, Path.size());
+			for (; I < End && Path[I] >= '0' && Path[I] <= '7'; ++I)
+			{
+				Byte = Byte * 8 + (Path[I] - '0');
+			}
+			--I;
+			Result += static_cast<char>(Byte);
+		}
+		else
+		{
+			// \\ and \"
+			Result += C;
+		}
+	}
+
+	return Result;
+}
+
+//-----------------------------------------------------------------------------
+// CSCChangedLines implementation
+//-----------------------------------------------------------------------------
+llvm::Expected<CSCChangedLines> CSCChangedLines::fromGitDiff(
+	llvm::StringRef Range)
+{
+	llvm::Expected<std::string> Root =
+		runGit({"rev-parse", "--show-toplevel"});
+	if (!Root)
+	{
+		return Root.takeError();
+	}
+
+	// The prefixes are spelled out: diff.noprefix or diff.mnemonicPrefix
+	// would change them
+	llvm::SmallVector<llvm::StringRef, 8> DiffArgs = {
+		"diff", "-U0", "--no-color", "--no-ext-diff", "--src-prefix=a/",
+		"--dst-prefix=b/"};
+	llvm::SmallVector<llvm::StringRef, 4> RangeArgs;
+	Range.split(RangeArgs, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+	DiffArgs.append(RangeArgs.begin(), RangeArgs.end());
+
+	llvm::Expected<std::string> Diff = runGit(DiffArgs);
+	if (!Diff)
+	{
+		return Diff.takeError();
+	}
+
+	return parse(*Diff, llvm::StringRef(*Root).trim());
+}
+
+CSCChangedLines CSCChangedLines::parse(
+	llvm::StringRef Diff,
+	llvm::StringRef RepoRoot)
+{
+	CSCChangedLines Result;
+	std::string CurrentFile;
+
+	while (!Diff.empty())
+	{
+		llvm::StringRef Line;
+		std::tie(Line, Diff) = Diff.split('\n');
+
+		if (Line.starts_with("+++ "))
+		{
+			std::string Unquoted = unquotePath(Line.drop_front(4).rtrim());
+			llvm::StringRef Path = Unquoted;
+			CurrentFile.clear();
+
+			// "+++ /dev/null" - the file was deleted
+			if (!Path.consume_front("b/"))
+			{
+				continue;
+			}
+
+			llvm::SmallString<256> FullPath(RepoRoot);
+			llvm::sys::path::append(FullPath, Path);
+
+			// Keyed by real path, so that lookups through symlinks and
+			// relative paths agree
+			llvm::SmallString<256> RealPath;
+			if (llvm::sys::fs::real_path(FullPath, RealPath))
+			{
+				RealPath = FullPath;
+			}
+			CurrentFile = RealPath.str().str();
+			continue;
+		}
+
+		if (CurrentFile.empty() || !Line.starts_with("@@ "))
+		{
+			continue;
+		}
+
+		// @@ -<old>[,<n>] +<new>[,<n>] @@
+		llvm::StringRef NewRange =
+			Line.drop_front(3).split(' ').second.split(' ').first;
+		unsigned Start = 0, Count = 0;
+		if (!NewRange.consume_front("+") || !parseRange(NewRange, Start, Count))
+		{
+			continue;
+		}
+
+		if (Count == 0)
+		{
+			Result.add(CurrentFile, std::max(Start, 1u), std::max(Start, 1u));
+		}
+		else
+		{
+			Result.add(CurrentFile, Start, Start + Count - 1);
+		}
+	}
+
+	Result.normalize();
+
+	return Result;
+}
+
+const CSCChangedLines::Intervals *CSCChangedLines::lookup(
+	llvm::StringRef File) const
+{
+	llvm::SmallString<256> RealPath;
+	if (llvm::sys::fs::real_path(File, RealPath))
+	{
+		RealPath = File;
+	}
+
+	auto It = Files.find(RealPath);
+	return (It == Files.end()) ? nullptr : &It->second;
+}
+
+bool CSCChangedLines::intersects(const Intervals &Changed, unsigned First,
+	unsigned Last)
+{
+	// The first interval that does not end before First
+	auto It = llvm::partition_point(Changed, [First](const Interval &I) {
+		return I.second < First;
+	});
+
+	return It != Changed.end() && It->first <= Last;
+}
+
+std::vector<std::string> CSCChangedLines::files() const
+{
+	std::vector<std::string> Result;
+	for (const auto &Entry : Files)
+	{
+		Result.push_back(Entry.getKey().str());
+	}
+	llvm::sort(Result);
+
+	return Result;
+}
+
+void CSCChangedLines::add(llvm::StringRef File, unsigned First, unsigned Last)
+{
+	Files[File].emplace_back(First, Last);
+}
+
+void CSCChangedLines::normalize()
+{
+	for (auto &Entry : Files)
+	{
+		Intervals &List = Entry.getValue();
+		llvm::sort(List);
+
+		Intervals Merged;
+		for (const Interval &I : List)
+		{
+			if (!Merged.empty() && I.first <= Merged.back().second + 1)
+			{
+				Merged.back().second = std::max(Merged.back().second, I.second);
+			}
+			else
+			{
+				Merged.push_back(I);
+			}
+		}
+		List = std::move(Merged);
+	}
+}
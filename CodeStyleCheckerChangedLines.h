@@ -0,0 +1,59 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerChangedLines.h
+//
+// DESCRIPTION:
+//    Declares CSCChangedLines - the lines touched by a git diff, per file
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_CHANGED_LINES_H
+#define CLANG_TUTOR_CSC_CHANGED_LINES_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Changed lines
+//-----------------------------------------------------------------------------
+// For every file touched by a diff, a sorted list of disjoint, closed
+// intervals of changed line numbers (1-based, in the new version of the
+// file). Files are keyed by their real path.
+class CSCChangedLines
+{
+public:
+	using Interval = std::pair<unsigned, unsigned>;
+	using Intervals = std::vector<Interval>;
+
+	// Runs `git diff -U0 <Range>` in the current directory and collects the
+	// added and modified lines. Range is split on spaces, so that e.g.
+	// "--cached" or "HEAD~3 HEAD" work too.
+	static llvm::Expected<CSCChangedLines> fromGitDiff(llvm::StringRef Range);
+
+	// Parses the output of `git diff -U0`. The paths in Diff are relative
+	// to RepoRoot.
+	static CSCChangedLines parse(llvm::StringRef Diff, llvm::StringRef RepoRoot);
+
+	// Changed lines of File, nullptr if File was not touched at all
+	const Intervals *lookup(llvm::StringRef File) const;
+
+	// Whether any line in [First, Last] is changed
+	static bool intersects(const Intervals &Changed, unsigned First,
+		unsigned Last);
+
+	// Paths of the touched files
+	std::vector<std::string> files() const;
+
+private:
+	llvm::StringMap<Intervals> Files;
+
+	void add(llvm::StringRef File, unsigned First, unsigned Last);
+	// Sorts and merges overlapping or adjacent intervals
+	void normalize();
+};
+
+#endif
@@ -0,0 +1,176 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerDiagnostics.cpp
+//
+// DESCRIPTION:
+//    Implements CSCDiagnosticConsumer. A record is printed as
+//
+//      <file>:<line>:<col>: warning: <rule message>
+//
+//    followed by the source line and a caret when snippets are requested.
+//    Lines and columns are only computed while printing, i.e. once per
+//    distinct record and in offset order, which keeps the SourceManager line
+//    cache hot.
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerDiagnostics.h"
+
+#include "llvm/ADT/STLExtras.h"
+
+#include <algorithm>
+#include <tuple>
+
+using namespace clang;
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+// Prints the line of Buffer that contains Offset and a caret under Offset
+static void printSnippet(llvm::raw_ostream &Out, StringRef Buffer,
+	unsigned Offset)
+{
+	size_t Begin = Buffer.rfind('\n', Offset);
+	Begin = (Begin == StringRef::npos) ? 0 : Begin + 1;
+
+	size_t End = Buffer.find_first_of("\r\n", Offset);
+	StringRef Line = Buffer.slice(Begin, End);
+
+	Out << Line << '\n';
+
+	// Keep the tabs so the caret lines up with the printed line
+	for (size_t i = Begin; i < Offset; ++i)
+	{
+		Out << (Buffer[i] == '\t' ? '\t' : ' ');
+	}
+	Out << "^\n";
+}
+
+//-----------------------------------------------------------------------------
+// CSCDiagnosticConsumer implementation
+//-----------------------------------------------------------------------------
+CSCDiagnosticConsumer *CSCDiagnosticConsumer::install(
+	DiagnosticsEngine &DiagEngine,
+	llvm::raw_ostream &OS,
+	bool Snippets)
+{
+	// takeClient() only returns the client if the engine owns it. The engine
+	// keeps pointing to the old client until setClient() below.
+	DiagnosticConsumer *Prev = DiagEngine.getClient();
+	std::unique_ptr<DiagnosticConsumer> OwnedPrev = DiagEngine.takeClient();
+
+	auto *Consumer = new CSCDiagnosticConsumer(
+		Prev, std::move(OwnedPrev), OS, Snippets);
+	DiagEngine.setClient(Consumer, /*ShouldOwnClient=*/true);
+
+	return Consumer;
+}
+
+void CSCDiagnosticConsumer::HandleDiagnostic(
+	DiagnosticsEngine::Level Level,
+	const Diagnostic &Info)
+{
+	// Keeps the warning/error counts of this consumer right
+	DiagnosticConsumer::HandleDiagnostic(Level, Info);
+
+	auto It = RuleOfDiag.find(Info.getID());
+	if (It == RuleOfDiag.end() || !Info.hasSourceManager() ||
+		Info.getLocation().isInvalid())
+	{
+		if (Next)
+		{
+			Next->HandleDiagnostic(Level, Info);
+		}
+		return;
+	}
+
+	SM = &Info.getSourceManager();
+
+	std::pair<FileID, unsigned> Loc =
+		SM->getDecomposedExpansionLoc(Info.getLocation());
+	Records.push_back({It->second, Loc.first, Loc.second});
+}
+
+void CSCDiagnosticConsumer::flush()
+{
+	if (Records.empty())
+	{
+		return;
+	}
+
+	llvm::sort(Records, [](const Record &L, const Record &R) {
+		return std::tie(L.FID, L.Offset, L.Rule) <
+			std::tie(R.FID, R.Offset, R.Rule);
+	});
+	Records.erase(
+		std::unique(Records.begin(), Records.end(),
+			[](const Record &L, const Record &R) {
+				return L.FID == R.FID && L.Offset == R.Offset &&
+					L.Rule == R.Rule;
+			}),
+		Records.end());
+
+	// Render the whole TU into memory and hand it to OS in a single write
+	std::string Buffer;
+	Buffer.reserve(Records.size() * 128);
+	llvm::raw_string_ostream Out(Buffer);
+
+	FileID LastFID;
+	StringRef FileName;
+	StringRef FileData;
+
+	for (const Record &R : Records)
+	{
+		if (R.FID != LastFID)
+		{
+			LastFID = R.FID;
+			FileName = SM->getFilename(SM->getLocForStartOfFile(R.FID));
+			FileData = SM->getBufferData(R.FID);
+		}
+
+		Out << FileName << ':' << SM->getLineNumber(R.FID, R.Offset) << ':'
+			<< SM->getColumnNumber(R.FID, R.Offset) << ": warning: "
+			<< getRuleMessage(R.Rule) << '\n';
+
+		if (Snippets)
+		{
+			printSnippet(Out, FileData, R.Offset);
+		}
+	}
+
+	Out.flush();
+	OS << Buffer;
+	OS.flush();
+
+	Records.clear();
+}
+
+void CSCDiagnosticConsumer::BeginSourceFile(
+	const LangOptions &LangOpts,
+	const Preprocessor *PP)
+{
+	if (Next)
+	{
+		Next->BeginSourceFile(LangOpts, PP);
+	}
+}
+
+void CSCDiagnosticConsumer::EndSourceFile()
+{
+	flush();
+
+	if (Next)
+	{
+		Next->EndSourceFile();
+	}
+}
+
+void CSCDiagnosticConsumer::finish()
+{
+	flush();
+
+	if (Next)
+	{
+		Next->finish();
+	}
+}
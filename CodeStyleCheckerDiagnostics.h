@@ -0,0 +1,91 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerDiagnostics.h
+//
+// DESCRIPTION:
+//    Declares CSCDiagnosticConsumer - a compact, buffered consumer for the
+//    CodeStyleChecker warnings
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_DIAGNOSTICS_H
+#define CLANG_TUTOR_CSC_DIAGNOSTICS_H
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeStyleCheckerRules.h"
+
+#include <memory>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// DiagnosticConsumer
+//-----------------------------------------------------------------------------
+// Clang's TextDiagnosticPrinter re-reads the source line of every warning and
+// renders carets and FixIt previews on unbuffered stderr. With thousands of
+// violations in a TU that is the most expensive part of the run.
+//
+// This consumer only keeps (rule, file, offset) for the CSC warnings of the
+// current TU. flush() sorts and deduplicates the records and prints them as
+// one-line records through a single buffered write. Everything that is not a
+// CSC warning (compiler errors, other plugins) goes to the previous consumer.
+class CSCDiagnosticConsumer : public clang::DiagnosticConsumer
+{
+public:
+	CSCDiagnosticConsumer(
+		clang::DiagnosticConsumer *Next,
+		std::unique_ptr<clang::DiagnosticConsumer> OwnedNext,
+		llvm::raw_ostream &OS,
+		bool Snippets)
+		: Next(Next), OwnedNext(std::move(OwnedNext)), OS(OS),
+		Snippets(Snippets) {}
+
+	// Replaces the client of DiagEngine with a CSCDiagnosticConsumer that
+	// forwards to the old one. The engine owns the new consumer.
+	static CSCDiagnosticConsumer *install(
+		clang::DiagnosticsEngine &DiagEngine,
+		llvm::raw_ostream &OS,
+		bool Snippets);
+
+	// Marks DiagID as a diagnostic of Rule. Only these are kept as records.
+	void add_rule(unsigned DiagID, CSCRule Rule)
+	{
+		RuleOfDiag[DiagID] = Rule;
+	}
+
+	// Prints the records collected so far and forgets them
+	void flush();
+
+	void HandleDiagnostic(
+		clang::DiagnosticsEngine::Level Level,
+		const clang::Diagnostic &Info) override;
+
+	void BeginSourceFile(
+		const clang::LangOptions &LangOpts,
+		const clang::Preprocessor *PP) override;
+	void EndSourceFile() override;
+	void finish() override;
+
+private:
+	struct Record
+	{
+		CSCRule Rule;
+		clang::FileID FID;
+		unsigned Offset;
+	};
+
+	clang::DiagnosticConsumer *Next;
+	std::unique_ptr<clang::DiagnosticConsumer> OwnedNext;
+	llvm::raw_ostream &OS;
+	bool Snippets;
+
+	llvm::DenseMap<unsigned, CSCRule> RuleOfDiag;
+	std::vector<Record> Records;
+	// Set by the first record of the TU
+	const clang::SourceManager *SM = nullptr;
+};
+
+#endif
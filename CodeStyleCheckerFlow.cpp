@@ -0,0 +1,62 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerFlow.cpp
+//
+// DESCRIPTION:
+//    Implements CSCFunctionFlow
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerFlow.h"
+
+#include "CodeStyleCheckerMemory.h"
+#include "CodeStyleCheckerRules.h"
+
+//-----------------------------------------------------------------------------
+// CSCFunctionFlow implementation
+//-----------------------------------------------------------------------------
+const clang::CFG *CSCFunctionFlow::cfg()
+{
+	// A function whose CFG can't be built is not tried twice
+	if (!Built)
+	{
+		Built = true;
+		// clang's allocations, not the rules'
+		CSCRuleAllocPause Pause;
+		Graph = buildFunctionCFG(FD, Ctx);
+	}
+
+	return Graph.get();
+}
+
+const llvm::BitVector &CSCFunctionFlow::reachable()
+{
+	if (!Reachable)
+	{
+		Reachable = findReachableBlocks(*cfg());
+	}
+
+	return *Reachable;
+}
+
+bool CSCFunctionFlow::acquires_resource(const clang::VarDecl *Var)
+{
+	// `for (int i = 0; ...)`, `int n;`: a walk of the body tells that nothing
+	// is ever assigned to them - only the rest needs the CFG
+	if (!AssignedVars)
+	{
+		AssignedVars = findAssignedResources(FD->getBody());
+	}
+	if (!AssignedVars->contains(Var) || !cfg())
+	{
+		return false;
+	}
+
+	// One scan of the CFG for all the locals of the function
+	if (!AcquiringVars)
+	{
+		AcquiringVars = findAcquiringVars(*Graph, reachable());
+	}
+
+	return AcquiringVars->contains(Var);
+}
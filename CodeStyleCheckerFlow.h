@@ -0,0 +1,58 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerFlow.h
+//
+// DESCRIPTION:
+//    Declares CSCFunctionFlow - the control flow of the function being
+//    traversed, shared by the flow-sensitive rules (R4.6.8, R5.7, R5.17)
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_FLOW_H
+#define CLANG_TUTOR_CSC_FLOW_H
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/Analysis/CFG.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseSet.h"
+
+#include <memory>
+#include <optional>
+
+// The visitor creates one as it enters a function body and destroys it as it
+// leaves, so at most one CFG per function is alive at a time. Nothing is
+// computed up front: the CFG is built the first time a rule asks for it and
+// every other flow rule of the function reuses it. A function without
+// `main`, a switch or a local assigned a resource never gets one.
+class CSCFunctionFlow
+{
+public:
+	CSCFunctionFlow(const clang::FunctionDecl *FD, clang::ASTContext &Ctx)
+		: FD(FD), Ctx(Ctx) {}
+
+	const clang::FunctionDecl *function() const { return FD; }
+
+	// nullptr if the function has no CFG (see buildFunctionCFG)
+	const clang::CFG *cfg();
+	// The blocks of cfg() reachable from the entry, cfg() must not be nullptr
+	const llvm::BitVector &reachable();
+
+	// R5.17: whether a reachable assignment gives Var a new resource. Builds
+	// the CFG only if some assignment in the body does, false if there is
+	// no CFG.
+	bool acquires_resource(const clang::VarDecl *Var);
+
+private:
+	const clang::FunctionDecl *FD;
+	clang::ASTContext &Ctx;
+
+	bool Built = false;
+	std::unique_ptr<clang::CFG> Graph;
+	std::optional<llvm::BitVector> Reachable;
+	// Assigned a resource anywhere in the body, see findAssignedResources
+	std::optional<llvm::DenseSet<const clang::VarDecl *>> AssignedVars;
+	std::optional<llvm::DenseSet<const clang::VarDecl *>> AcquiringVars;
+};
+
+#endif
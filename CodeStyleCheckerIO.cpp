@@ -0,0 +1,318 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerIO.cpp
+//
+// DESCRIPTION:
+//    Implements the format string parser, CSCFormatStrings and the
+//    classification of stdio calls
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerIO.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+
+#include <algorithm>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Format strings
+//-----------------------------------------------------------------------------
+// R5.4: how error, warning and usage messages start
+static bool looksLikeDiagnostic(llvm::StringRef Text)
+{
+	std::string Lower = Text.ltrim().lower();
+	llvm::StringRef Start(Lower);
+
+	return Start.starts_with("error") || Start.starts_with("warning") ||
+		Start.starts_with("fatal") || Start.starts_with("debug") ||
+		Start.starts_with("usage") || Start.starts_with("cannot") ||
+		Start.starts_with("can't") || Start.starts_with("failed") ||
+		Start.starts_with("invalid") || Start.starts_with("unable") ||
+		// `"%s: error: ..."` with the program name first
+		Start.contains("error:") || Start.contains("warning:");
+}
+
+CSCFormatString parseFormatString(llvm::StringRef Text, CSCFormatKind Kind)
+{
+	CSCFormatString Result;
+	Result.EndsWithNewline = Text.ends_with("\n");
+	Result.LooksLikeDiagnostic = looksLikeDiagnostic(Text);
+
+	size_t I = 0;
+	while (Kind != CSCFormatKind::Text &&
+		(I = Text.find('%', I)) != llvm::StringRef::npos)
+	{
+		CSCFormatSpec Spec = {static_cast<unsigned>(I), 0, 0, false, false};
+		size_t J = I + 1;
+
+		if (J < Text.size() && Text[J] == '%')
+		{
+			I = J + 1;
+			continue;
+		}
+
+		if (Kind == CSCFormatKind::Printf)
+		{
+			while (J < Text.size() &&
+				llvm::StringRef("-+ #0'").contains(Text[J]))
+			{
+				++J;
+			}
+		}
+		else if (J < Text.size() && Text[J] == '*')
+		{
+			Spec.Suppressed = true;
+			++J;
+		}
+
+		// Width, and the precision of printf. A `*` width comes from the
+		// arguments - a width all the same.
+		while (J < Text.size() && (clang::isDigit(Text[J]) ||
+			(Text[J] == '*' && Kind == CSCFormatKind::Printf)))
+		{
+			Spec.HasWidth = true;
+			++J;
+		}
+		if (Kind == CSCFormatKind::Printf && J < Text.size() && Text[J] == '.')
+		{
+			++J;
+			while (J < Text.size() &&
+				(clang::isDigit(Text[J]) || Text[J] == '*'))
+			{
+				++J;
+			}
+		}
+
+		// Length modifiers: hh, h, l, ll, j, z, t, L, q
+		while (J < Text.size() && llvm::StringRef("hljztLq").contains(Text[J]))
+		{
+			++J;
+		}
+
+		// An incomplete conversion at the end is no conversion
+		if (J == Text.size())
+		{
+			break;
+		}
+
+		Spec.Conversion = Text[J++];
+		if (Spec.Conversion == '[')
+		{
+			// `%[]abc]` and `%[^]abc]` - the first `]` is part of the set
+			if (J < Text.size() && Text[J] == '^')
+			{
+				++J;
+			}
+			if (J < Text.size() && Text[J] == ']')
+			{
+				++J;
+			}
+			J = std::min(Text.find(']', J), Text.size() - 1) + 1;
+		}
+
+		Spec.Length = J - I;
+		Result.Specs.push_back(Spec);
+		I = J;
+	}
+
+	Result.EndsWithSpec = !Result.Specs.empty() &&
+		Result.Specs.back().Offset + Result.Specs.back().Length == Text.size();
+
+	return Result;
+}
+
+//-----------------------------------------------------------------------------
+// CSCFormatStrings implementation
+//-----------------------------------------------------------------------------
+const CSCFormatString *CSCFormatStrings::get(const clang::StringLiteral *SL,
+	CSCFormatKind Kind)
+{
+	if (SL->getCharByteWidth() != 1)
+	{
+		return nullptr;
+	}
+
+	auto Inserted = Parsed.try_emplace({SL, static_cast<unsigned>(Kind)});
+	if (Inserted.second)
+	{
+		Inserted.first->second = parseFormatString(SL->getString(), Kind);
+	}
+
+	return &Inserted.first->second;
+}
+
+//-----------------------------------------------------------------------------
+// Calls
+//-----------------------------------------------------------------------------
+// `stdout` is a variable in glibc and musl, a macro for __stdoutp on the BSDs
+// and macOS
+static CSCStream getStream(const clang::Expr *E)
+{
+	const auto *Ref =
+		llvm::dyn_cast<clang::DeclRefExpr>(E->IgnoreParenImpCasts());
+	const clang::IdentifierInfo *II =
+		Ref ? Ref->getDecl()->getIdentifier() : nullptr;
+	if (!II)
+	{
+		return CSCStream::Unknown;
+	}
+
+	return llvm::StringSwitch<CSCStream>(II->getName())
+		.Cases("stdin", "__stdinp", CSCStream::Stdin)
+		.Cases("stdout", "__stdoutp", CSCStream::Stdout)
+		.Cases("stderr", "__stderrp", CSCStream::Stderr)
+		.Default(CSCStream::Unknown);
+}
+
+// dprintf(1, ...), dprintf(STDERR_FILENO, ...)
+static CSCStream getDescriptorStream(const clang::Expr *E,
+	const clang::ASTContext &Ctx)
+{
+	std::optional<llvm::APSInt> FD;
+	if (!E->isValueDependent())
+	{
+		FD = E->getIntegerConstantExpr(Ctx);
+	}
+	if (!FD)
+	{
+		return CSCStream::Unknown;
+	}
+
+	switch (FD->getExtValue())
+	{
+	case 0:
+		return CSCStream::Stdin;
+	case 1:
+		return CSCStream::Stdout;
+	case 2:
+		return CSCStream::Stderr;
+	default:
+		return CSCStream::Unknown;
+	}
+}
+
+std::optional<CSCIOCall> classifyIOCall(const clang::CallExpr *E)
+{
+	const clang::FunctionDecl *Callee = E->getDirectCallee();
+	const clang::IdentifierInfo *II =
+		Callee ? Callee->getIdentifier() : nullptr;
+
+	// Only the C library functions, not e.g. a member called printf
+	if (!II || !(Callee->isExternC() || Callee->isInStdNamespace()))
+	{
+		return std::nullopt;
+	}
+
+	// (kind, stream argument or -1, text argument or -1)
+	struct Signature
+	{
+		CSCIOCall::Kind Function;
+		CSCStream Stream;
+		int StreamArg;
+		int TextArg;
+	};
+	std::optional<Signature> Sig =
+		llvm::StringSwitch<std::optional<Signature>>(II->getName())
+		.Cases("printf", "vprintf",
+			Signature{CSCIOCall::Print, CSCStream::Stdout, -1, 0})
+		.Cases("fprintf", "vfprintf",
+			Signature{CSCIOCall::Print, CSCStream::Unknown, 0, 1})
+		.Cases("dprintf", "vdprintf",
+			Signature{CSCIOCall::Print, CSCStream::Unknown, 0, 1})
+		.Cases("scanf", "vscanf",
+			Signature{CSCIOCall::Scan, CSCStream::Stdin, -1, 0})
+		.Cases("fscanf", "vfscanf",
+			Signature{CSCIOCall::Scan, CSCStream::Unknown, 0, 1})
+		.Cases("sscanf", "vsscanf",
+			Signature{CSCIOCall::Scan, CSCStream::Unknown, -1, 1})
+		.Case("puts", Signature{CSCIOCall::Puts, CSCStream::Stdout, -1, 0})
+		.Case("fputs", Signature{CSCIOCall::Write, CSCStream::Unknown, 1, 0})
+		.Case("putchar",
+			Signature{CSCIOCall::PutChar, CSCStream::Stdout, -1, -1})
+		.Cases("putc", "fputc",
+			Signature{CSCIOCall::PutChar, CSCStream::Unknown, 1, -1})
+		.Default(std::nullopt);
+	if (!Sig || static_cast<int>(E->getNumArgs()) <=
+		std::max(Sig->StreamArg, Sig->TextArg))
+	{
+		return std::nullopt;
+	}
+
+	CSCIOCall Call = {Sig->Function, Sig->Stream, nullptr};
+	if (Sig->StreamArg >= 0)
+	{
+		const clang::Expr *Stream = E->getArg(Sig->StreamArg);
+		Call.Stream = II->getName().contains("dprintf")
+			? getDescriptorStream(Stream, Callee->getASTContext())
+			: getStream(Stream);
+	}
+	if (Sig->TextArg >= 0)
+	{
+		Call.Text = llvm::dyn_cast<clang::StringLiteral>(
+			E->getArg(Sig->TextArg)->IgnoreParenImpCasts());
+	}
+
+	return Call;
+}
+
+std::vector<const clang::CallExpr *> findLastOutputs(const clang::CFG &Graph,
+	const llvm::BitVector &Reachable, const clang::SourceManager &SM)
+{
+	std::vector<const clang::CallExpr *> Result;
+
+	// Backwards from the exit. A path stops at its first output call,
+	// any other block leads further back.
+	llvm::BitVector Visited(Graph.getNumBlockIDs());
+	llvm::SmallVector<const clang::CFGBlock *, 32> Worklist;
+	Worklist.push_back(&Graph.getExit());
+	Visited.set(Graph.getExit().getBlockID());
+
+	while (!Worklist.empty())
+	{
+		const clang::CFGBlock *Block = Worklist.pop_back_val();
+
+		const clang::CallExpr *Output = nullptr;
+		for (const clang::CFGElement &E : llvm::reverse(*Block))
+		{
+			std::optional<clang::CFGStmt> S = E.getAs<clang::CFGStmt>();
+			const auto *Call = S
+				? llvm::dyn_cast<clang::CallExpr>(S->getStmt()) : nullptr;
+			std::optional<CSCIOCall> IO =
+				Call ? classifyIOCall(Call) : std::nullopt;
+			if (IO && IO->Stream == CSCStream::Stdout &&
+				IO->Function != CSCIOCall::Scan)
+			{
+				Output = Call;
+				break;
+			}
+		}
+		if (Output)
+		{
+			Result.push_back(Output);
+			continue;
+		}
+
+		for (const clang::CFGBlock *Pred : Block->preds())
+		{
+			if (Pred && Reachable.test(Pred->getBlockID()) &&
+				!Visited.test(Pred->getBlockID()))
+			{
+				Visited.set(Pred->getBlockID());
+				Worklist.push_back(Pred);
+			}
+		}
+	}
+
+	llvm::sort(Result, [&](const clang::CallExpr *A, const clang::CallExpr *B) {
+		return SM.isBeforeInTranslationUnit(A->getBeginLoc(), B->getBeginLoc());
+	});
+	Result.erase(std::unique(Result.begin(), Result.end()), Result.end());
+
+	return Result;
+}
@@ -0,0 +1,144 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerIO.h
+//
+// DESCRIPTION:
+//    Declares what the input/output rules (R5.4, R5.5, R5.6, the scanf half
+//    of R5.8) know about a call: which stdio function it is, which stream it
+//    writes to, and the parsed format string - one parse per literal per TU,
+//    see CSCFormatStrings
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_IO_H
+#define CLANG_TUTOR_CSC_IO_H
+
+#include "clang/AST/Expr.h"
+#include "clang/Analysis/CFG.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Format strings
+//-----------------------------------------------------------------------------
+enum class CSCFormatKind : unsigned
+{
+	Printf,
+	Scanf,
+	Text,		// puts, fputs: no conversions
+};
+
+// One conversion: `%-8.3lf`, `%*d`, `%[^\n]`
+struct CSCFormatSpec
+{
+	unsigned Offset;	// of the '%', in the bytes of the literal
+	unsigned Length;	// up to and including the conversion
+	char Conversion;	// 'd', 's', '[', ...
+	bool HasWidth;		// scanf: the maximum field width
+	bool Suppressed;	// scanf: `%*d` stores nothing
+
+	// R5.8: a scanf conversion that may overflow the buffer it fills
+	bool is_unbounded_string() const
+	{
+		return (Conversion == 's' || Conversion == '[') && !HasWidth &&
+			!Suppressed;
+	}
+};
+
+// Everything the rules ask about a format string (or the text of puts),
+// computed in one pass over the characters
+struct CSCFormatString
+{
+	llvm::SmallVector<CSCFormatSpec, 4> Specs;
+	bool EndsWithNewline = false;
+	// The last conversion is at the very end, so a `%s` or `%c` may still
+	// supply the newline
+	bool EndsWithSpec = false;
+	// Starts like an error, a warning or a usage message (R5.4)
+	bool LooksLikeDiagnostic = false;
+
+	// R5.5, R5.6: the text surely does not end the line
+	bool lacks_newline() const
+	{
+		return !EndsWithNewline && !(EndsWithSpec &&
+			(Specs.back().Conversion == 's' || Specs.back().Conversion == 'c'));
+	}
+};
+
+CSCFormatString parseFormatString(llvm::StringRef Text, CSCFormatKind Kind);
+
+// The format strings of a TU, parsed on first use. A call is looked at by
+// several rules - R5.4 and R5.5 as it is visited, R5.6 again from the CFG of
+// main - and each of them asks for its format: the literal is parsed by the
+// first one only.
+class CSCFormatStrings
+{
+public:
+	// nullptr if SL is not a narrow string. The result is valid until the
+	// next call.
+	const CSCFormatString *get(const clang::StringLiteral *SL,
+		CSCFormatKind Kind);
+
+private:
+	llvm::DenseMap<std::pair<const clang::StringLiteral *, unsigned>,
+		CSCFormatString> Parsed;
+};
+
+//-----------------------------------------------------------------------------
+// Calls
+//-----------------------------------------------------------------------------
+enum class CSCStream
+{
+	Unknown,
+	Stdin,
+	Stdout,
+	Stderr,
+};
+
+// A call of a stdio function the rules care about
+struct CSCIOCall
+{
+	enum Kind
+	{
+		Print,		// printf, fprintf, dprintf, vprintf, vfprintf
+		Scan,		// scanf, fscanf, sscanf, vscanf, vfscanf, vsscanf
+		Puts,		// puts - adds the newline itself
+		Write,		// fputs - the text as it is
+		PutChar,	// putchar, putc, fputc - character by character
+	};
+
+	Kind Function;
+	CSCStream Stream;
+	// The format (or the text), nullptr if it is not a literal
+	const clang::StringLiteral *Text;
+
+	CSCFormatKind format_kind() const
+	{
+		switch (Function)
+		{
+		case Print:
+			return CSCFormatKind::Printf;
+		case Scan:
+			return CSCFormatKind::Scanf;
+		default:
+			return CSCFormatKind::Text;
+		}
+	}
+};
+
+// std::nullopt for anything but the C library functions above
+std::optional<CSCIOCall> classifyIOCall(const clang::CallExpr *E);
+
+// R5.6: the calls that write to stdout last before the program ends - on
+// every reachable path of Graph to its exit, the last such call, if any. In
+// source order.
+std::vector<const clang::CallExpr *> findLastOutputs(const clang::CFG &Graph,
+	const llvm::BitVector &Reachable, const clang::SourceManager &SM);
+
+#endif
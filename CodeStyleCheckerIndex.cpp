@@ -0,0 +1,309 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerIndex.cpp
+//
+// DESCRIPTION:
+//    Implements CSCSymbolIndex
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerIndex.h"
+
+#include "CodeStyleCheckerLock.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cctype>
+#include <tuple>
+#include <utility>
+
+static const char IndexHeader[] = "csc-index 1";
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+static llvm::Error malformed(llvm::StringRef Path, llvm::StringRef Line)
+{
+	return llvm::createStringError(llvm::inconvertibleErrorCode(),
+		"malformed line in index '%s': %s", Path.str().c_str(),
+		Line.str().c_str());
+}
+
+static bool isIdentifierChar(char C)
+{
+	return isalnum(static_cast<unsigned char>(C)) || C == '_';
+}
+
+//-----------------------------------------------------------------------------
+// CSCSymbolIndex implementation
+//-----------------------------------------------------------------------------
+llvm::Error CSCSymbolIndex::load(llvm::StringRef Path)
+{
+	TUs.clear();
+
+	if (!llvm::sys::fs::exists(Path))
+	{
+		return llvm::Error::success();
+	}
+
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufOrErr =
+		llvm::MemoryBuffer::getFile(Path, /*IsText=*/true);
+	if (std::error_code EC = BufOrErr.getError())
+	{
+		return llvm::createStringError(EC, "cannot read index '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	llvm::StringRef Contents = (*BufOrErr)->getBuffer();
+	llvm::StringRef Line;
+
+	std::tie(Line, Contents) = Contents.split('\n');
+	if (Line.rtrim() != IndexHeader)
+	{
+		return llvm::createStringError(llvm::inconvertibleErrorCode(),
+			"'%s' is not a code style index", Path.str().c_str());
+	}
+
+	TUSymbols *TU = nullptr;
+	Symbol *Sym = nullptr;
+
+	while (!Contents.empty())
+	{
+		std::tie(Line, Contents) = Contents.split('\n');
+		Line = Line.rtrim("\r");
+
+		if (Line.empty())
+		{
+			continue;
+		}
+		if (Line.size() < 2 || Line[1] != ' ')
+		{
+			return malformed(Path, Line);
+		}
+
+		llvm::StringRef Rest = Line.drop_front(2);
+
+		switch (Line[0])
+		{
+		case 'T':
+			TU = &TUs[Rest.str()];
+			*TU = TUSymbols();
+			Sym = nullptr;
+			break;
+
+		case 'F':
+			if (!TU)
+			{
+				return malformed(Path, Line);
+			}
+			TU->Files.push_back(Rest.str());
+			break;
+
+		case 'S':
+		{
+			llvm::SmallVector<llvm::StringRef, 3> Fields;
+			Rest.split(Fields, '\t');
+			if (!TU || Fields.size() != 3)
+			{
+				return malformed(Path, Line);
+			}
+			TU->Symbols.push_back(
+				{Fields[0].str(), Fields[1].str(), Fields[2].str(), {}});
+			Sym = &TU->Symbols.back();
+			break;
+		}
+
+		case 'R':
+		{
+			if (!Sym)
+			{
+				return malformed(Path, Line);
+			}
+
+			llvm::SmallVector<llvm::StringRef, 16> Refs;
+			Rest.split(Refs, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+			for (llvm::StringRef Ref : Refs)
+			{
+				llvm::StringRef FileText, OffsetText;
+				std::tie(FileText, OffsetText) = Ref.split(':');
+
+				Location Loc;
+				if (FileText.getAsInteger(10, Loc.File) ||
+					OffsetText.getAsInteger(10, Loc.Offset) ||
+					Loc.File >= TU->Files.size())
+				{
+					return malformed(Path, Line);
+				}
+				Sym->Refs.push_back(Loc);
+			}
+			break;
+		}
+
+		default:
+			return malformed(Path, Line);
+		}
+	}
+
+	return llvm::Error::success();
+}
+
+llvm::Error CSCSymbolIndex::write(llvm::StringRef Path) const
+{
+	// writeToOutput() writes a temporary file next to Path and renames it
+	llvm::Error E = llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+	{
+		OS << IndexHeader << '\n';
+		for (const auto &TU : TUs)
+		{
+			OS << "T " << TU.first << '\n';
+			for (const std::string &File : TU.second.Files)
+			{
+				OS << "F " << File << '\n';
+			}
+			for (const Symbol &Sym : TU.second.Symbols)
+			{
+				OS << "S " << Sym.USR << '\t' << Sym.Name << '\t'
+					<< Sym.NewName << '\n' << 'R';
+				for (const Location &Ref : Sym.Refs)
+				{
+					OS << ' ' << Ref.File << ':' << Ref.Offset;
+				}
+				OS << '\n';
+			}
+		}
+		return llvm::Error::success();
+	});
+
+	if (E)
+	{
+		return llvm::createStringError(llvm::inconvertibleErrorCode(),
+			"cannot write index '%s': %s", Path.str().c_str(),
+			llvm::toString(std::move(E)).c_str());
+	}
+
+	return llvm::Error::success();
+}
+
+llvm::Error CSCSymbolIndex::merge_into(llvm::StringRef Path) const
+{
+	return lockedUpdate(Path, [&]() -> llvm::Error
+	{
+		CSCSymbolIndex OnDisk;
+		if (llvm::Error E = OnDisk.load(Path))
+		{
+			return E;
+		}
+
+		for (const std::string &MainFile : Updated)
+		{
+			auto It = TUs.find(MainFile);
+			if (It == TUs.end())
+			{
+				OnDisk.TUs.erase(MainFile);
+			}
+			else
+			{
+				OnDisk.TUs[MainFile] = It->second;
+			}
+		}
+
+		return OnDisk.write(Path);
+	});
+}
+
+void CSCSymbolIndex::update(llvm::StringRef MainFile, TUSymbols Symbols)
+{
+	std::lock_guard<std::mutex> Guard(Lock);
+
+	Updated.insert(MainFile.str());
+	if (Symbols.Symbols.empty())
+	{
+		TUs.erase(MainFile.str());
+		return;
+	}
+
+	TUs[MainFile.str()] = std::move(Symbols);
+}
+
+llvm::Expected<unsigned> CSCSymbolIndex::apply_fixes() const
+{
+	// File -> offset -> (old name, new name). A header is seen by many TUs,
+	// so most edits are recorded several times - the map keeps one of each.
+	using Edit = std::pair<llvm::StringRef, llvm::StringRef>;
+	std::map<std::string, std::map<unsigned, Edit>> Edits;
+
+	for (const auto &TU : TUs)
+	{
+		for (const Symbol &Sym : TU.second.Symbols)
+		{
+			for (const Location &Ref : Sym.Refs)
+			{
+				Edits[TU.second.Files[Ref.File]].emplace(Ref.Offset,
+					Edit(Sym.Name, Sym.NewName));
+			}
+		}
+	}
+
+	unsigned Rewritten = 0;
+
+	for (const auto &FileEdits : Edits)
+	{
+		const std::string &File = FileEdits.first;
+
+		llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufOrErr =
+			llvm::MemoryBuffer::getFile(File);
+		if (std::error_code EC = BufOrErr.getError())
+		{
+			return llvm::createStringError(EC, "cannot read '%s': %s",
+				File.c_str(), EC.message().c_str());
+		}
+
+		llvm::StringRef Code = (*BufOrErr)->getBuffer();
+		std::string Result;
+		Result.reserve(Code.size());
+
+		size_t Pos = 0;
+		for (const auto &E : FileEdits.second)
+		{
+			unsigned Offset = E.first;
+			llvm::StringRef Name = E.second.first;
+
+			// Stale (the file changed since it was indexed) or overlapping
+			// with the previous edit
+			size_t End = Offset + Name.size();
+			if (Offset < Pos || Code.substr(Offset, Name.size()) != Name ||
+				(End < Code.size() && isIdentifierChar(Code[End])))
+			{
+				continue;
+			}
+
+			Result.append(Code.data() + Pos, Offset - Pos);
+			Result += E.second.second;
+			Pos = End;
+		}
+
+		if (Pos == 0)
+		{
+			continue;
+		}
+		Result.append(Code.substr(Pos).str());
+
+		// Don't write through a possibly mmap-ed buffer
+		BufOrErr->reset();
+
+		std::error_code EC;
+		llvm::raw_fd_ostream OS(File, EC);
+		if (EC)
+		{
+			return llvm::createStringError(EC, "cannot write '%s': %s",
+				File.c_str(), EC.message().c_str());
+		}
+		OS << Result;
+		++Rewritten;
+	}
+
+	return Rewritten;
+}
@@ -0,0 +1,109 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerIndex.h
+//
+// DESCRIPTION:
+//    Declares CSCSymbolIndex - the persistent, cross-TU index of the symbols
+//    that violate the naming rules and of all their references
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_INDEX_H
+#define CLANG_TUTOR_CSC_INDEX_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Symbol index
+//-----------------------------------------------------------------------------
+// The FixIt of a naming warning only renames the declaration. To rename a
+// symbol consistently, every TU records the USR of each flagged declaration
+// and every location that spells its name (redeclarations, DeclRefExprs,
+// MemberExprs, TypeLocs). The records are merged by USR when the fixes are
+// applied, so a symbol declared in a header is renamed in all TUs at once.
+//
+// The index is kept per TU: re-checking a TU replaces only its own records.
+// Files are recorded by their real path, so the TUs of a build that compiles
+// from several directories agree on them. On disk it is a line-based file:
+//
+//    csc-index 1
+//    T <main file of the TU>
+//    F <file>                                 (file table of the TU)
+//    S <usr> \t <name> \t <new name>
+//    R <file #>:<offset> <file #>:<offset> ...
+class CSCSymbolIndex
+{
+public:
+	struct Location
+	{
+		unsigned File;		// index into TUSymbols::Files
+		unsigned Offset;	// of the first character of the name
+
+		bool operator<(const Location &Other) const
+		{
+			return File < Other.File ||
+				(File == Other.File && Offset < Other.Offset);
+		}
+		bool operator==(const Location &Other) const
+		{
+			return File == Other.File && Offset == Other.Offset;
+		}
+	};
+
+	struct Symbol
+	{
+		std::string USR;
+		std::string Name;
+		std::string NewName;
+		std::vector<Location> Refs;
+	};
+
+	// Everything one TU contributed to the index
+	struct TUSymbols
+	{
+		std::vector<std::string> Files;
+		std::vector<Symbol> Symbols;
+	};
+
+	// A missing file is an empty index
+	llvm::Error load(llvm::StringRef Path);
+	// Replaces Path atomically: a reader sees the old or the new file
+	llvm::Error write(llvm::StringRef Path) const;
+	// Replaces the records in Path of the TUs passed to update() since the
+	// last clear(), keeping those of the other TUs. Every compiler process
+	// of a parallel build does this for its own TU, so the read-merge-write
+	// is serialized by a lock on Path.lock.
+	llvm::Error merge_into(llvm::StringRef Path) const;
+
+	// Replaces the records of the TU with main file MainFile, a real path.
+	// Safe to call from several threads.
+	void update(llvm::StringRef MainFile, TUSymbols Symbols);
+
+	// Renames every indexed symbol at every recorded location. Locations
+	// whose text is not the old name any more (the file was edited since it
+	// was indexed) are left alone. Returns the number of rewritten files.
+	llvm::Expected<unsigned> apply_fixes() const;
+
+	// Forgets everything, e.g. after the fixes were applied
+	void clear()
+	{
+		TUs.clear();
+		Updated.clear();
+	}
+
+private:
+	// Ordered, so that the file on disk does not depend on the TU order
+	std::map<std::string, TUSymbols> TUs;
+	// The main files of the TUs merge_into() writes
+	std::set<std::string> Updated;
+	std::mutex Lock;
+};
+
+#endif
@@ -0,0 +1,285 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerLayout.cpp
+//
+// DESCRIPTION:
+//    Implements CSCTokenStream and CSCLayout
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerLayout.h"
+
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+
+//-----------------------------------------------------------------------------
+// CSCTokenStream implementation
+//-----------------------------------------------------------------------------
+CSCTokenStream::CSCTokenStream(
+	const clang::SourceManager &SM,
+	clang::FileID FID,
+	const clang::LangOptions &LangOpts)
+{
+	llvm::MemoryBufferRef Buffer = SM.getBufferOrFake(FID);
+	Code = Buffer.getBuffer();
+
+	// Raw lexing: no preprocessing and no header is read
+	clang::Lexer Lex(FID, Buffer, SM, LangOpts);
+	Lex.SetCommentRetentionState(true);
+
+	// Roughly one token per 4 characters of source
+	Tokens.reserve(Code.size() / 4);
+
+	clang::Token Tok;
+	while (true)
+	{
+		Lex.LexFromRawLexer(Tok);
+		if (Tok.is(clang::tok::eof))
+		{
+			break;
+		}
+		if (Tok.is(clang::tok::comment))
+		{
+			Comments.emplace_back(SM.getFileOffset(Tok.getLocation()),
+				Tok.getLength());
+			continue;
+		}
+
+		Tokens.push_back({SM.getFileOffset(Tok.getLocation()), Tok.getLength(),
+			Tok.getKind(), Tok.isAtStartOfLine()});
+	}
+}
+
+std::optional<unsigned> CSCTokenStream::find(unsigned Offset) const
+{
+	auto It = std::lower_bound(Tokens.begin(), Tokens.end(), Offset,
+		[](const Token &Tok, unsigned Offset) { return Tok.Offset < Offset; });
+	if (It == Tokens.end() || It->Offset != Offset)
+	{
+		return std::nullopt;
+	}
+
+	return It - Tokens.begin();
+}
+
+llvm::StringRef CSCTokenStream::gap_text(size_t I) const
+{
+	unsigned Begin = I == 0 ? 0 : Tokens[I - 1].Offset + Tokens[I - 1].Length;
+	unsigned End = I == Tokens.size() ? Code.size() : Tokens[I].Offset;
+	return Code.slice(Begin, End);
+}
+
+CSCTokenStream::Gap CSCTokenStream::gap(size_t I) const
+{
+	llvm::StringRef Text = gap_text(I);
+
+	if (Text.empty())
+	{
+		return Gap::None;
+	}
+	// The lexer only skips comments, whitespace and escaped line breaks
+	if (Text.contains("//") || Text.contains("/*"))
+	{
+		return Gap::Comment;
+	}
+	if (Text.find_first_of("\n\r") != llvm::StringRef::npos)
+	{
+		return Gap::Break;
+	}
+
+	return Gap::Blank;
+}
+
+bool CSCTokenStream::starts_line(size_t I) const
+{
+	unsigned Offset = Tokens[I].Offset;
+	return Offset == 0 || Code[Offset - 1] == '\n' || Code[Offset - 1] == '\r';
+}
+
+uint64_t CSCTokenStream::fingerprint() const
+{
+	if (Fingerprint)
+	{
+		return *Fingerprint;
+	}
+
+	std::string Stream;
+	Stream.reserve(Code.size());
+
+	bool InDirective = false;
+	for (size_t I = 0; I < Tokens.size(); ++I)
+	{
+		// Line breaks only matter where they end a directive
+		if (Tokens[I].AtStartOfLine)
+		{
+			if (InDirective)
+			{
+				Stream += '\n';
+			}
+			InDirective = Tokens[I].Kind == clang::tok::hash;
+			if (InDirective)
+			{
+				Stream += '\n';
+			}
+		}
+
+		Stream += text(I);
+		Stream += '\0';
+	}
+
+	Fingerprint = llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Stream));
+	return *Fingerprint;
+}
+
+CSCTokenStream::Position CSCTokenStream::position(unsigned Offset) const
+{
+	auto It = std::upper_bound(Tokens.begin(), Tokens.end(), Offset,
+		[](unsigned Offset, const Token &Tok) { return Offset < Tok.Offset; });
+	if (It == Tokens.begin())
+	{
+		return {-1, Offset};
+	}
+
+	--It;
+	return {static_cast<int>(It - Tokens.begin()), Offset - It->Offset};
+}
+
+CSCTokenStream::Position CSCTokenStream::end_position(unsigned Offset) const
+{
+	auto It = std::lower_bound(Tokens.begin(), Tokens.end(), Offset,
+		[](const Token &Tok, unsigned Offset) { return Tok.Offset < Offset; });
+	if (It == Tokens.begin())
+	{
+		return {-1, Offset};
+	}
+
+	--It;
+	return {static_cast<int>(It - Tokens.begin()), Offset - It->Offset};
+}
+
+unsigned CSCTokenStream::offset(Position Pos) const
+{
+	if (Pos.Token < 0 || Tokens.empty())
+	{
+		return Pos.Delta;
+	}
+
+	// Same fingerprint, same number of tokens - unless the cache file was
+	// edited by hand
+	size_t Token = std::min<size_t>(Pos.Token, Tokens.size() - 1);
+	return Tokens[Token].Offset + Pos.Delta;
+}
+
+//-----------------------------------------------------------------------------
+// CSCLayout implementation
+//-----------------------------------------------------------------------------
+const CSCTokenStream &CSCLayout::tokens(clang::FileID FID)
+{
+	std::unique_ptr<CSCTokenStream> &Stream = Streams[FID];
+	if (!Stream)
+	{
+		Stream = std::make_unique<CSCTokenStream>(SM, FID, LangOpts);
+	}
+
+	return *Stream;
+}
+
+std::optional<std::pair<clang::FileID, unsigned>>
+CSCLayout::find(clang::SourceLocation Loc)
+{
+	// The layout of a macro expansion is the layout of the macro definition
+	if (Loc.isInvalid() || Loc.isMacroID() || SM.isInSystemHeader(Loc))
+	{
+		return std::nullopt;
+	}
+
+	std::pair<clang::FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+	std::optional<unsigned> Token =
+		tokens(Decomposed.first).find(Decomposed.second);
+	if (!Token)
+	{
+		return std::nullopt;
+	}
+
+	return std::make_pair(Decomposed.first, *Token);
+}
+
+void CSCLayout::expect(CSCRule Rule, clang::FileID FID, unsigned Token,
+	CSCGapCheck Check)
+{
+	Expectations.push_back({Rule, FID, Token, Check});
+}
+
+void CSCLayout::expect_before(CSCRule Rule, clang::SourceLocation Loc,
+	CSCGapCheck Check)
+{
+	if (auto Found = find(Loc))
+	{
+		expect(Rule, Found->first, Found->second, Check);
+	}
+}
+
+void CSCLayout::expect_after(CSCRule Rule, clang::SourceLocation Loc,
+	CSCGapCheck Check)
+{
+	auto Found = find(Loc);
+	if (Found && Found->second + 1 < tokens(Found->first).size())
+	{
+		expect(Rule, Found->first, Found->second + 1, Check);
+	}
+}
+
+void CSCLayout::check(llvm::function_ref<void(const Expectation &,
+	const CSCTokenStream &)> Fail)
+{
+	auto Key = [](const Expectation &E) {
+		return std::make_tuple(E.FID, E.Token, static_cast<unsigned>(E.Check));
+	};
+
+	// Stable: of the identical expectations the first one filed is kept
+	std::stable_sort(Expectations.begin(), Expectations.end(),
+		[&](const Expectation &A, const Expectation &B) {
+			return Key(A) < Key(B);
+		});
+	Expectations.erase(std::unique(Expectations.begin(), Expectations.end(),
+		[&](const Expectation &A, const Expectation &B) {
+			return Key(A) == Key(B);
+		}), Expectations.end());
+
+	for (const Expectation &E : Expectations)
+	{
+		const CSCTokenStream &Toks = tokens(E.FID);
+		if (E.Token < Toks.size() && !meetsGapCheck(Toks, E.Token, E.Check))
+		{
+			Fail(E, Toks);
+		}
+	}
+}
+
+bool meetsGapCheck(const CSCTokenStream &Toks, size_t I, CSCGapCheck Check)
+{
+	if (Check == CSCGapCheck::LineStart)
+	{
+		return Toks.starts_line(I);
+	}
+
+	switch (Toks.gap(I))
+	{
+	case CSCTokenStream::Gap::None:
+		return Check != CSCGapCheck::Blank;
+	case CSCTokenStream::Gap::Blank:
+		return Check == CSCGapCheck::Blank;
+	case CSCTokenStream::Gap::Break:
+		return Check != CSCGapCheck::NoGap;
+	case CSCTokenStream::Gap::Comment:
+		return true;
+	}
+
+	return true;
+}
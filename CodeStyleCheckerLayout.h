@@ -0,0 +1,182 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerLayout.h
+//
+// DESCRIPTION:
+//    Declares CSCTokenStream - the raw tokens of one file, lexed once per TU -
+//    and CSCLayout, the engine behind the section 4 layout rules, which checks
+//    the whitespace between the tokens that the AST points at
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_LAYOUT_H
+#define CLANG_TUTOR_CSC_LAYOUT_H
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TokenKinds.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "CodeStyleCheckerRules.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Token stream
+//-----------------------------------------------------------------------------
+// The tokens of one buffer as the raw lexer sees them: no preprocessing, no
+// header is read, whitespace is skipped and the comments are kept aside.
+// Everything that looks at the layout of a file (the section 4 rules, the
+// -cache fingerprint, R5.12 after a cache hit) queries the same stream by
+// file offset instead of re-lexing the text.
+class CSCTokenStream
+{
+public:
+	struct Token
+	{
+		unsigned Offset;
+		unsigned Length;
+		clang::tok::TokenKind Kind;
+		bool AtStartOfLine;
+	};
+
+	// Offset Delta into token Token (-1: the start of the file)
+	struct Position
+	{
+		int Token = -1;
+		unsigned Delta = 0;
+	};
+
+	// What separates a token from the one before it
+	enum class Gap
+	{
+		None,		// nothing, the tokens touch
+		Blank,		// spaces and tabs
+		Break,		// at least one line break
+		Comment,	// a comment - never judged
+	};
+
+	CSCTokenStream(const clang::SourceManager &SM, clang::FileID FID,
+		const clang::LangOptions &LangOpts);
+
+	size_t size() const { return Tokens.size(); }
+	const Token &operator[](size_t I) const { return Tokens[I]; }
+	llvm::StringRef text(size_t I) const
+	{
+		return Code.substr(Tokens[I].Offset, Tokens[I].Length);
+	}
+
+	// [offset, length) of every comment, in file order
+	const std::vector<std::pair<unsigned, unsigned>> &comments() const
+	{
+		return Comments;
+	}
+
+	// Index of the token that starts at Offset
+	std::optional<unsigned> find(unsigned Offset) const;
+
+	// The text between token I - 1 (the start of the file for 0) and token I
+	llvm::StringRef gap_text(size_t I) const;
+	Gap gap(size_t I) const;
+	// Token I is the first on its line and in the first column
+	bool starts_line(size_t I) const;
+
+	// Stable across runs. Only the tokens and the ends of preprocessor
+	// directives take part, not their layout. Computed on first use.
+	uint64_t fingerprint() const;
+
+	Position position(unsigned Offset) const;
+	// Same, but an offset right after a token stays with that token (the end
+	// of a range)
+	Position end_position(unsigned Offset) const;
+	unsigned offset(Position Pos) const;
+
+private:
+	llvm::StringRef Code;
+	std::vector<Token> Tokens;
+	std::vector<std::pair<unsigned, unsigned>> Comments;
+	mutable std::optional<uint64_t> Fingerprint;
+};
+
+//-----------------------------------------------------------------------------
+// Layout engine
+//-----------------------------------------------------------------------------
+// What a gap between two tokens must look like
+enum class CSCGapCheck : unsigned
+{
+	NoGap,		// `a->b`, `f(`
+	NoBlank,	// no spaces, a line break is fine: `(`, `)`
+	Blank,		// a space or a line break: `a + b`, `a, b`
+	LineStart,	// the token begins its line, in the first column
+};
+
+// The section 4 rules are expectations about the gaps between tokens. The
+// visitor finds the interesting tokens in the AST (the operator of a
+// BinaryOperator, the star of a pointer declarator, the braces of a function
+// body) and files an expectation about the gap before or after each one.
+// They are all checked at the end of the TU, file by file, against the
+// token streams - one lexing pass per file, however many rules there are.
+//
+// Expectations are kept as (file, token index) pairs: they depend on the
+// tokens only, not on the whitespace, so -cache can store them and re-check
+// them against a file that only changed its layout.
+class CSCLayout
+{
+public:
+	struct Expectation
+	{
+		CSCRule Rule;
+		clang::FileID FID;
+		unsigned Token;		// the gap before this token
+		CSCGapCheck Check;
+	};
+
+	CSCLayout(const clang::SourceManager &SM,
+		const clang::LangOptions &LangOpts)
+		: SM(SM), LangOpts(LangOpts) {}
+
+	// Lexed on first use
+	const CSCTokenStream &tokens(clang::FileID FID);
+
+	// The token that starts at Loc. std::nullopt if Loc comes from a macro,
+	// is in a system header or does not start a token.
+	std::optional<std::pair<clang::FileID, unsigned>>
+	find(clang::SourceLocation Loc);
+
+	void expect(CSCRule Rule, clang::FileID FID, unsigned Token,
+		CSCGapCheck Check);
+	// The same for the gap before / after the token at Loc (see find())
+	void expect_before(CSCRule Rule, clang::SourceLocation Loc,
+		CSCGapCheck Check);
+	void expect_after(CSCRule Rule, clang::SourceLocation Loc,
+		CSCGapCheck Check);
+
+	const std::vector<Expectation> &expectations() const
+	{
+		return Expectations;
+	}
+
+	// Calls Fail for every expectation the gap does not meet, in file and
+	// token order. A gap with several identical expectations (e.g. from the
+	// instantiations of a template) fails once.
+	void check(llvm::function_ref<void(const Expectation &,
+		const CSCTokenStream &)> Fail);
+
+private:
+	const clang::SourceManager &SM;
+	const clang::LangOptions &LangOpts;
+
+	llvm::DenseMap<clang::FileID, std::unique_ptr<CSCTokenStream>> Streams;
+	std::vector<Expectation> Expectations;
+};
+
+// Whether the gap before token I of Toks meets Check
+bool meetsGapCheck(const CSCTokenStream &Toks, size_t I, CSCGapCheck Check);
+
+#endif
@@ -0,0 +1,54 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerLock.cpp
+//
+// DESCRIPTION:
+//    Implements lockedUpdate
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerLock.h"
+
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+
+#include <chrono>
+
+//-----------------------------------------------------------------------------
+// lockedUpdate implementation
+//-----------------------------------------------------------------------------
+llvm::Error lockedUpdate(llvm::StringRef Path,
+	llvm::function_ref<llvm::Error()> Update)
+{
+	llvm::SmallString<256> LockPath(Path);
+	LockPath += ".lock";
+
+	int LockFD;
+	if (std::error_code EC = llvm::sys::fs::openFileForWrite(LockPath,
+		LockFD, llvm::sys::fs::CD_OpenAlways))
+	{
+		return llvm::createStringError(EC, "cannot open '%s': %s",
+			LockPath.c_str(), EC.message().c_str());
+	}
+	auto CloseLock = llvm::make_scope_exit([LockFD]
+	{
+		llvm::sys::Process::SafelyCloseFileDescriptor(LockFD);
+	});
+
+	// Each process holds the lock only for as long as it takes to read and
+	// write the file
+	if (std::error_code EC = llvm::sys::fs::tryLockFile(LockFD,
+		std::chrono::seconds(60)))
+	{
+		return llvm::createStringError(EC, "cannot lock '%s': %s",
+			LockPath.c_str(), EC.message().c_str());
+	}
+	auto Unlock = llvm::make_scope_exit([LockFD]
+	{
+		llvm::sys::fs::unlockFile(LockFD);
+	});
+
+	return Update();
+}
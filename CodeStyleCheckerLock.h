@@ -0,0 +1,28 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerLock.h
+//
+// DESCRIPTION:
+//    Declares lockedUpdate - the read-modify-write of a file shared by the
+//    compiler processes of a parallel build
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_LOCK_H
+#define CLANG_TUTOR_CSC_LOCK_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+//-----------------------------------------------------------------------------
+// File lock
+//-----------------------------------------------------------------------------
+// Runs Update while holding an exclusive lock on Path.lock, waiting for the
+// other processes that hold it. Update is expected to read Path, merge its
+// own records in and replace Path atomically (see llvm::writeToOutput), so
+// that neither a concurrent writer nor a reader sees a partial file.
+llvm::Error lockedUpdate(llvm::StringRef Path,
+	llvm::function_ref<llvm::Error()> Update);
+
+#endif
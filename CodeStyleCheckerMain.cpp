@@ -11,15 +11,78 @@
 //    * ct-code-style-checker input-file.cpp
 //  All TUs (the main file and the #includ-ed header files)
 //    * ct-code-style-checker -main-tu-only=false input-file.cpp
+//  Only per-rule counts, each rule capped at 100 violations per TU
+//    * ct-code-style-checker -summary -max-per-rule=100 input-file.cpp
+//  Fast one-line output for inputs with many violations
+//    * ct-code-style-checker -compact input-file.cpp
+//  Record the current violations, then only report new ones
+//    * ct-code-style-checker -baseline=csc.baseline -write-baseline *.c
+//    * ct-code-style-checker -baseline=csc.baseline *.c
+//  Only the lines changed since the last commit (e.g. in a pre-commit hook)
+//    * ct-code-style-checker -changed-lines=HEAD *.c
+//  Index the misnamed symbols of a project and rename them everywhere
+//    * ct-code-style-checker -index=csc.index -apply-fixes *.c
+//  Many loose files without compile_commands.json, in one process, with
+//  one flag set (the language is picked by extension)
+//    * ct-code-style-checker -batch=submissions/ -compact -- -Wall -Iinclude
+//    * ct-code-style-checker -batch=files.txt -summary --
+//  Submissions straight out of tar/zip archives, nothing is extracted to
+//  disk (the warnings name `archive.zip/dir/file.c`)
+//    * ct-code-style-checker submissions.tar.gz -compact --
+//    * ct-code-style-checker -batch=archives.txt -summary --
+//  Re-check resubmissions without parsing the ones that only changed in
+//  layout or comments
+//    * ct-code-style-checker -cache=csc.cache -compact input-file.c
+//  Memory used per TU and a histogram for the run, to size worker pools
+//    * ct-code-style-checker -mem-report -summary -main-tu-only=false *.cpp
+//  Whether every module has its header and every file includes exactly the
+//  headers it uses, over all the files of a project
+//    * ct-code-style-checker -project -compact src/*.c
+//  The same on 8 threads
+//    * ct-code-style-checker -batch=submissions/ -compact -j 8 --
+//  A progress line every 30 seconds and metrics for the node exporter
+//    * ct-code-style-checker -batch=archives.txt -compact -j 8 -progress=30 '\'
+//        -metrics=/var/lib/node_exporter/csc.prom --
+//  Diagnostics and quick fixes in the editor as the file is edited (the
+//  flags of a document come from -p or after --)
+//    * ct-code-style-checker -lsp -p build
+//    * ct-code-style-checker -lsp -- -Iinclude
+//  Without the in-process clang-format check
+//    * ct-code-style-checker -format-style=none input-file.cpp
 //
 // License: The Unlicense
 //==============================================================================
 #include "CodeStyleChecker.h"
+#include "CodeStyleCheckerArchive.h"
+#include "CodeStyleCheckerServer.h"
 
+#include "clang/Basic/FileManager.h"
+#include "clang/Driver/Options.h"
+#include "clang/Format/Format.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Option/ArgList.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <numeric>
 
 using namespace llvm;
 using namespace clang;
@@ -29,21 +92,492 @@ using namespace clang;
 //===----------------------------------------------------------------------===//
 static llvm::cl::OptionCategory CSCCategory("ct-code-style-checker options");
 
-static cl::opt<bool> MainTuOnly
+static CodeStyleCheckerOptions Opts;
+
+static cl::opt<bool, true> MainTuOnly
 {
 	"main-tu-only",
 	cl::desc("Only run on the main translation unit "
 			 "(e.g. ignore included header files)"),
+	cl::location(Opts.MainTUOnly),
 	cl::init(true),
 	cl::cat(CSCCategory)
 };
 
+static cl::opt<std::string> FormatStyleName
+{
+	"format-style",
+	cl::desc("Style for the in-process clang-format check: 'file' (the "
+			 ".clang-format of the first input), a predefined style name, "
+			 "or 'none' to disable the check"),
+	cl::init("file"),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool, true> Summary
+{
+	"summary",
+	cl::desc("Only count the violations per rule and per file and print "
+			 "the counts instead of the warnings"),
+	cl::location(Opts.Summary),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<unsigned, true> MaxPerRule
+{
+	"max-per-rule",
+	cl::desc("Stop checking a rule after this many violations in a "
+			 "translation unit (0 - no limit)"),
+	cl::location(Opts.MaxPerRule),
+	cl::init(0),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool, true> Compact
+{
+	"compact",
+	cl::desc("Print the warnings as sorted one-line records at the end of "
+			 "each translation unit, without source snippets"),
+	cl::location(Opts.Compact),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool, true> Snippets
+{
+	"snippets",
+	cl::desc("With -compact, also print the source line of every warning"),
+	cl::location(Opts.Snippets),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<std::string> BaselinePath
+{
+	"baseline",
+	cl::desc("File with the fingerprints of known violations, which are "
+			 "not reported"),
+	cl::value_desc("file"),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool, true> WriteBaseline
+{
+	"write-baseline",
+	cl::desc("Regenerate the -baseline file from the current violations "
+			 "instead of reporting them"),
+	cl::location(Opts.WriteBaseline),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static CSCBaseline Baseline;
+
+static cl::opt<std::string> ChangedLinesRange
+{
+	"changed-lines",
+	cl::desc("Only check the lines changed in this git diff range, e.g. "
+			 "HEAD or --cached"),
+	cl::value_desc("git diff range"),
+	cl::cat(CSCCategory)
+};
+
+static CSCChangedLines ChangedLines;
+
+static cl::opt<std::string> IndexPath
+{
+	"index",
+	cl::desc("Symbol index to update with the misnamed symbols and their "
+			 "references (only the records of the checked files change)"),
+	cl::value_desc("file"),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool> ApplyFixes
+{
+	"apply-fixes",
+	cl::desc("After checking, rename every symbol in the -index at all its "
+			 "references in all files"),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static CSCSymbolIndex Index;
+
+static cl::opt<std::string> CachePath
+{
+	"cache",
+	cl::desc("Reuse the results of the AST and preprocessor rules for files "
+			 "whose tokens (ignoring whitespace and comments) are in this "
+			 "cache, and add the others to it"),
+	cl::value_desc("file"),
+	cl::cat(CSCCategory)
+};
+
+static CSCResultCache Cache;
+
+static cl::opt<bool> MemReportEnabled
+{
+	"mem-report",
+	cl::desc("Print the memory used by every TU (AST arena, source buffers, "
+			 "allocations of the rules, peak RSS) and a histogram at the end"),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static CSCMemoryReport MemReport;
+
+static cl::opt<bool> ProjectEnabled
+{
+	"project",
+	cl::desc("After checking, treat all the inputs as one project and check "
+			 "the rules about modules and their headers (R6.1, R6.3 - R6.5)"),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static CSCProject Project;
+
+static cl::opt<unsigned> ProgressInterval
+{
+	"progress",
+	cl::desc("Print the progress, the throughput and the rules that fire "
+			 "the most to stderr every N seconds (0 - never)"),
+	cl::value_desc("N"),
+	cl::init(0),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<std::string> MetricsPath
+{
+	"metrics",
+	cl::desc("Keep the counters of the run in this file, in the Prometheus "
+			 "text format (rewritten every -progress interval, or every 10 "
+			 "seconds)"),
+	cl::value_desc("file"),
+	cl::cat(CSCCategory)
+};
+
+static CSCMetrics Metrics;
+
+static cl::opt<bool> LanguageServerEnabled
+{
+	"lsp",
+	cl::desc("Run as a language server on stdin/stdout: check the documents "
+			 "open in the editor as they change (the inputs are ignored)"),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<bool> LanguageServerLog
+{
+	"lsp-log",
+	cl::desc("With -lsp, log every check and its time to stderr"),
+	cl::init(false),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<std::string> Batch
+{
+	"batch",
+	cl::desc("Check every .c/.cpp file under this directory, or every file "
+			 "listed in this file (one per line), in one process with the "
+			 "flags after --"),
+	cl::value_desc("directory or file list"),
+	cl::cat(CSCCategory)
+};
+
+static cl::opt<unsigned> Jobs
+{
+	"j",
+	cl::desc("Check the inputs on this many threads (the output is the same, "
+			 "byte for byte, as with -j 1)"),
+	cl::value_desc("N"),
+	cl::init(1),
+	cl::cat(CSCCategory)
+};
+
+// Loaded once in main() and shared by every TU
+static std::unique_ptr<format::FormatStyle> Style;
+
+//===----------------------------------------------------------------------===//
+// Allocation counting
+//===----------------------------------------------------------------------===//
+// The replaceable global allocation functions, so that -mem-report can count
+// what the rules allocate (see CSCRuleAllocScope). Outside of rule code this
+// is one thread-local load on top of malloc. This file is not part of the
+// plugin: a .so must not replace the allocator of the compiler loading it.
+void *operator new(size_t Size)
+{
+	if (CSCAllocStats *Stats = CSCRuleAllocs)
+	{
+		++Stats->Count;
+		Stats->Bytes += Size;
+	}
+
+	void *Ptr = std::malloc(Size ? Size : 1);
+	if (!Ptr)
+	{
+		report_bad_alloc_error("operator new failed");
+	}
+	return Ptr;
+}
+
+void operator delete(void *Ptr) noexcept
+{
+	std::free(Ptr);
+}
+
+void operator delete(void *Ptr, size_t) noexcept
+{
+	std::free(Ptr);
+}
+
+//===----------------------------------------------------------------------===//
+// Batch mode
+//===----------------------------------------------------------------------===//
+static bool isCSource(StringRef Path)
+{
+	return sys::path::extension(Path) == ".c";
+}
+
+static bool isSource(StringRef Path)
+{
+	StringRef Ext = sys::path::extension(Path);
+	return Ext == ".c" || Ext == ".cc" || Ext == ".cpp" || Ext == ".cxx";
+}
+
+// Appends the sources named by -batch to Sources
+static Error collectBatchSources(StringRef Path,
+	std::vector<std::string> &Sources)
+{
+	if (sys::fs::is_directory(Path))
+	{
+		std::vector<std::string> Found;
+		std::error_code EC;
+		for (sys::fs::recursive_directory_iterator It(Path, EC), End;
+			It != End && !EC; It.increment(EC))
+		{
+			if (isSource(It->path()))
+			{
+				Found.push_back(It->path());
+			}
+		}
+		if (EC)
+		{
+			return createStringError(EC, "cannot read directory '%s': %s",
+				Path.str().c_str(), EC.message().c_str());
+		}
+
+		// Directory order is arbitrary, the output should not be
+		llvm::sort(Found);
+		Sources.insert(Sources.end(), Found.begin(), Found.end());
+		return Error::success();
+	}
+
+	ErrorOr<std::unique_ptr<MemoryBuffer>> List =
+		MemoryBuffer::getFile(Path, /*IsText=*/true);
+	if (std::error_code EC = List.getError())
+	{
+		return createStringError(EC, "cannot read file list '%s': %s",
+			Path.str().c_str(), EC.message().c_str());
+	}
+
+	SmallVector<StringRef, 64> Lines;
+	(*List)->getBuffer().split(Lines, '\n');
+	for (StringRef Line : Lines)
+	{
+		Line = Line.trim();
+		if (!Line.empty() && !Line.starts_with("#"))
+		{
+			Sources.push_back(Line.str());
+		}
+	}
+
+	return Error::success();
+}
+
+// All batch inputs share one flag set, so the language can't come from it:
+// -x is set by the extension of each file and a -std= meant for the other
+// language is dropped
+static tooling::ArgumentsAdjuster getBatchLanguageAdjuster()
+{
+	return [](const tooling::CommandLineArguments &Args, StringRef File) {
+		bool IsC = isCSource(File);
+
+		tooling::CommandLineArguments Result;
+		for (const std::string &Arg : Args)
+		{
+			StringRef ArgRef(Arg);
+			if (ArgRef.starts_with("-std=") && ArgRef.contains("++") == IsC)
+			{
+				continue;
+			}
+			Result.push_back(Arg);
+		}
+
+		// Right after the program name, before the input
+		Result.insert(Result.begin() + (Result.empty() ? 0 : 1),
+			IsC ? "-xc" : "-xc++");
+		return Result;
+	};
+}
+
+//===----------------------------------------------------------------------===//
+// Archives
+//===----------------------------------------------------------------------===//
+// Replaces every archive in Sources by the sources inside it. Its members are
+// moved into FS under the archive's own absolute path, which is appended to
+// Roots.
+static Error mountArchives(std::vector<std::string> &Sources,
+	vfs::InMemoryFileSystem &FS, std::vector<std::string> &Roots)
+{
+	std::vector<std::string> Expanded;
+	for (std::string &Source : Sources)
+	{
+		if (!CSCArchive::isArchive(Source))
+		{
+			Expanded.push_back(std::move(Source));
+			continue;
+		}
+
+		CSCArchive Archive;
+		if (auto E = Archive.load(Source))
+		{
+			return E;
+		}
+
+		SmallString<256> Root(Source);
+		if (std::error_code EC = sys::fs::make_absolute(Root))
+		{
+			return createStringError(EC, "cannot resolve '%s': %s",
+				Source.c_str(), EC.message().c_str());
+		}
+		sys::path::remove_dots(Root, /*remove_dot_dot=*/true);
+
+		std::vector<std::string> Found;
+		for (std::string &Path : Archive.mount(FS, Root))
+		{
+			if (isSource(Path))
+			{
+				Found.push_back(std::move(Path));
+			}
+		}
+
+		// Same order as for a -batch directory
+		llvm::sort(Found);
+		Expanded.insert(Expanded.end(), Found.begin(), Found.end());
+		Roots.push_back(Root.str().str());
+	}
+
+	Sources = std::move(Expanded);
+	return Error::success();
+}
+
+// Archive members are compiled from the directory that holds the archive, by
+// their path relative to it, so the diagnostics (and the baseline
+// fingerprints) name `archive.tar/dir/file.c` rather than an absolute path
+// that does not exist on disk. Everything else comes from the wrapped
+// database.
+class ArchiveCompilationDatabase : public tooling::CompilationDatabase
+{
+public:
+	ArchiveCompilationDatabase(
+		const tooling::CompilationDatabase &Base,
+		std::vector<std::string> Roots)
+		: Base(Base), Roots(std::move(Roots)) {}
+
+	std::vector<tooling::CompileCommand> getCompileCommands(
+		StringRef FilePath) const override
+	{
+		std::vector<tooling::CompileCommand> Commands =
+			Base.getCompileCommands(FilePath);
+
+		for (const std::string &Root : Roots)
+		{
+			if (!FilePath.starts_with(Root) || FilePath.size() == Root.size() ||
+				!sys::path::is_separator(FilePath[Root.size()]))
+			{
+				continue;
+			}
+
+			StringRef Dir = sys::path::parent_path(Root);
+			std::string Relative =
+				FilePath.drop_front(Dir.size()).ltrim("/\\").str();
+
+			// A compile_commands.json knows nothing about the members
+			if (Commands.empty())
+			{
+				Commands.emplace_back(Dir, FilePath,
+					std::vector<std::string>{"clang-tool", FilePath.str()}, "");
+			}
+
+			for (tooling::CompileCommand &Command : Commands)
+			{
+				Command.Directory = Dir.str();
+				Command.Filename = Relative;
+				llvm::replace(Command.CommandLine, FilePath.str(), Relative);
+			}
+			break;
+		}
+
+		return Commands;
+	}
+
+	std::vector<std::string> getAllFiles() const override
+	{
+		return Base.getAllFiles();
+	}
+
+	std::vector<tooling::CompileCommand> getAllCompileCommands() const override
+	{
+		return Base.getAllCompileCommands();
+	}
+
+private:
+	const tooling::CompilationDatabase &Base;
+	std::vector<std::string> Roots;
+};
+
+//===----------------------------------------------------------------------===//
+// Result cache
+//===----------------------------------------------------------------------===//
+// Everything besides the main file that changes what the cached rules find:
+// the target, the language, the include paths (R5.3) and macros, and the
+// options that change how violations are reported
+static std::string getCacheConfig(const CompilerInstance &CI,
+	const CodeStyleCheckerOptions &Opts)
+{
+	std::string Config;
+	raw_string_ostream OS(Config);
+
+	OS << CI.getTargetOpts().Triple << '\0'
+		<< static_cast<unsigned>(CI.getLangOpts().LangStd) << '\0';
+	for (const auto &Entry : CI.getHeaderSearchOpts().UserEntries)
+	{
+		OS << "-I" << Entry.Path << '\0';
+	}
+	for (const auto &Macro : CI.getPreprocessorOpts().Macros)
+	{
+		OS << (Macro.second ? "-U" : "-D") << Macro.first << '\0';
+	}
+	OS << Opts.Summary << Opts.MaxPerRule << '\0';
+	// Entries store rule numbers: a build with other rules can't use them
+	OS << NumCSCRules << '\0' << CSCResultCache::CachedRules;
+
+	return Config;
+}
+
 //===----------------------------------------------------------------------===//
 // PluginASTAction
 //===----------------------------------------------------------------------===//
 class CSCPluginAction : public PluginASTAction
 {
 public:
+	explicit CSCPluginAction(const CodeStyleCheckerOptions &Opts)
+		: Opts(Opts) {}
+
 	bool ParseArgs(
 		const CompilerInstance &CI,
 		const std::vector<std::string> &args) override 
@@ -55,18 +589,314 @@ public:
 		CompilerInstance &CI,
 		StringRef file) override 
 	{
-		return std::make_unique<CodeStyleCheckerASTConsumer>(
-			&CI.getASTContext(), MainTuOnly, CI.getSourceManager());
+		auto Consumer = std::make_unique<CodeStyleCheckerASTConsumer>(
+			&CI.getASTContext(), Opts, CI.getSourceManager());
+		CI.getPreprocessor().addPPCallbacks(
+			Consumer->create_pp_callbacks(CI.getPreprocessor()));
+
+		CSCConsumer = Consumer.get();
+		return Consumer;
+	}
+
+protected:
+	void ExecuteAction() override
+	{
+		// A cache hit has already been reported - nothing to parse
+		if (CSCConsumer && CSCConsumer->replay_cached(
+			getCacheConfig(getCompilerInstance(), Opts)))
+		{
+			return;
+		}
+
+		PluginASTAction::ExecuteAction();
+	}
+
+private:
+	const CodeStyleCheckerOptions &Opts;
+	// Owned by the CompilerInstance
+	CodeStyleCheckerASTConsumer *CSCConsumer = nullptr;
+};
+
+class CSCActionFactory : public tooling::FrontendActionFactory
+{
+public:
+	explicit CSCActionFactory(const CodeStyleCheckerOptions &Opts)
+		: Opts(Opts) {}
+
+	std::unique_ptr<FrontendAction> create() override
+	{
+		return std::make_unique<CSCPluginAction>(Opts);
+	}
+
+private:
+	const CodeStyleCheckerOptions &Opts;
+};
+
+//===----------------------------------------------------------------------===//
+// Parallel mode
+//===----------------------------------------------------------------------===//
+// A view of a shared file system with a working directory of its own.
+// ClangTool sets the working directory of its file system for every TU, the
+// -j workers must not move each other's (nor the process's).
+class WorkerFileSystem : public vfs::ProxyFileSystem
+{
+public:
+	explicit WorkerFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> FS)
+		: ProxyFileSystem(std::move(FS))
+	{
+		SmallString<256> CWD;
+		if (!sys::fs::current_path(CWD))
+		{
+			WorkingDir = CWD.str().str();
+		}
+	}
+
+	ErrorOr<vfs::Status> status(const Twine &Path) override
+	{
+		return ProxyFileSystem::status(absolute(Path));
+	}
+
+	ErrorOr<std::unique_ptr<vfs::File>>
+	openFileForRead(const Twine &Path) override
+	{
+		return ProxyFileSystem::openFileForRead(absolute(Path));
+	}
+
+	vfs::directory_iterator dir_begin(const Twine &Dir,
+		std::error_code &EC) override
+	{
+		return ProxyFileSystem::dir_begin(absolute(Dir), EC);
+	}
+
+	std::error_code getRealPath(const Twine &Path,
+		SmallVectorImpl<char> &Output) const override
+	{
+		return ProxyFileSystem::getRealPath(absolute(Path), Output);
+	}
+
+	ErrorOr<std::string> getCurrentWorkingDirectory() const override
+	{
+		return WorkingDir;
+	}
+
+	std::error_code setCurrentWorkingDirectory(const Twine &Path) override
+	{
+		WorkingDir = absolute(Path).str().str();
+		return std::error_code();
+	}
+
+private:
+	std::string WorkingDir;
+
+	SmallString<256> absolute(const Twine &Path) const
+	{
+		SmallString<256> Result;
+		Path.toVector(Result);
+		if (!WorkingDir.empty())
+		{
+			sys::fs::make_absolute(WorkingDir, Result);
+		}
+		return Result;
 	}
 };
 
+// How many TUs a worker may run ahead of the output, per worker
+static constexpr size_t ReorderWindowPerWorker = 4;
+
+// The diagnostic options of a compile command (-fno-color-diagnostics,
+// -fno-diagnostics-show-option, ...), parsed the way ClangTool parses them
+// for the printer it creates itself - that one writes to llvm::errs()
+static IntrusiveRefCntPtr<DiagnosticOptions> getDiagOpts(
+	const std::vector<std::string> &CommandLine)
+{
+	SmallVector<const char *, 64> Argv;
+	for (const std::string &Arg : drop_begin(CommandLine))
+	{
+		Argv.push_back(Arg.c_str());
+	}
+
+	unsigned MissingArgIndex, MissingArgCount;
+	opt::InputArgList Args = driver::getDriverOptTable().ParseArgs(Argv,
+		MissingArgIndex, MissingArgCount);
+
+	auto DiagOpts = makeIntrusiveRefCnt<DiagnosticOptions>();
+	ParseDiagnosticArgs(*DiagOpts, Args);
+	return DiagOpts;
+}
+
+// Combines the results of two ClangTool runs the way ClangTool::run()
+// combines those of its TUs: 1 if a TU failed, else 2 if one was skipped
+static int combineResults(int Result, int Other)
+{
+	if (Result == 1 || Other == 1)
+	{
+		return 1;
+	}
+	return std::max(Result, Other);
+}
+
+// Runs a ClangTool over Source alone. ClangTool writes "Skipping" and "Error
+// while processing" lines to stderr itself, past the output buffer of the TU:
+// the same lines go to Errs instead, in the place a serial run has them. So
+// do the diagnostics, printed with the options of the TU's compile command.
+static int runOne(
+	const tooling::CompilationDatabase &Compilations,
+	const std::string &Source,
+	std::shared_ptr<PCHContainerOperations> PCHOps,
+	IntrusiveRefCntPtr<vfs::FileSystem> FS,
+	IntrusiveRefCntPtr<FileManager> Files,
+	CSCActionFactory &Factory,
+	raw_ostream &Errs)
+{
+	Expected<std::string> File = tooling::getAbsolutePath(*FS, Source);
+	if (!File)
+	{
+		Errs << "Skipping " << Source
+			<< ". Error while getting an absolute path: "
+			<< toString(File.takeError()) << "\n";
+		return 0;
+	}
+	std::vector<tooling::CompileCommand> Commands =
+		Compilations.getCompileCommands(*File);
+	if (Commands.empty())
+	{
+		Errs << "Skipping " << *File << ". Compile command not found.\n";
+		return 2;
+	}
+
+	IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts =
+		getDiagOpts(Commands.front().CommandLine);
+	TextDiagnosticPrinter Printer(Errs, DiagOpts.get());
+
+	tooling::ClangTool Tool(Compilations, Source, std::move(PCHOps),
+		std::move(FS), std::move(Files));
+	Tool.setDiagnosticConsumer(&Printer);
+	Tool.setPrintErrorMessage(false);
+	if (!Batch.empty())
+	{
+		Tool.appendArgumentsAdjuster(getBatchLanguageAdjuster());
+	}
+
+	int Result = Tool.run(&Factory);
+	if (Result == 1)
+	{
+		Errs << "Error while processing " << *File << ".\n";
+	}
+	return Result;
+}
+
+// Checks Sources on NumWorkers threads. The workers take the inputs in order,
+// one at a time, and run a ClangTool per TU over a FileManager of their own -
+// shared by the TUs of the worker. The stderr/stdout output of a TU is
+// buffered and written in input order, exactly as a serial run would write
+// it: as soon as the TUs before it are written. A worker does not start a TU
+// more than the reorder window ahead of the first TU not written yet, so at
+// most that many outputs are held at a time.
+// The stores shared by the TUs (baseline, index, cache, memory report) lock
+// internally.
+static int runParallel(
+	const tooling::CompilationDatabase &Compilations,
+	const std::vector<std::string> &Sources,
+	IntrusiveRefCntPtr<vfs::FileSystem> ArchiveFS,
+	unsigned NumWorkers)
+{
+	NumWorkers = std::min<size_t>(NumWorkers, Sources.size());
+
+	// The output of TU I waits in slot I % Window until it is its turn
+	struct TUOutput
+	{
+		std::string Outs;
+		std::string Errs;
+		bool Done = false;
+	};
+	const size_t Window = NumWorkers * ReorderWindowPerWorker;
+	std::vector<TUOutput> Slots(Window);
+	size_t NextToWrite = 0;
+	std::mutex OutputLock;
+	std::condition_variable Written;
+
+	std::atomic<size_t> NextToStart{0};
+	std::vector<int> Results(NumWorkers, 0);
+
+	ThreadPool Pool(hardware_concurrency(NumWorkers));
+	for (unsigned Worker = 0; Worker < NumWorkers; ++Worker)
+	{
+		Pool.async([&, Worker] {
+			std::string ErrsBuffer;
+			std::string OutsBuffer;
+			raw_string_ostream WorkerErrs(ErrsBuffer);
+			raw_string_ostream WorkerOuts(OutsBuffer);
+
+			CodeStyleCheckerOptions WorkerOpts = Opts;
+			WorkerOpts.Errs = &WorkerErrs;
+			WorkerOpts.Outs = &WorkerOuts;
+			if (Opts.Counters)
+			{
+				WorkerOpts.Counters = &Metrics.worker(Worker);
+			}
+
+			auto FS = makeIntrusiveRefCnt<vfs::OverlayFileSystem>(
+				vfs::createPhysicalFileSystem());
+			FS->pushOverlay(makeIntrusiveRefCnt<WorkerFileSystem>(ArchiveFS));
+			auto Files = makeIntrusiveRefCnt<FileManager>(FileSystemOptions(),
+				FS);
+			auto PCHOps = std::make_shared<PCHContainerOperations>();
+
+			CSCActionFactory Factory(WorkerOpts);
+
+			for (size_t I; (I = NextToStart++) < Sources.size();)
+			{
+				{
+					std::unique_lock<std::mutex> Guard(OutputLock);
+					Written.wait(Guard,
+						[&] { return I < NextToWrite + Window; });
+				}
+
+				Results[Worker] = combineResults(Results[Worker],
+					runOne(Compilations, Sources[I], PCHOps, FS, Files,
+						Factory, WorkerErrs));
+
+				std::lock_guard<std::mutex> Guard(OutputLock);
+				TUOutput &Slot = Slots[I % Window];
+				Slot.Outs = std::move(WorkerOuts.str());
+				Slot.Errs = std::move(WorkerErrs.str());
+				Slot.Done = true;
+				OutsBuffer.clear();
+				ErrsBuffer.clear();
+
+				// Everything up to the first TU still running
+				size_t Before = NextToWrite;
+				while (NextToWrite < Sources.size() &&
+					Slots[NextToWrite % Window].Done)
+				{
+					TUOutput &Next = Slots[NextToWrite % Window];
+					outs() << Next.Outs;
+					errs() << Next.Errs;
+					Next = TUOutput();
+					++NextToWrite;
+				}
+				if (NextToWrite != Before)
+				{
+					outs().flush();
+					Written.notify_all();
+				}
+			}
+		});
+	}
+	Pool.wait();
+
+	return std::accumulate(Results.begin(), Results.end(), 0,
+		combineResults);
+}
+
 //===----------------------------------------------------------------------===//
 // Main driver code.
 //===----------------------------------------------------------------------===//
 int main(int Argc, const char **Argv)
 {
 	Expected<tooling::CommonOptionsParser> eOptParser =
-		clang::tooling::CommonOptionsParser::create(Argc, Argv, CSCCategory);
+		clang::tooling::CommonOptionsParser::create(Argc, Argv, CSCCategory,
+			cl::ZeroOrMore);
 
 	if (auto E = eOptParser.takeError())
 	{
@@ -75,10 +905,245 @@ int main(int Argc, const char **Argv)
 		return EXIT_FAILURE;
 	}
 
-	clang::tooling::ClangTool Tool(
+	std::vector<std::string> Sources = eOptParser->getSourcePathList();
+
+	if (!Batch.empty())
+	{
+		if (auto E = collectBatchSources(Batch, Sources))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The real file system, with the archive members on top
+	auto ArchiveFS = makeIntrusiveRefCnt<vfs::InMemoryFileSystem>();
+	auto FS = makeIntrusiveRefCnt<vfs::OverlayFileSystem>(
+		vfs::getRealFileSystem());
+	FS->pushOverlay(ArchiveFS);
+
+	std::vector<std::string> ArchiveRoots;
+	if (auto E = mountArchives(Sources, *ArchiveFS, ArchiveRoots))
+	{
+		errs() << toString(std::move(E)) << '\n';
+		return EXIT_FAILURE;
+	}
+
+	// The editor sends the documents to check
+	if (LanguageServerEnabled)
+	{
+		return runLanguageServer(eOptParser->getCompilations(), Opts,
+			FormatStyleName, FS, LanguageServerLog);
+	}
+
+	if (Sources.empty())
+	{
+		errs() << "No input files (give them on the command line or with "
+			"-batch)\n";
+		return EXIT_FAILURE;
+	}
+
+	if (ChangedLinesRange.getNumOccurrences())
+	{
+		Expected<CSCChangedLines> Lines =
+			CSCChangedLines::fromGitDiff(ChangedLinesRange);
+
+		if (auto E = Lines.takeError())
+		{
+			errs() << "Problem reading the changed lines "
+				<< toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+
+		ChangedLines = std::move(*Lines);
+		Opts.ChangedLines = &ChangedLines;
+
+		// Files without changes are not even parsed
+		llvm::erase_if(Sources, [](const std::string &Source) {
+			return !ChangedLines.lookup(Source);
+		});
+		if (Sources.empty())
+		{
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (FormatStyleName != "none" && !Sources.empty())
+	{
+		Expected<format::FormatStyle> StyleOrErr =
+			format::getStyle(FormatStyleName, Sources.front(), "none", "",
+				FS.get());
+
+		if (auto E = StyleOrErr.takeError())
+		{
+			errs() << "Problem loading the format style "
+				<< toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+
+		Style = std::make_unique<format::FormatStyle>(std::move(*StyleOrErr));
+		Opts.Style = Style.get();
+	}
+
+	if (!BaselinePath.empty())
+	{
+		if (!WriteBaseline)
+		{
+			if (auto E = Baseline.load(BaselinePath))
+			{
+				errs() << toString(std::move(E)) << '\n';
+				return EXIT_FAILURE;
+			}
+		}
+		Opts.Baseline = &Baseline;
+	}
+	else if (WriteBaseline)
+	{
+		errs() << "-write-baseline requires -baseline=<file>\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!IndexPath.empty())
+	{
+		if (auto E = Index.load(IndexPath))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+		Opts.Index = &Index;
+	}
+	else if (ApplyFixes)
+	{
+		errs() << "-apply-fixes requires -index=<file>\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!CachePath.empty())
+	{
+		if (auto E = Cache.load(CachePath))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+		Opts.Cache = &Cache;
+	}
+
+	if (MemReportEnabled)
+	{
+		Opts.MemReport = &MemReport;
+	}
+
+	if (ProjectEnabled)
+	{
+		Opts.Project = &Project;
+	}
+
+	if (ApplyFixes && !ArchiveRoots.empty())
+	{
+		errs() << "-apply-fixes cannot rewrite the files inside an archive\n";
+		return EXIT_FAILURE;
+	}
+
+	// One process for all the inputs: LLVM is initialized and the options
+	// parsed once, and every TU reuses the tool's FileManager, so headers
+	// shared by the inputs (and the stats of their search paths) are cached
+	// after the first TU.
+	ArchiveCompilationDatabase Compilations(
 		eOptParser->getCompilations(),
-		eOptParser->getSourcePathList());
+		std::move(ArchiveRoots));
+
+	if (ProgressInterval || !MetricsPath.empty())
+	{
+		size_t NumWorkers =
+			Jobs > 1 ? std::min<size_t>(Jobs, Sources.size()) : 1;
+		Metrics.reset(NumWorkers, Sources.size());
+		Opts.Counters = &Metrics.worker(0);
+		Metrics.start(std::chrono::seconds(
+			ProgressInterval ? ProgressInterval : 10),
+			ProgressInterval != 0, MetricsPath);
+	}
+
+	int Result = 0;
+	if (Jobs > 1 && Sources.size() > 1)
+	{
+		Result = runParallel(Compilations, Sources, ArchiveFS, Jobs);
+	}
+	else
+	{
+		clang::tooling::ClangTool Tool(
+			Compilations,
+			Sources,
+			std::make_shared<PCHContainerOperations>(),
+			FS);
+
+		if (!Batch.empty())
+		{
+			Tool.appendArgumentsAdjuster(getBatchLanguageAdjuster());
+		}
+
+		CSCActionFactory Factory(Opts);
+		Result = Tool.run(&Factory);
+	}
+
+	// The final numbers
+	if (auto E = Metrics.stop())
+	{
+		errs() << toString(std::move(E)) << '\n';
+		return EXIT_FAILURE;
+	}
+
+	// Every TU has contributed its facts by now - in a -j run too
+	if (Opts.Project)
+	{
+		Project.check(*FS, Opts.Summary ? Opts.report_stream()
+			: Opts.diag_stream(), Opts.Summary);
+	}
+
+	if (Opts.MemReport)
+	{
+		MemReport.print_histogram(outs());
+	}
+
+	if (Opts.Cache)
+	{
+		if (auto E = Cache.write(CachePath))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (WriteBaseline)
+	{
+		if (auto E = Baseline.write(BaselinePath))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (Opts.Index)
+	{
+		if (ApplyFixes)
+		{
+			Expected<unsigned> Rewritten = Index.apply_fixes();
+			if (auto E = Rewritten.takeError())
+			{
+				errs() << toString(std::move(E)) << '\n';
+				return EXIT_FAILURE;
+			}
+			errs() << "renamed symbols in " << *Rewritten << " file(s)\n";
+
+			// All offsets are stale now
+			Index.clear();
+		}
+
+		if (auto E = Index.write(IndexPath))
+		{
+			errs() << toString(std::move(E)) << '\n';
+			return EXIT_FAILURE;
+		}
+	}
 
-	return Tool.run(
-		clang::tooling::newFrontendActionFactory<CSCPluginAction>().get());
+	return Result;
 }
\ No newline at end of file
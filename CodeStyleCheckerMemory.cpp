@@ -0,0 +1,130 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerMemory.cpp
+//
+// DESCRIPTION:
+//    Implements the memory instrumentation of the CodeStyleChecker
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerMemory.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <map>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+thread_local CSCAllocStats *CSCRuleAllocs = nullptr;
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+static void printMiB(llvm::raw_ostream &OS, uint64_t Bytes)
+{
+	OS << llvm::format("%.1f MiB", Bytes / (1024.0 * 1024.0));
+}
+
+//-----------------------------------------------------------------------------
+// Process
+//-----------------------------------------------------------------------------
+uint64_t getPeakRSS()
+{
+#ifndef _WIN32
+	struct rusage Usage;
+	if (getrusage(RUSAGE_SELF, &Usage) != 0)
+	{
+		return 0;
+	}
+#ifdef __APPLE__
+	return Usage.ru_maxrss;
+#else
+	// Linux and the BSDs report kilobytes
+	return static_cast<uint64_t>(Usage.ru_maxrss) * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// CSCMemoryReport implementation
+//-----------------------------------------------------------------------------
+void CSCMemoryReport::add(TU T, llvm::raw_ostream &OS)
+{
+	OS << T.File << ": mem ast=" << T.ASTBytes << " sources=" << T.SourceBytes
+		<< " rule-allocs=" << T.RuleAllocs.Count << " rule-bytes="
+		<< T.RuleAllocs.Bytes << " peak-rss=" << T.PeakRSS << "\n";
+
+	std::lock_guard<std::mutex> Guard(Lock);
+	TUs.push_back(std::move(T));
+}
+
+void CSCMemoryReport::print_histogram(llvm::raw_ostream &OS) const
+{
+	if (TUs.empty())
+	{
+		return;
+	}
+
+	// Bucket N holds [2^N, 2^(N+1)) bytes, all under 2 MiB share the first
+	constexpr unsigned MinBucket = 20;
+	std::map<unsigned, unsigned> Buckets;
+	for (const TU &T : TUs)
+	{
+		uint64_t Bytes = T.ASTBytes + T.SourceBytes + T.RuleAllocs.Bytes;
+		unsigned Bucket = llvm::Log2_64(std::max<uint64_t>(Bytes, 1));
+		++Buckets[std::max(MinBucket, Bucket)];
+	}
+
+	unsigned Widest = 0;
+	for (const auto &Bucket : Buckets)
+	{
+		Widest = std::max(Widest, Bucket.second);
+	}
+
+	OS << "memory per TU (AST + sources + rule allocations), " << TUs.size()
+		<< " TU(s):\n";
+	for (const auto &Bucket : Buckets)
+	{
+		OS << "  ";
+		if (Bucket.first == MinBucket)
+		{
+			OS << llvm::format("%21s", "< 2 MiB");
+		}
+		else
+		{
+			OS << llvm::format("[%6llu MiB, %6llu MiB)",
+				1ULL << (Bucket.first - MinBucket),
+				1ULL << (Bucket.first - MinBucket + 1));
+		}
+		OS << llvm::format(" %6u ", Bucket.second)
+			<< std::string((Bucket.second * 40 + Widest - 1) / Widest, '#')
+			<< "\n";
+	}
+
+	// RSS only grows: the TU that grew it the most is the one that sizes a
+	// worker
+	uint64_t Previous = 0;
+	uint64_t MaxGrowth = 0;
+	const TU *Sizing = &TUs.front();
+	for (const TU &T : TUs)
+	{
+		if (T.PeakRSS > Previous && T.PeakRSS - Previous > MaxGrowth)
+		{
+			MaxGrowth = T.PeakRSS - Previous;
+			Sizing = &T;
+		}
+		Previous = std::max(Previous, T.PeakRSS);
+	}
+
+	OS << "peak RSS: ";
+	printMiB(OS, Previous);
+	OS << ", largest growth: +";
+	printMiB(OS, MaxGrowth);
+	OS << " (" << Sizing->File << ")\n";
+}
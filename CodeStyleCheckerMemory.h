@@ -0,0 +1,114 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerMemory.h
+//
+// DESCRIPTION:
+//    Declares the memory instrumentation of the CodeStyleChecker: counters for
+//    the heap allocations made by the rules and CSCMemoryReport, the per-TU
+//    memory records of a run (-mem-report)
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_MEMORY_H
+#define CLANG_TUTOR_CSC_MEMORY_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Rule allocations
+//-----------------------------------------------------------------------------
+struct CSCAllocStats
+{
+	uint64_t Count = 0;
+	uint64_t Bytes = 0;
+};
+
+// Where operator new counts the allocations of this thread (nullptr - not in
+// rule code). Only the standalone tool replaces operator new, loaded as a
+// plugin the counters stay at 0.
+extern thread_local CSCAllocStats *CSCRuleAllocs;
+
+// Counts the allocations made on this thread into Stats while alive
+class CSCRuleAllocScope
+{
+public:
+	explicit CSCRuleAllocScope(CSCAllocStats &Stats)
+		: Saved(CSCRuleAllocs)
+	{
+		CSCRuleAllocs = &Stats;
+	}
+	~CSCRuleAllocScope() { CSCRuleAllocs = Saved; }
+
+	CSCRuleAllocScope(const CSCRuleAllocScope &) = delete;
+	CSCRuleAllocScope &operator=(const CSCRuleAllocScope &) = delete;
+
+private:
+	CSCAllocStats *Saved;
+};
+
+// Stops the counting of the enclosing CSCRuleAllocScope while alive: the
+// clang code the rules call into (the CFG builder, clang-format, the
+// rendering of a diagnostic) is not rule code
+class CSCRuleAllocPause
+{
+public:
+	CSCRuleAllocPause()
+		: Saved(CSCRuleAllocs)
+	{
+		CSCRuleAllocs = nullptr;
+	}
+	~CSCRuleAllocPause() { CSCRuleAllocs = Saved; }
+
+	CSCRuleAllocPause(const CSCRuleAllocPause &) = delete;
+	CSCRuleAllocPause &operator=(const CSCRuleAllocPause &) = delete;
+
+private:
+	CSCAllocStats *Saved;
+};
+
+// Peak resident set size of the process so far, in bytes (0 - unknown)
+uint64_t getPeakRSS();
+
+//-----------------------------------------------------------------------------
+// Memory report
+//-----------------------------------------------------------------------------
+// One record per TU, printed when the TU is done:
+//
+//    <main file>: mem ast=<bytes> sources=<bytes> rule-allocs=<count>
+//        rule-bytes=<bytes> peak-rss=<bytes>
+//
+// and, at the end of the run, a histogram of the per-TU footprint (AST arena
+// + source buffers + rule allocations) in power-of-two buckets together with
+// the TU after which the process peak RSS grew the most. That is the TU that
+// sizes a worker.
+class CSCMemoryReport
+{
+public:
+	struct TU
+	{
+		std::string File;
+		uint64_t ASTBytes = 0;		// ASTContext arena and side tables
+		uint64_t SourceBytes = 0;	// SourceManager buffers, malloc + mmap
+		// Of the rule predicates and the visitor's bookkeeping only
+		CSCAllocStats RuleAllocs;
+		uint64_t PeakRSS = 0;
+	};
+
+	// Prints the record of T and keeps it for the histogram. Safe to call
+	// from several threads.
+	void add(TU T, llvm::raw_ostream &OS);
+
+	void print_histogram(llvm::raw_ostream &OS) const;
+
+private:
+	std::vector<TU> TUs;
+	std::mutex Lock;
+};
+
+#endif
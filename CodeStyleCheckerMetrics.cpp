@@ -0,0 +1,226 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerMetrics.cpp
+//
+// DESCRIPTION:
+//    Implements CSCMetrics
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerMetrics.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <numeric>
+
+static const char *const PhaseNames[NumCSCPhases] = {
+	"parse",
+	"check",
+	"report",
+};
+
+static double seconds(uint64_t Nanos)
+{
+	return Nanos / 1e9;
+}
+
+//-----------------------------------------------------------------------------
+// CSCMetrics implementation
+//-----------------------------------------------------------------------------
+void CSCMetrics::reset(unsigned Count, uint64_t TUs)
+{
+	Workers = std::make_unique<CSCWorkerCounters[]>(Count);
+	NumWorkers = Count;
+	NumTUs = TUs;
+	Started = std::chrono::steady_clock::now();
+}
+
+CSCMetrics::Snapshot CSCMetrics::snapshot() const
+{
+	Snapshot S;
+
+	for (unsigned W = 0; W < NumWorkers; ++W)
+	{
+		const CSCWorkerCounters &C = Workers[W];
+		S.TUs += C.TUs.load(std::memory_order_relaxed);
+		S.Bytes += C.Bytes.load(std::memory_order_relaxed);
+		for (unsigned I = 0; I < NumCSCRules; ++I)
+		{
+			S.Violations[I] += C.Violations[I].load(std::memory_order_relaxed);
+		}
+		for (unsigned I = 0; I < NumCSCPhases; ++I)
+		{
+			S.PhaseNanos[I] += C.PhaseNanos[I].load(std::memory_order_relaxed);
+		}
+	}
+
+	return S;
+}
+
+void CSCMetrics::start(std::chrono::seconds Interval, bool WithProgress,
+	llvm::StringRef MetricsPath)
+{
+	Progress = WithProgress;
+	Path = MetricsPath.str();
+	Running = true;
+
+	Reporter = std::thread([this, Interval] {
+		std::unique_lock<std::mutex> Guard(Lock);
+		while (!Wakeup.wait_for(Guard, Interval, [this] { return Stopping; }))
+		{
+			if (llvm::Error E = report())
+			{
+				llvm::errs() << "csc: " << toString(std::move(E)) << '\n';
+			}
+		}
+	});
+}
+
+llvm::Error CSCMetrics::stop()
+{
+	if (!Running)
+	{
+		return llvm::Error::success();
+	}
+
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+		Stopping = true;
+	}
+	Wakeup.notify_one();
+	Reporter.join();
+	Running = false;
+
+	// Everything is counted now
+	return report();
+}
+
+llvm::Error CSCMetrics::report()
+{
+	Snapshot S = snapshot();
+
+	if (Progress)
+	{
+		// One write, so that the line never interleaves with the output of
+		// a worker
+		std::string Line;
+		llvm::raw_string_ostream OS(Line);
+		print_progress(S, OS);
+		llvm::errs() << OS.str();
+	}
+
+	return Path.empty() ? llvm::Error::success() : write_prometheus(S, Path);
+}
+
+void CSCMetrics::print_progress(const Snapshot &S, llvm::raw_ostream &OS) const
+{
+	double Elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - Started).count();
+	double MB = S.Bytes / 1e6;
+
+	OS << "csc: " << S.TUs << "/" << NumTUs << " TUs";
+	if (NumTUs)
+	{
+		OS << llvm::format(" (%.1f%%)", 100.0 * S.TUs / NumTUs);
+	}
+	OS << llvm::format(", %.1f MB, %.1f TU/s, %.2f MB/s", MB,
+		Elapsed > 0 ? S.TUs / Elapsed : 0.0, Elapsed > 0 ? MB / Elapsed : 0.0);
+
+	// The rules that fire the most
+	std::array<unsigned, NumCSCRules> Rules;
+	std::iota(Rules.begin(), Rules.end(), 0);
+	auto Top = Rules.begin() + std::min(3u, NumCSCRules);
+	std::partial_sort(Rules.begin(), Top, Rules.end(),
+		[&](unsigned L, unsigned R) {
+			return S.Violations[L] > S.Violations[R];
+		});
+	const char *Separator = ", top:";
+	for (auto It = Rules.begin(); It != Top && S.Violations[*It]; ++It)
+	{
+		OS << Separator << " " << getRuleName(static_cast<CSCRule>(*It)) << "="
+			<< S.Violations[*It];
+		Separator = "";
+	}
+
+	OS << llvm::format(", %.0fs", Elapsed) << "\n";
+}
+
+llvm::Error CSCMetrics::write_prometheus(const Snapshot &S,
+	llvm::StringRef MetricsPath) const
+{
+	llvm::SmallString<256> Temp(MetricsPath);
+	Temp += ".tmp";
+
+	{
+		std::error_code EC;
+		llvm::raw_fd_ostream OS(Temp, EC, llvm::sys::fs::OF_Text);
+		if (EC)
+		{
+			return llvm::createStringError(EC, "cannot write metrics '%s': %s",
+				Temp.c_str(), EC.message().c_str());
+		}
+
+		auto Metric = [&](llvm::StringRef Name, llvm::StringRef Type,
+			llvm::StringRef Help) {
+			OS << "# HELP " << Name << " " << Help << "\n"
+				<< "# TYPE " << Name << " " << Type << "\n";
+		};
+
+		Metric("csc_translation_units", "gauge",
+			"Translation units in the run.");
+		OS << "csc_translation_units " << NumTUs << "\n";
+
+		Metric("csc_translation_units_checked_total", "counter",
+			"Translation units checked so far.");
+		OS << "csc_translation_units_checked_total " << S.TUs << "\n";
+
+		Metric("csc_source_bytes_total", "counter",
+			"Bytes of the main files checked so far.");
+		OS << "csc_source_bytes_total " << S.Bytes << "\n";
+
+		Metric("csc_violations_total", "counter", "Violations by rule.");
+		for (unsigned I = 0; I < NumCSCRules; ++I)
+		{
+			OS << "csc_violations_total{rule=\""
+				<< getRuleName(static_cast<CSCRule>(I)) << "\"} "
+				<< S.Violations[I] << "\n";
+		}
+
+		Metric("csc_phase_seconds_total", "counter",
+			"Time spent in each phase, summed over the workers.");
+		for (unsigned I = 0; I < NumCSCPhases; ++I)
+		{
+			OS << "csc_phase_seconds_total{phase=\"" << PhaseNames[I] << "\"} "
+				<< llvm::format("%.6f", seconds(S.PhaseNanos[I])) << "\n";
+		}
+
+		Metric("csc_workers", "gauge", "Worker threads.");
+		OS << "csc_workers " << NumWorkers << "\n";
+
+		Metric("csc_elapsed_seconds", "gauge", "Time since the run started.");
+		OS << llvm::format("csc_elapsed_seconds %.3f\n",
+			std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - Started).count());
+
+		OS.close();
+		if (OS.has_error())
+		{
+			OS.clear_error();
+			return llvm::createStringError(llvm::inconvertibleErrorCode(),
+				"cannot write metrics '%s'", Temp.c_str());
+		}
+	}
+
+	// A scraper sees either the previous file or this one
+	if (std::error_code EC = llvm::sys::fs::rename(Temp, MetricsPath))
+	{
+		return llvm::createStringError(EC, "cannot write metrics '%s': %s",
+			MetricsPath.str().c_str(), EC.message().c_str());
+	}
+
+	return llvm::Error::success();
+}
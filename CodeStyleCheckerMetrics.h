@@ -0,0 +1,130 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerMetrics.h
+//
+// DESCRIPTION:
+//    Declares the live metrics of a run of the standalone tool: the counters
+//    every worker updates as it finishes a TU, and CSCMetrics, which sums
+//    them for the progress line (-progress) and the Prometheus text file
+//    (-metrics)
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_METRICS_H
+#define CLANG_TUTOR_CSC_METRICS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeStyleCheckerRules.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//-----------------------------------------------------------------------------
+// Worker counters
+//-----------------------------------------------------------------------------
+// Where the time of a TU goes
+enum class CSCPhase : unsigned
+{
+	Parse,		// preprocessing and Sema (lexing only on a cache hit)
+	Check,		// the traversal, or the replay of a cache hit
+	Report,		// the buffer rules, clang-format and the output
+	NumPhases
+};
+
+constexpr unsigned NumCSCPhases = static_cast<unsigned>(CSCPhase::NumPhases);
+
+// The counters of one worker. Only its own thread writes them, so an update
+// is a relaxed load and store - no locked instruction, no lock. Readers may
+// see a TU half counted, never a torn value. Every worker has its own cache
+// lines: the workers never invalidate each other's.
+struct alignas(64) CSCWorkerCounters
+{
+	std::atomic<uint64_t> TUs{0};
+	// Of the main files
+	std::atomic<uint64_t> Bytes{0};
+	std::array<std::atomic<uint64_t>, NumCSCRules> Violations{};
+	std::array<std::atomic<uint64_t>, NumCSCPhases> PhaseNanos{};
+
+	static void add(std::atomic<uint64_t> &Counter, uint64_t N)
+	{
+		Counter.store(Counter.load(std::memory_order_relaxed) + N,
+			std::memory_order_relaxed);
+	}
+
+	void add_time(CSCPhase Phase, std::chrono::nanoseconds Time)
+	{
+		add(PhaseNanos[static_cast<unsigned>(Phase)], Time.count());
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Metrics
+//-----------------------------------------------------------------------------
+// Owns the counters of the workers. A reporter thread wakes up every
+// interval, sums the counters and prints
+//
+//    csc: <done>/<total> TUs (<percent>%), <MB> MB, <TU/s> TU/s, <MB/s> MB/s,
+//        top: <rule>=<count> ..., <seconds>s
+//
+// to stderr and/or rewrites the metrics file (written next to it and
+// renamed, so that a scraper never reads half of it). The workers are never
+// blocked by the reporter.
+class CSCMetrics
+{
+public:
+	struct Snapshot
+	{
+		uint64_t TUs = 0;
+		uint64_t Bytes = 0;
+		std::array<uint64_t, NumCSCRules> Violations = {};
+		std::array<uint64_t, NumCSCPhases> PhaseNanos = {};
+	};
+
+	~CSCMetrics() { llvm::consumeError(stop()); }
+
+	// Counters for Count workers, for a run of TUs TUs
+	void reset(unsigned Count, uint64_t TUs);
+	CSCWorkerCounters &worker(unsigned Worker) { return Workers[Worker]; }
+
+	Snapshot snapshot() const;
+
+	// Starts the reporter thread. WithProgress: print the progress line,
+	// MetricsPath: write the metrics file (empty - don't).
+	void start(std::chrono::seconds Interval, bool WithProgress,
+		llvm::StringRef MetricsPath);
+	// Stops the reporter thread and reports a last time. Returns the error
+	// of the last write of the metrics file.
+	llvm::Error stop();
+
+	void print_progress(const Snapshot &S, llvm::raw_ostream &OS) const;
+	llvm::Error write_prometheus(const Snapshot &S,
+		llvm::StringRef MetricsPath) const;
+
+private:
+	std::unique_ptr<CSCWorkerCounters[]> Workers;
+	unsigned NumWorkers = 0;
+	uint64_t NumTUs = 0;
+	std::chrono::steady_clock::time_point Started;
+
+	bool Progress = false;
+	std::string Path;
+	std::thread Reporter;
+	std::mutex Lock;
+	std::condition_variable Wakeup;
+	bool Stopping = false;
+	bool Running = false;
+
+	llvm::Error report();
+};
+
+#endif
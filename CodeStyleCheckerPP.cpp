@@ -0,0 +1,207 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerPP.cpp
+//
+// DESCRIPTION:
+//    Implements CSCPPCallbacks
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerPP.h"
+
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/MacroInfo.h"
+
+#include "CodeStyleChecker.h"
+
+using namespace clang;
+
+//-----------------------------------------------------------------------------
+// CSCPPCallbacks implementation
+//-----------------------------------------------------------------------------
+bool CSCPPCallbacks::is_checked(SourceLocation Loc) const
+{
+	const SourceManager &SM = PP.getSourceManager();
+
+	if (Loc.isInvalid() || SM.isInSystemHeader(Loc))
+	{
+		return false;
+	}
+	// <built-in> and <command line>: the predefined and -D macros
+	if (!SM.getFileEntryRefForID(SM.getFileID(SM.getExpansionLoc(Loc))))
+	{
+		return false;
+	}
+
+	return !Opts.MainTUOnly || SM.isInMainFile(Loc);
+}
+
+void CSCPPCallbacks::MacroDefined(const Token &MacroNameTok,
+	const MacroDirective *MD)
+{
+	CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+	if (!Visitor.is_rule_active(CSCRule::R5_2))
+	{
+		return;
+	}
+
+	if (!is_checked(MacroNameTok.getLocation()) ||
+		!isIntegerConstantMacro(MD->getMacroInfo(), PP))
+	{
+		return;
+	}
+
+	if (!Visitor.account(CSCRule::R5_2, MacroNameTok.getLocation()))
+	{
+		return;
+	}
+
+	Visitor.report(CSCRule::R5_2, MacroNameTok.getLocation());
+}
+
+void CSCPPCallbacks::InclusionDirective(
+	SourceLocation HashLoc,
+	const Token &IncludeTok,
+	StringRef FileName,
+	bool IsAngled,
+	CharSourceRange FilenameRange,
+	OptionalFileEntryRef File,
+	StringRef SearchPath,
+	StringRef RelativePath,
+	const Module *SuggestedModule,
+	bool ModuleImported,
+	SrcMgr::CharacteristicKind FileType)
+{
+	CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+	// A missing header is the compiler's business
+	if (!File || !Visitor.is_rule_active(CSCRule::R5_3) ||
+		!is_checked(HashLoc))
+	{
+		return;
+	}
+
+	std::optional<std::string> Hint =
+		fixIncludeStyle(FileName, IsAngled, FileType);
+	if (!Hint)
+	{
+		return;
+	}
+
+	SourceLocation Loc = FilenameRange.getBegin();
+	if (!Visitor.account(CSCRule::R5_3, Loc))
+	{
+		return;
+	}
+
+	Visitor.report(CSCRule::R5_3, Loc,
+		FixItHint::CreateReplacement(FilenameRange, *Hint));
+}
+
+void CSCPPCallbacks::FileChanged(
+	SourceLocation Loc,
+	FileChangeReason Reason,
+	SrcMgr::CharacteristicKind FileType,
+	FileID PrevFID)
+{
+	CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+	// The controlling macro of the file being left is already known here
+	if (Reason == ExitFile && PrevFID.isValid())
+	{
+		check_header_guard(PrevFID);
+	}
+}
+
+bool CSCPPCallbacks::HandleComment(Preprocessor &PP, SourceRange Comment)
+{
+	CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+	if (Visitor.is_rule_active(CSCRule::R5_12) &&
+		is_checked(Comment.getBegin()))
+	{
+		const SourceManager &SM = PP.getSourceManager();
+		const char *Begin = SM.getCharacterData(Comment.getBegin());
+		const char *End = SM.getCharacterData(Comment.getEnd());
+		Visitor.check_comment(Comment.getBegin(),
+			StringRef(Begin, End - Begin));
+	}
+
+	// No token was pushed
+	return false;
+}
+
+void CSCPPCallbacks::SourceRangeSkipped(
+	SourceRange Range,
+	SourceLocation EndifLoc)
+{
+	CSCRuleAllocScope AllocScope(Visitor.rule_allocs());
+
+	Visitor.skipped_range(Range);
+}
+
+void CSCPPCallbacks::PragmaDirective(
+	SourceLocation Loc,
+	PragmaIntroducerKind Introducer)
+{
+	const SourceManager &SM = PP.getSourceManager();
+	if (Introducer != PIK_HashPragma || !SM.isWrittenInMainFile(Loc))
+	{
+		return;
+	}
+
+	// Loc is the '#': the tokens after it are `pragma` and the name
+	std::optional<Token> Pragma =
+		Lexer::findNextToken(Loc, SM, PP.getLangOpts());
+	std::optional<Token> Name = Pragma
+		? Lexer::findNextToken(Pragma->getLocation(), SM, PP.getLangOpts())
+		: std::nullopt;
+	if (Name && Name->is(tok::raw_identifier) &&
+		Name->getRawIdentifier() == "once")
+	{
+		MainFilePragmaOnce = true;
+	}
+}
+
+void CSCPPCallbacks::check_main_file()
+{
+	check_header_guard(PP.getSourceManager().getMainFileID());
+}
+
+void CSCPPCallbacks::check_header_guard(FileID FID)
+{
+	if (!Visitor.is_rule_active(CSCRule::R6_2))
+	{
+		return;
+	}
+
+	const SourceManager &SM = PP.getSourceManager();
+
+	OptionalFileEntryRef FE = SM.getFileEntryRefForID(FID);
+	if (!FE || !isHeaderFile(FE->getName()))
+	{
+		return;
+	}
+
+	SourceLocation Loc = SM.getLocForStartOfFile(FID);
+	if (!is_checked(Loc) || !GuardChecked.insert(&FE->getFileEntry()).second)
+	{
+		return;
+	}
+
+	// The preprocessor ignores a #pragma once in the main file
+	if (PP.getHeaderSearchInfo().isFileMultipleIncludeGuarded(*FE) ||
+		(FID == SM.getMainFileID() && MainFilePragmaOnce))
+	{
+		return;
+	}
+
+	if (!Visitor.account(CSCRule::R6_2, Loc))
+	{
+		return;
+	}
+
+	Visitor.report(CSCRule::R6_2, Loc);
+}
@@ -0,0 +1,106 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerPP.h
+//
+// DESCRIPTION:
+//    Declares CSCPPCallbacks - the rules that are only visible to the
+//    preprocessor
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_PP_H
+#define CLANG_TUTOR_CSC_PP_H
+
+#include "clang/Basic/FileEntry.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/DenseSet.h"
+
+class CodeStyleCheckerVisitor;
+struct CodeStyleCheckerOptions;
+
+//-----------------------------------------------------------------------------
+// PPCallbacks
+//-----------------------------------------------------------------------------
+// Macros, #include directives and header guards never reach the AST. These
+// rules are checked from the callbacks while the preprocessor runs, on the
+// tokens it has already lexed:
+//    * R5.2 - object-like macros that expand to an integer literal
+//    * R5.3 - the include style, judged by where the header search found the
+//      file (a system or a user directory)
+//    * R6.2 - header guards, as detected by the preprocessor's multiple
+//      include optimisation (#pragma once is accepted too - in a header
+//      compiled on its own the preprocessor ignores it, so it is looked
+//      for here)
+//    * R5.12 - commented-out code. The comments are handed over by the lexer
+//      as it skips them (CommentHandler), no comment tokens are kept and no
+//      file is read twice.
+//
+// The violations are reported through the visitor, so that -summary,
+// -max-per-rule, -baseline and -changed-lines apply to them as well.
+class CSCPPCallbacks : public clang::PPCallbacks, public clang::CommentHandler
+{
+public:
+	CSCPPCallbacks(
+		clang::Preprocessor &PP,
+		CodeStyleCheckerVisitor &Visitor,
+		const CodeStyleCheckerOptions &Opts)
+		: PP(PP), Visitor(Visitor), Opts(Opts) {}
+
+	void MacroDefined(
+		const clang::Token &MacroNameTok,
+		const clang::MacroDirective *MD) override;
+
+	void InclusionDirective(
+		clang::SourceLocation HashLoc,
+		const clang::Token &IncludeTok,
+		llvm::StringRef FileName,
+		bool IsAngled,
+		clang::CharSourceRange FilenameRange,
+		clang::OptionalFileEntryRef File,
+		llvm::StringRef SearchPath,
+		llvm::StringRef RelativePath,
+		const clang::Module *SuggestedModule,
+		bool ModuleImported,
+		clang::SrcMgr::CharacteristicKind FileType) override;
+
+	void FileChanged(
+		clang::SourceLocation Loc,
+		FileChangeReason Reason,
+		clang::SrcMgr::CharacteristicKind FileType,
+		clang::FileID PrevFID) override;
+
+	bool HandleComment(clang::Preprocessor &PP,
+		clang::SourceRange Comment) override;
+
+	void SourceRangeSkipped(
+		clang::SourceRange Range,
+		clang::SourceLocation EndifLoc) override;
+
+	void PragmaDirective(
+		clang::SourceLocation Loc,
+		clang::PragmaIntroducerKind Introducer) override;
+
+	// The main file is never exited, its guard is checked once the whole TU
+	// has been preprocessed
+	void check_main_file();
+
+private:
+	clang::Preprocessor &PP;
+	CodeStyleCheckerVisitor &Visitor;
+	const CodeStyleCheckerOptions &Opts;
+
+	// Headers whose guard was already checked. An unguarded header is
+	// entered once per #include.
+	llvm::DenseSet<const clang::FileEntry *> GuardChecked;
+	// The main file has a #pragma once
+	bool MainFilePragmaOnce = false;
+
+	// Whether the violations at Loc are reported at all (-main-tu-only,
+	// system headers)
+	bool is_checked(clang::SourceLocation Loc) const;
+
+	void check_header_guard(clang::FileID FID);
+};
+
+#endif
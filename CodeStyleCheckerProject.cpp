@@ -0,0 +1,442 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerProject.cpp
+//
+// DESCRIPTION:
+//    Implements CSCProject and CSCFactsCollector
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerProject.h"
+
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Lex/MacroInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Path.h"
+
+#include "CodeStyleCheckerRules.h"
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+
+//-----------------------------------------------------------------------------
+// CSCProject implementation
+//-----------------------------------------------------------------------------
+void CSCProject::add(TUFacts Facts)
+{
+	std::lock_guard<std::mutex> Guard(Lock);
+	TUs.push_back(std::move(Facts));
+}
+
+namespace
+{
+struct Violation
+{
+	std::string Name;
+	unsigned Line;
+	unsigned Column;
+	CSCRule Rule;
+
+	bool operator<(const Violation &Other) const
+	{
+		return std::tie(Name, Line, Column, Rule) <
+			std::tie(Other.Name, Other.Line, Other.Column, Other.Rule);
+	}
+	bool operator==(const Violation &Other) const
+	{
+		return std::tie(Name, Line, Column, Rule) ==
+			std::tie(Other.Name, Other.Line, Other.Column, Other.Rule);
+	}
+};
+} // namespace
+
+unsigned CSCProject::check(llvm::vfs::FileSystem &FS, llvm::raw_ostream &OS,
+	bool Summary) const
+{
+	std::vector<Violation> Violations;
+
+	// A header is seen by every TU that includes it - its facts are merged
+	// by path. The TU that defines each function, by its main file.
+	llvm::StringMap<std::vector<const FileFacts *>> Files;
+	llvm::StringMap<llvm::StringRef> Definers;
+	for (const TUFacts &TU : TUs)
+	{
+		for (const FileFacts &File : TU.Files)
+		{
+			Files[File.Path].push_back(&File);
+		}
+		for (const std::string &Name : TU.Definitions)
+		{
+			if (!TU.Files.empty())
+			{
+				Definers.try_emplace(Name, TU.Files.front().Path);
+			}
+		}
+	}
+
+	// R6.1, R6.3: module.c and module.h
+	for (const TUFacts &TU : TUs)
+	{
+		if (TU.Files.empty() || isHeaderFile(TU.Files.front().Path))
+		{
+			continue;
+		}
+		const FileFacts &Main = TU.Files.front();
+
+		llvm::SmallString<256> Header(Main.Path);
+		llvm::sys::path::replace_extension(Header, "h");
+		if (llvm::any_of(Main.Includes, [&](const Include &Inc) {
+				return llvm::StringRef(Inc.Path) == Header;
+			}))
+		{
+			continue;
+		}
+
+		if (Files.count(Header) || FS.exists(Header))
+		{
+			Violations.push_back({Main.Name, 1, 1, CSCRule::R6_3});
+		}
+		else if (!TU.DefinesMain)
+		{
+			Violations.push_back({Main.Name, 1, 1, CSCRule::R6_1});
+		}
+	}
+
+	for (const auto &Entry : Files)
+	{
+		const std::vector<const FileFacts *> &Facts = Entry.second;
+		bool Header = isHeaderFile(Entry.first());
+
+		// The same name in every TU, whichever finished first
+		llvm::StringRef Name = Facts.front()->Name;
+		for (const FileFacts *File : Facts)
+		{
+			Name = std::min(Name, llvm::StringRef(File->Name));
+		}
+
+		// R6.4: whatever is used is declared in a header included directly
+		llvm::StringSet<> Used;
+		for (const FileFacts *File : Facts)
+		{
+			for (const Use &U : File->Uses)
+			{
+				if (!U.Via.empty())
+				{
+					Used.insert(U.Via);
+				}
+				if (!U.System && U.Via != U.DeclaredIn &&
+					isHeaderFile(U.DeclaredIn))
+				{
+					Violations.push_back(
+						{Name.str(), U.Line, U.Column, CSCRule::R6_4});
+				}
+			}
+
+			// ... and not by a prototype of its own
+			for (const Prototype &P : Header ? llvm::ArrayRef<Prototype>()
+				: llvm::ArrayRef<Prototype>(File->Prototypes))
+			{
+				auto Definer = Definers.find(P.Name);
+				if (Definer != Definers.end() &&
+					Definer->second != Entry.first())
+				{
+					Violations.push_back(
+						{Name.str(), P.Line, P.Column, CSCRule::R6_4});
+				}
+			}
+		}
+
+		// R6.5: a header includes nothing it does not use
+		if (!Header)
+		{
+			continue;
+		}
+		for (const FileFacts *File : Facts)
+		{
+			for (const Include &Inc : File->Includes)
+			{
+				if (!Used.count(Inc.Path))
+				{
+					Violations.push_back(
+						{Name.str(), Inc.Line, Inc.Column, CSCRule::R6_5});
+				}
+			}
+		}
+	}
+
+	llvm::sort(Violations);
+	Violations.erase(std::unique(Violations.begin(), Violations.end()),
+		Violations.end());
+
+	if (Summary)
+	{
+		std::array<unsigned, NumCSCRules> Counts = {};
+		for (const Violation &V : Violations)
+		{
+			++Counts[static_cast<unsigned>(V.Rule)];
+		}
+
+		OS << "project:";
+		for (unsigned I = 0; I < NumCSCRules; ++I)
+		{
+			if (Counts[I] != 0)
+			{
+				OS << " " << getRuleName(static_cast<CSCRule>(I)) << "="
+					<< Counts[I];
+			}
+		}
+		OS << "\n";
+	}
+	else
+	{
+		for (const Violation &V : Violations)
+		{
+			OS << V.Name << ":" << V.Line << ":" << V.Column << ": warning: "
+				<< getRuleMessage(V.Rule) << "\n";
+		}
+	}
+
+	return Violations.size();
+}
+
+//-----------------------------------------------------------------------------
+// CSCFactsCollector implementation
+//-----------------------------------------------------------------------------
+namespace
+{
+// The names used in the headers the visitor did not traverse
+class UseCollector : public clang::RecursiveASTVisitor<UseCollector>
+{
+public:
+	explicit UseCollector(CSCFactsCollector &Facts) : Facts(Facts) {}
+
+	bool VisitDeclRefExpr(clang::DeclRefExpr *E)
+	{
+		Facts.record_use(E->getLocation(), E->getDecl());
+		return true;
+	}
+	bool VisitTagTypeLoc(clang::TagTypeLoc TL)
+	{
+		Facts.record_use(TL.getNameLoc(), TL.getDecl());
+		return true;
+	}
+	bool VisitTypedefTypeLoc(clang::TypedefTypeLoc TL)
+	{
+		Facts.record_use(TL.getNameLoc(), TL.getTypedefNameDecl());
+		return true;
+	}
+
+private:
+	CSCFactsCollector &Facts;
+};
+} // namespace
+
+void CSCFactsCollector::InclusionDirective(
+	clang::SourceLocation HashLoc,
+	const clang::Token &,
+	llvm::StringRef,
+	bool,
+	clang::CharSourceRange FilenameRange,
+	clang::OptionalFileEntryRef File,
+	llvm::StringRef,
+	llvm::StringRef,
+	const clang::Module *,
+	bool,
+	clang::SrcMgr::CharacteristicKind FileType)
+{
+	PendingFile *Includer = File ? file(SM.getFileID(HashLoc)) : nullptr;
+	if (!Includer)
+	{
+		return;
+	}
+
+	clang::SourceLocation Loc = FilenameRange.getBegin();
+	Includer->Includes.push_back({absolute(File->getName()),
+		SM.getSpellingLineNumber(Loc), SM.getSpellingColumnNumber(Loc),
+		clang::SrcMgr::isSystem(FileType)});
+	// Also when the header guard keeps the file from being entered again
+	Includer->Included.insert(&File->getFileEntry());
+}
+
+void CSCFactsCollector::MacroExpands(
+	const clang::Token &MacroNameTok,
+	const clang::MacroDefinition &MD,
+	clang::SourceRange,
+	const clang::MacroArgs *)
+{
+	const clang::MacroInfo *MI = MD.getMacroInfo();
+	if (MI && !MI->isBuiltinMacro())
+	{
+		record_use(MacroNameTok.getLocation(), MI->getDefinitionLoc());
+	}
+}
+
+void CSCFactsCollector::record_use(clang::SourceLocation Loc,
+	const clang::Decl *D)
+{
+	if (D)
+	{
+		record_use(Loc, D->getLocation());
+	}
+}
+
+void CSCFactsCollector::record_use(clang::SourceLocation Loc,
+	clang::SourceLocation DeclLoc)
+{
+	if (Loc.isInvalid() || DeclLoc.isInvalid())
+	{
+		return;
+	}
+	Loc = SM.getExpansionLoc(Loc);
+	DeclLoc = SM.getExpansionLoc(DeclLoc);
+
+	clang::FileID UseFID = SM.getFileID(Loc);
+	clang::FileID DeclFID = SM.getFileID(DeclLoc);
+	if (UseFID == DeclFID || !SeenUses.insert({UseFID, DeclFID}).second ||
+		!SM.getFileEntryForID(DeclFID))
+	{
+		return;
+	}
+
+	PendingFile *File = file(UseFID);
+	if (!File)
+	{
+		return;
+	}
+
+	// Up the include stack of the declaration to the first file the user
+	// #include-s itself
+	clang::FileID Via;
+	for (clang::FileID F = DeclFID; F.isValid();
+		F = SM.getFileID(SM.getIncludeLoc(F)))
+	{
+		if (File->Included.contains(SM.getFileEntryForID(F)))
+		{
+			Via = F;
+			break;
+		}
+		if (SM.getIncludeLoc(F).isInvalid())
+		{
+			break;
+		}
+	}
+
+	File->Uses.push_back({DeclFID, Via, SM.getSpellingLineNumber(Loc),
+		SM.getSpellingColumnNumber(Loc), SM.isInSystemHeader(DeclLoc)});
+}
+
+void CSCFactsCollector::collect(clang::ASTContext &Ctx, bool HeadersTraversed)
+{
+	UseCollector Uses(*this);
+
+	for (clang::Decl *D : Ctx.getTranslationUnitDecl()->decls())
+	{
+		clang::SourceLocation Loc = SM.getExpansionLoc(D->getLocation());
+		if (Loc.isInvalid() || SM.isInSystemHeader(Loc))
+		{
+			continue;
+		}
+		bool InMain = SM.isInMainFile(Loc);
+
+		const auto *FD = llvm::dyn_cast<clang::FunctionDecl>(D);
+		if (FD && FD->getIdentifier() && FD->isExternallyVisible())
+		{
+			if (!FD->isThisDeclarationADefinition())
+			{
+				if (PendingFile *File = file(SM.getFileID(Loc)))
+				{
+					File->Prototypes.push_back({FD->getName().str(),
+						SM.getSpellingLineNumber(Loc),
+						SM.getSpellingColumnNumber(Loc)});
+				}
+			}
+			else if (FD->isMain())
+			{
+				DefinesMain = true;
+			}
+			else if (InMain)
+			{
+				Definitions.push_back(FD->getName().str());
+			}
+		}
+
+		if (!HeadersTraversed && !InMain)
+		{
+			Uses.TraverseDecl(D);
+		}
+	}
+}
+
+CSCProject::TUFacts CSCFactsCollector::take()
+{
+	CSCProject::TUFacts Result;
+	Result.DefinesMain = DefinesMain;
+	Result.Definitions = std::move(Definitions);
+
+	// The main file first. It is registered here, as a main file without
+	// #includes or prototypes has not been seen by file() yet and its
+	// definitions and R6.1 facts would otherwise be lost.
+	clang::FileID MainFID = SM.getMainFileID();
+	file(MainFID);
+	std::stable_partition(Files.begin(), Files.end(),
+		[&](const PendingFile &File) { return File.FID == MainFID; });
+
+	for (PendingFile &Pending : Files)
+	{
+		CSCProject::FileFacts File;
+		File.Path = path(Pending.FID);
+		File.Name =
+			SM.getFilename(SM.getLocForStartOfFile(Pending.FID)).str();
+		File.Includes = std::move(Pending.Includes);
+		File.Prototypes = std::move(Pending.Prototypes);
+		for (const PendingUse &U : Pending.Uses)
+		{
+			File.Uses.push_back({path(U.DeclaredIn),
+				U.Via.isValid() ? path(U.Via) : std::string(), U.Line,
+				U.Column, U.System});
+		}
+		Result.Files.push_back(std::move(File));
+	}
+
+	FileIndex.clear();
+	Files.clear();
+	SeenUses.clear();
+
+	return Result;
+}
+
+CSCFactsCollector::PendingFile *CSCFactsCollector::file(clang::FileID FID)
+{
+	static constexpr unsigned NotTracked = ~0u;
+
+	auto Inserted = FileIndex.try_emplace(FID, NotTracked);
+	if (Inserted.second && SM.getFileEntryForID(FID) &&
+		!SM.isInSystemHeader(SM.getLocForStartOfFile(FID)))
+	{
+		Inserted.first->second = Files.size();
+		Files.push_back({FID, {}, {}, {}, {}});
+	}
+
+	return Inserted.first->second == NotTracked
+		? nullptr : &Files[Inserted.first->second];
+}
+
+std::string CSCFactsCollector::absolute(llvm::StringRef Name) const
+{
+	llvm::SmallString<256> Path(Name);
+	SM.getFileManager().getVirtualFileSystem().makeAbsolute(Path);
+	llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+
+	return Path.str().str();
+}
+
+std::string CSCFactsCollector::path(clang::FileID FID) const
+{
+	clang::OptionalFileEntryRef Entry = SM.getFileEntryRefForID(FID);
+
+	return Entry ? absolute(Entry->getName()) : std::string();
+}
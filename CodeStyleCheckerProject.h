@@ -0,0 +1,188 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerProject.h
+//
+// DESCRIPTION:
+//    Declares CSCProject - the facts every TU contributes to the section 6
+//    rules (R6.1, R6.3 - R6.5), which are about a project rather than a TU,
+//    and the reducer that checks them once all TUs are done - and
+//    CSCFactsCollector, which gathers the facts of one TU
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_PROJECT_H
+#define CLANG_TUTOR_CSC_PROJECT_H
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Project facts
+//-----------------------------------------------------------------------------
+// Whether module.c has a module.h, includes it, and whether every file
+// includes exactly the headers whose declarations it uses can't be decided
+// from one TU. Each TU records what it saw while it was checked anyway - the
+// #include directives of its user files, which header every name it uses is
+// declared in, its function definitions and prototypes - and check()
+// evaluates the rules over the records of all TUs. Nothing is parsed again,
+// and every step of check() is a hash lookup per fact.
+//
+// Files are identified by absolute path, so that a header shared by the TUs
+// is one file.
+class CSCProject
+{
+public:
+	struct Include
+	{
+		std::string Path;
+		unsigned Line;
+		unsigned Column;
+		bool System;
+	};
+
+	// The first use in a file of something declared in another file
+	struct Use
+	{
+		std::string DeclaredIn;
+		// The file #include-d by the using file that DeclaredIn is, or that
+		// (transitively) includes it. Empty if the using file does not lead
+		// to DeclaredIn at all.
+		std::string Via;
+		unsigned Line;
+		unsigned Column;
+		bool System;	// DeclaredIn is a system header
+	};
+
+	// A function declared without a body
+	struct Prototype
+	{
+		std::string Name;
+		unsigned Line;
+		unsigned Column;
+	};
+
+	// A file of the TU that is not a system header
+	struct FileFacts
+	{
+		std::string Path;
+		// As the diagnostics of the TU name it
+		std::string Name;
+		std::vector<Include> Includes;
+		std::vector<Use> Uses;
+		std::vector<Prototype> Prototypes;
+	};
+
+	struct TUFacts
+	{
+		// The main file comes first
+		std::vector<FileFacts> Files;
+		bool DefinesMain = false;
+		// Functions with external linkage defined in the main file
+		std::vector<std::string> Definitions;
+	};
+
+	// Safe to call from several threads
+	void add(TUFacts Facts);
+
+	// Checks R6.1, R6.3, R6.4 and R6.5 over the facts of all TUs and prints
+	// the violations to OS as sorted one-line records (-summary: only their
+	// counts). FS tells whether a header exists. Returns the number of
+	// violations.
+	unsigned check(llvm::vfs::FileSystem &FS, llvm::raw_ostream &OS,
+		bool Summary) const;
+
+private:
+	std::vector<TUFacts> TUs;
+	std::mutex Lock;
+};
+
+//-----------------------------------------------------------------------------
+// Facts of a TU
+//-----------------------------------------------------------------------------
+// The #include directives and the macro expansions come from the
+// preprocessor. The visitor reports the names used in the files it
+// traverses; the declarations of the headers it does not traverse (the
+// default -main-tu-only) are walked by collect() at the end of the TU.
+class CSCFactsCollector : public clang::PPCallbacks
+{
+public:
+	explicit CSCFactsCollector(const clang::SourceManager &SM) : SM(SM) {}
+
+	void InclusionDirective(
+		clang::SourceLocation HashLoc,
+		const clang::Token &IncludeTok,
+		llvm::StringRef FileName,
+		bool IsAngled,
+		clang::CharSourceRange FilenameRange,
+		clang::OptionalFileEntryRef File,
+		llvm::StringRef SearchPath,
+		llvm::StringRef RelativePath,
+		const clang::Module *SuggestedModule,
+		bool ModuleImported,
+		clang::SrcMgr::CharacteristicKind FileType) override;
+
+	void MacroExpands(
+		const clang::Token &MacroNameTok,
+		const clang::MacroDefinition &MD,
+		clang::SourceRange Range,
+		const clang::MacroArgs *Args) override;
+
+	// The name of D is used at Loc. Only the first use per pair of files is
+	// kept.
+	void record_use(clang::SourceLocation Loc, const clang::Decl *D);
+
+	// Collects the definitions and prototypes, and the uses in the headers
+	// if the visitor did not traverse them
+	void collect(clang::ASTContext &Ctx, bool HeadersTraversed);
+
+	CSCProject::TUFacts take();
+
+private:
+	struct PendingUse
+	{
+		clang::FileID DeclaredIn;
+		clang::FileID Via;
+		unsigned Line;
+		unsigned Column;
+		bool System;
+	};
+
+	struct PendingFile
+	{
+		clang::FileID FID;
+		std::vector<CSCProject::Include> Includes;
+		// Every file named by an #include of this one
+		llvm::DenseSet<const clang::FileEntry *> Included;
+		std::vector<PendingUse> Uses;
+		std::vector<CSCProject::Prototype> Prototypes;
+	};
+
+	const clang::SourceManager &SM;
+
+	// Index into Files, by file. The main file is added first.
+	llvm::DenseMap<clang::FileID, unsigned> FileIndex;
+	std::vector<PendingFile> Files;
+	llvm::DenseSet<std::pair<clang::FileID, clang::FileID>> SeenUses;
+
+	bool DefinesMain = false;
+	std::vector<std::string> Definitions;
+
+	// nullptr for a system header or a buffer that is not a file
+	PendingFile *file(clang::FileID FID);
+	void record_use(clang::SourceLocation Loc, clang::SourceLocation DeclLoc);
+	std::string absolute(llvm::StringRef Name) const;
+	std::string path(clang::FileID FID) const;
+};
+
+#endif
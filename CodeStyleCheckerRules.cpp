@@ -0,0 +1,978 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerRules.cpp
+//
+// DESCRIPTION:
+//    Names and messages of the rules reported by the CodeStyleChecker
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerRules.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Analysis/CFG.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <cctype>
+
+//-----------------------------------------------------------------------------
+// Rules
+//-----------------------------------------------------------------------------
+const char *getRuleName(CSCRule Rule)
+{
+	switch (Rule)
+	{
+	case CSCRule::R1:
+		return "R1";
+	case CSCRule::R1_1:
+		return "R1.1";
+	case CSCRule::R3_2:
+		return "R3.2";
+	case CSCRule::R3_3:
+		return "R3.3";
+	case CSCRule::R3_4:
+		return "R3.4";
+	case CSCRule::R3_6:
+		return "R3.6";
+	case CSCRule::R4_3:
+		return "R4.3";
+	case CSCRule::R4_5_1:
+		return "R4.5.1";
+	case CSCRule::R4_5_2:
+		return "R4.5.2";
+	case CSCRule::R4_6_8:
+		return "R4.6.8";
+	case CSCRule::R4_7_1:
+		return "R4.7.1";
+	case CSCRule::R4_7_2:
+		return "R4.7.2";
+	case CSCRule::R4_7_3:
+		return "R4.7.3";
+	case CSCRule::R4_7_4:
+		return "R4.7.4";
+	case CSCRule::R4_7_5:
+		return "R4.7.5";
+	case CSCRule::R4_7_6:
+		return "R4.7.6";
+	case CSCRule::R4_7_7:
+		return "R4.7.7";
+	case CSCRule::R5_2:
+		return "R5.2";
+	case CSCRule::R5_3:
+		return "R5.3";
+	case CSCRule::R5_4:
+		return "R5.4";
+	case CSCRule::R5_5:
+		return "R5.5";
+	case CSCRule::R5_6:
+		return "R5.6";
+	case CSCRule::R5_7:
+		return "R5.7";
+	case CSCRule::R5_8:
+		return "R5.8";
+	case CSCRule::R5_12:
+		return "R5.12";
+	case CSCRule::R5_17:
+		return "R5.17";
+	case CSCRule::R6_1:
+		return "R6.1";
+	case CSCRule::R6_2:
+		return "R6.2";
+	case CSCRule::R6_3:
+		return "R6.3";
+	case CSCRule::R6_4:
+		return "R6.4";
+	case CSCRule::R6_5:
+		return "R6.5";
+	case CSCRule::Format:
+		return "R2/R4 (clang-format)";
+	case CSCRule::NumRules:
+		break;
+	}
+
+	return "unknown";
+}
+
+const char *getRuleMessage(CSCRule Rule)
+{
+	switch (Rule)
+	{
+	case CSCRule::R1:
+		return "string literal contains invalid characters (including '\\t') "
+			"(R1.1, R1.2) [CMC-OS]";
+	case CSCRule::R1_1:
+		return "file contains a control character (R1.1) [CMC-OS]";
+	case CSCRule::R3_2:
+		return "names must only use English words (non-ASCII characters) "
+			"(R3.2) [CMC-OS]";
+	case CSCRule::R3_3:
+		return "consts, constexprs and enums name must be in "
+			"SCREAMING_SNAKE_CASE (R3.3) [CMC-OS]";
+	case CSCRule::R3_4:
+		return "variable, function and label name must be in snake_case "
+			"(R3.4) [CMC-OS]";
+	case CSCRule::R3_6:
+		return "type and tag names must be in UpperCamelCase "
+			"(`_` is not allowed) (R3.6) [CMC-OS]";
+	case CSCRule::R4_3:
+		return "'*' of a pointer declarator belongs to the name: a space "
+			"before it, none after it (R4.3) [CMC-OS]";
+	case CSCRule::R4_5_1:
+		return "function definition: return type on its own line, name and "
+			"braces in the first column, no space before '(' (R4.5.1) "
+			"[CMC-OS]";
+	case CSCRule::R4_5_2:
+		return "function without parameters must be declared with (void) "
+			"(R4.5.2) [CMC-OS]";
+	case CSCRule::R4_6_8:
+		return "the previous case falls through to this label: end every case "
+			"with break (R4.6.8) [CMC-OS]";
+	case CSCRule::R4_7_1:
+		return "binary operator must be surrounded by spaces (R4.7.1) "
+			"[CMC-OS]";
+	case CSCRule::R4_7_2:
+		return "no spaces around '.', '->', '[' and ']' (R4.7.2) [CMC-OS]";
+	case CSCRule::R4_7_3:
+		return "',' and ';' in a for header must be followed by a space "
+			"(R4.7.3) [CMC-OS]";
+	case CSCRule::R4_7_4:
+		return "no space between a unary operator and its operand (R4.7.4) "
+			"[CMC-OS]";
+	case CSCRule::R4_7_5:
+		return "no space between a function name and '(' (R4.7.5) [CMC-OS]";
+	case CSCRule::R4_7_6:
+		return "no space after '(' and before ')' (R4.7.6) [CMC-OS]";
+	case CSCRule::R4_7_7:
+		return "the ')' of a cast must be followed by a space (R4.7.7) "
+			"[CMC-OS]";
+	case CSCRule::R5_2:
+		return "integer constants must be defined with enum (C) or constexpr "
+			"(C++), not with #define or const (R5.2) [CMC-OS]";
+	case CSCRule::R5_3:
+		return "standard headers must be included with <>, user headers "
+			"with \"\" (R5.3) [CMC-OS]";
+	case CSCRule::R5_4:
+		return "errors, warnings and other diagnostics must be printed to "
+			"stderr (R5.4) [CMC-OS]";
+	case CSCRule::R5_5:
+		return "diagnostic message must end with a newline (R5.5) [CMC-OS]";
+	case CSCRule::R5_6:
+		return "the output of the program must end with a newline (R5.6) "
+			"[CMC-OS]";
+	case CSCRule::R5_7:
+		return "every path of function 'main' must end with a return statement "
+			"with an exit code in [0, 128) (R5.7) [CMC-OS]";
+	case CSCRule::R5_8:
+		return "gets, sprintf, strcpy, strcat, strncpy, strncat and scanf's "
+			"string conversions without a width don't check for buffer "
+			"overflow and are forbidden (R5.8) [CMC-OS]";
+	case CSCRule::R5_12:
+		return "commented-out code must be removed (R5.12) [CMC-OS]";
+	case CSCRule::R5_17:
+		return "variable holding a resource (FILE *, descriptor, heap pointer) "
+			"must be defined at the start of the function and initialized "
+			"(R5.17) [CMC-OS]";
+	case CSCRule::R6_1:
+		return "every module except the one with 'main' must have a header "
+			"file of the same name (R6.1) [CMC-OS]";
+	case CSCRule::R6_2:
+		return "header file must be protected from repeated inclusion "
+			"(R6.2) [CMC-OS]";
+	case CSCRule::R6_3:
+		return "module must include its own header file (R6.3) [CMC-OS]";
+	case CSCRule::R6_4:
+		return "the header that declares this must be included directly, "
+			"not through another header or replaced by a prototype "
+			"(R6.4) [CMC-OS]";
+	case CSCRule::R6_5:
+		return "header file must not include what it does not use "
+			"(R6.5) [CMC-OS]";
+	case CSCRule::Format:
+		return "code layout does not match .clang-format (R2, R4) [CMC-OS]";
+	case CSCRule::NumRules:
+		break;
+	}
+
+	return "unknown rule [CMC-OS]";
+}
+
+//-----------------------------------------------------------------------------
+// Naming rules
+//-----------------------------------------------------------------------------
+std::string fixScreamingSnakeCase(llvm::StringRef Name, size_t *FirstBad)
+{
+	std::string Hint = Name.str();
+	std::transform(Hint.begin(), Hint.end(), Hint.begin(), ::toupper);
+
+	if (FirstBad)
+	{
+		*FirstBad = 0;
+		for (size_t i = 0; i < Name.size(); ++i) {
+			if (islower(Name[i])) {
+				*FirstBad = i;
+				break;
+			}
+		}
+	}
+
+	return Hint;
+}
+
+std::string fixSnakeCase(llvm::StringRef Name, size_t *FirstBad)
+{
+	std::string Hint = Name.str();
+	std::transform(Hint.begin(), Hint.end(), Hint.begin(), ::tolower);
+
+	if (FirstBad)
+	{
+		*FirstBad = 0;
+		for (size_t i = 0; i < Name.size(); ++i) {
+			if (isupper(Name[i])) {
+				*FirstBad = i;
+				break;
+			}
+		}
+	}
+
+	return Hint;
+}
+
+std::string fixUpperCamelCase(llvm::StringRef Name, size_t *FirstBad)
+{
+	std::string Hint;
+
+	bool hasChanged = false;
+	size_t firstChangedPos = 0;
+
+	for (size_t i = 0, n = Name.size(); i < n; ++i) {
+		if (Name[i] == '_') {
+			if (!hasChanged)
+			{
+				firstChangedPos = i;
+			}
+			hasChanged = true;
+			continue;
+		}
+		if (i == 0 || Name[i - 1] == '_') {
+			if (!isupper(Name[i])) {
+				if (!hasChanged)
+				{
+					firstChangedPos = i;
+				}
+				hasChanged = true;
+				Hint += toupper(Name[i]);
+			} else {
+				Hint += Name[i];
+			}
+		} else {
+			Hint += Name[i];
+		}
+	}
+
+	if (FirstBad)
+	{
+		*FirstBad = firstChangedPos;
+	}
+
+	// A name that starts with an upper case letter and has no underscores
+	// is returned unchanged, so that callers can compare with Name
+	return hasChanged ? Hint : Name.str();
+}
+
+std::string fixName(CSCRule Rule, llvm::StringRef Name, size_t *FirstBad)
+{
+	switch (Rule)
+	{
+	case CSCRule::R3_3:
+		return fixScreamingSnakeCase(Name, FirstBad);
+	case CSCRule::R3_4:
+		return fixSnakeCase(Name, FirstBad);
+	case CSCRule::R3_6:
+		return fixUpperCamelCase(Name, FirstBad);
+	default:
+		break;
+	}
+
+	return Name.str();
+}
+
+std::optional<CSCRule> getNamingRule(const clang::NamedDecl *D)
+{
+	// Anonymous declarations, operators, constructors, ...
+	if (!D->getIdentifier())
+	{
+		return std::nullopt;
+	}
+
+	if (llvm::isa<clang::TagDecl>(D))
+	{
+		return CSCRule::R3_6;
+	}
+	if (llvm::isa<clang::EnumConstantDecl>(D))
+	{
+		return CSCRule::R3_3;
+	}
+	if (const auto *VD = llvm::dyn_cast<clang::VarDecl>(D))
+	{
+		return (VD->isConstexpr() || VD->getType().isConstQualified())
+			? CSCRule::R3_3 : CSCRule::R3_4;
+	}
+	if (llvm::isa<clang::FunctionDecl>(D) &&
+		!llvm::isa<clang::CXXConversionDecl>(D))
+	{
+		return CSCRule::R3_4;
+	}
+
+	return std::nullopt;
+}
+
+bool isEnglishName(llvm::StringRef Name)
+{
+	return llvm::all_of(Name, [](char C) { return clang::isASCII(C); });
+}
+
+//-----------------------------------------------------------------------------
+// Other rules
+//-----------------------------------------------------------------------------
+std::string stripControlChars(llvm::StringRef Str)
+{
+	std::string Result;
+	Result.reserve(Str.size());
+
+	for (char C : Str)
+	{
+		if (!isControlChar(C))
+		{
+			Result.push_back(C);
+		}
+	}
+
+	return Result;
+}
+
+std::vector<unsigned> findControlChars(llvm::StringRef Code,
+	llvm::ArrayRef<std::pair<unsigned, unsigned>> Skip, bool WithTabs,
+	unsigned Begin, unsigned End)
+{
+	std::vector<unsigned> Result;
+	auto Range = Skip.begin();
+
+	for (unsigned I = Begin, E = std::min<size_t>(End, Code.size()); I < E;
+		++I)
+	{
+		unsigned char C = Code[I];
+		if (!isControlChar(C) || (C == '\t' && !WithTabs))
+		{
+			continue;
+		}
+
+		while (Range != Skip.end() && Range->second <= I)
+		{
+			++Range;
+		}
+		if (Range != Skip.end() && Range->first <= I)
+		{
+			continue;
+		}
+
+		Result.push_back(I);
+	}
+
+	return Result;
+}
+
+bool isIntegerConstant(const clang::VarDecl *D, const clang::ASTContext &Ctx)
+{
+	// constexpr is the right way in C++, parameters are not constants
+	if (D->isConstexpr() || llvm::isa<clang::ParmVarDecl>(D) ||
+		!D->getType().isConstQualified())
+	{
+		return false;
+	}
+
+	// Only integers: floating constants are defined with const, and bools
+	// and characters are not what the rule is about
+	clang::QualType Type = D->getType();
+	if (!Type->isIntegerType() || Type->isBooleanType() ||
+		Type->isAnyCharacterType())
+	{
+		return false;
+	}
+
+	// `const int Len = strlen(S);` is a read-only variable, not a constant
+	const clang::Expr *Init = D->getInit();
+	return Init && !Init->isValueDependent() &&
+		Init->isIntegerConstantExpr(Ctx);
+}
+
+bool isIntegerConstantMacro(const clang::MacroInfo *MI,
+	const clang::Preprocessor &PP)
+{
+	if (MI->isFunctionLike())
+	{
+		return false;
+	}
+
+	// #define N 8, #define N (-8)
+	llvm::ArrayRef<clang::Token> Body = MI->tokens();
+	while (Body.size() >= 2 && Body.front().is(clang::tok::l_paren) &&
+		Body.back().is(clang::tok::r_paren))
+	{
+		Body = Body.drop_front().drop_back();
+	}
+	if (!Body.empty() && Body.front().isOneOf(clang::tok::minus,
+		clang::tok::plus))
+	{
+		Body = Body.drop_front();
+	}
+	if (Body.size() != 1 || Body.front().isNot(clang::tok::numeric_constant))
+	{
+		return false;
+	}
+
+	// The token is already lexed, its spelling is read from the buffer
+	llvm::SmallString<32> Buffer;
+	bool Invalid = false;
+	llvm::StringRef Spelling = PP.getSpelling(Body.front(), Buffer, &Invalid);
+	if (Invalid)
+	{
+		return false;
+	}
+
+	// Not a floating literal (1.0, 1e5, 0x1p3)
+	bool Hex = Spelling.starts_with_insensitive("0x");
+	return Spelling.find('.') == llvm::StringRef::npos &&
+		Spelling.find_first_of(Hex ? "pP" : "eE") == llvm::StringRef::npos;
+}
+
+std::optional<std::string> fixIncludeStyle(llvm::StringRef FileName,
+	bool IsAngled, clang::SrcMgr::CharacteristicKind FileType)
+{
+	// FileType is where the header search found the file: -isystem and
+	// the compiler's own directories are system
+	bool IsSystem = clang::SrcMgr::isSystem(FileType);
+	if (IsAngled == IsSystem)
+	{
+		return std::nullopt;
+	}
+
+	return IsSystem
+		? ("<" + FileName + ">").str()
+		: ("\"" + FileName + "\"").str();
+}
+
+bool isForbiddenFunction(const clang::FunctionDecl *FD)
+{
+	const clang::IdentifierInfo *II = FD->getIdentifier();
+
+	// Only the C library functions, not e.g. a member called strcpy
+	if (!II || !(FD->isExternC() || FD->isInStdNamespace()))
+	{
+		return false;
+	}
+
+	return llvm::StringSwitch<bool>(II->getName())
+		.Cases("gets", "sprintf", "strcpy", "strcat", true)
+		.Cases("strncpy", "strncat", true)
+		.Default(false);
+}
+
+// The keywords that start or make up most statements, enough to tell code
+// from prose
+static bool isCodeKeyword(llvm::StringRef Word)
+{
+	return llvm::StringSwitch<bool>(Word)
+		.Cases("if", "else", "for", "while", "do", "switch", "case", true)
+		.Cases("default", "break", "continue", "return", "goto", true)
+		.Cases("sizeof", "int", "char", "short", "long", "unsigned", true)
+		.Cases("signed", "float", "double", "void", "const", "static", true)
+		.Cases("struct", "union", "enum", "typedef", "extern", "auto", true)
+		.Cases("bool", "true", "false", "nullptr", "NULL", true)
+		.Cases("new", "delete", "class", "using", "namespace", true)
+		.Cases("template", "constexpr", true)
+		.Default(false);
+}
+
+// The cheap part of R5.12: Body is the comment without its delimiters
+static bool mayBeCode(llvm::StringRef Body)
+{
+	if (Body.contains("://"))
+	{
+		return false;
+	}
+
+	unsigned Letters = 0;
+	unsigned Operators = 0;
+	for (char C : Body)
+	{
+		// Code is ASCII, the comments of this course mostly are not
+		if (!clang::isASCII(C))
+		{
+			return false;
+		}
+		if (clang::isLetter(C))
+		{
+			++Letters;
+		}
+		else if (llvm::StringRef(";{}()[]=<>+-*/&|!,.%^~?:#").contains(C))
+		{
+			++Operators;
+		}
+	}
+
+	// Prose has a word or two per punctuation mark, code a lot less
+	if (Operators * 8 < Letters)
+	{
+		return false;
+	}
+
+	llvm::SmallVector<llvm::StringRef, 8> Lines;
+	Body.split(Lines, '\n');
+	for (llvm::StringRef Line : Lines)
+	{
+		Line = Line.trim();
+		if (Line.ends_with(";") || Line.ends_with("{") ||
+			Line.ends_with("}") || Line.starts_with("#"))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool isCommentedOutCode(llvm::StringRef Comment,
+	const clang::LangOptions &LangOpts)
+{
+	// Doxygen: `///`, `//!`, `/**`, `/*!` - examples in there are on purpose
+	if (Comment.starts_with("///") || Comment.starts_with("//!") ||
+		Comment.starts_with("/**") || Comment.starts_with("/*!"))
+	{
+		return false;
+	}
+
+	llvm::StringRef Body = Comment.drop_front(2);
+	if (Comment.starts_with("/*"))
+	{
+		Body.consume_back("*/");
+	}
+
+	if (!mayBeCode(Body))
+	{
+		return false;
+	}
+
+	// The lexer wants a null-terminated buffer
+	std::string Text = Body.str();
+	clang::Lexer Lex(clang::SourceLocation(), LangOpts, Text.c_str(),
+		Text.c_str(), Text.c_str() + Text.size());
+
+	unsigned Words = 0;
+	unsigned Keywords = 0;
+	unsigned Others = 0;		// punctuation and literals
+	bool Terminated = false;
+	clang::tok::TokenKind Last = clang::tok::unknown;
+
+	clang::Token Tok;
+	while (true)
+	{
+		Lex.LexFromRawLexer(Tok);
+
+		// The last token of a line (or of the comment)
+		if ((Tok.isAtStartOfLine() || Tok.is(clang::tok::eof)) &&
+			(Last == clang::tok::semi || Last == clang::tok::l_brace ||
+				Last == clang::tok::r_brace))
+		{
+			Terminated = true;
+		}
+
+		if (Tok.is(clang::tok::eof))
+		{
+			break;
+		}
+
+		// An apostrophe in "don't" or a stray backtick - prose
+		if (Tok.is(clang::tok::unknown))
+		{
+			return false;
+		}
+
+		// `#include <...>`, `#define ...`
+		if (Tok.isAtStartOfLine() && Tok.is(clang::tok::hash))
+		{
+			Terminated = true;
+		}
+
+		if (Tok.is(clang::tok::raw_identifier))
+		{
+			++Words;
+			if (isCodeKeyword(Tok.getRawIdentifier()))
+			{
+				++Keywords;
+			}
+		}
+		else
+		{
+			++Others;
+		}
+		Last = Tok.getKind();
+	}
+
+	// `int x;`, `return 0;`, `printf("%d", a);`, `x = 5;` - but not
+	// "first do this; then that;"
+	return Terminated && Others * 2 >= Words && (Keywords > 0 || Others >= 2);
+}
+
+bool isHeaderFile(llvm::StringRef Path)
+{
+	llvm::StringRef Ext = llvm::sys::path::extension(Path);
+
+	return Ext.equals_insensitive(".h") || Ext.equals_insensitive(".hh") ||
+		Ext.equals_insensitive(".hpp") || Ext.equals_insensitive(".hxx");
+}
+
+//-----------------------------------------------------------------------------
+// Flow rules
+//-----------------------------------------------------------------------------
+std::unique_ptr<clang::CFG> buildFunctionCFG(const clang::FunctionDecl *FD,
+	clang::ASTContext &Ctx)
+{
+	if (!FD->doesThisDeclarationHaveABody() || FD->isDependentContext())
+	{
+		return nullptr;
+	}
+
+	// The rules look for returns, assignments and [[fallthrough]] among the
+	// elements, by default most statements only show up as subexpressions
+	clang::CFG::BuildOptions Options;
+	Options.setAllAlwaysAdd();
+
+	return clang::CFG::buildCFG(FD, FD->getBody(), &Ctx, Options);
+}
+
+llvm::BitVector findReachableBlocks(const clang::CFG &Graph)
+{
+	llvm::BitVector Reachable(Graph.getNumBlockIDs());
+	llvm::SmallVector<const clang::CFGBlock *, 32> Worklist;
+
+	Reachable.set(Graph.getEntry().getBlockID());
+	Worklist.push_back(&Graph.getEntry());
+	while (!Worklist.empty())
+	{
+		const clang::CFGBlock *Block = Worklist.pop_back_val();
+		// A pruned edge (`if (0)`) is a null successor
+		for (const clang::CFGBlock *Succ : Block->succs())
+		{
+			if (Succ && !Reachable.test(Succ->getBlockID()))
+			{
+				Reachable.set(Succ->getBlockID());
+				Worklist.push_back(Succ);
+			}
+		}
+	}
+
+	return Reachable;
+}
+
+// The path through Block continues into the next case label on purpose
+static bool isStackedOrAnnotated(const clang::CFGBlock &Block)
+{
+	// `case 1: case 2:` - the outer label gets a block of its own
+	if (Block.empty() && llvm::isa_and_nonnull<clang::SwitchCase>(
+		Block.getLabel()))
+	{
+		return true;
+	}
+
+	return llvm::any_of(Block, [](const clang::CFGElement &E) {
+		std::optional<clang::CFGStmt> S = E.getAs<clang::CFGStmt>();
+		const auto *Attributed = S
+			? llvm::dyn_cast<clang::AttributedStmt>(S->getStmt()) : nullptr;
+		return Attributed && llvm::any_of(Attributed->getAttrs(),
+			[](const clang::Attr *A) {
+				return llvm::isa<clang::FallThroughAttr>(A);
+			});
+	});
+}
+
+std::vector<const clang::SwitchCase *> findFallThroughs(
+	const clang::SwitchStmt *S, const clang::CFG &Graph,
+	const llvm::BitVector &Reachable)
+{
+	std::vector<const clang::SwitchCase *> Result;
+
+	const clang::CFGBlock *Dispatch = nullptr;
+	for (const clang::CFGBlock *Block : Graph)
+	{
+		if (Block->getTerminatorStmt() == S)
+		{
+			Dispatch = Block;
+			break;
+		}
+	}
+	// Not in this function (e.g. in a lambda) or never executed
+	if (!Dispatch || !Reachable.test(Dispatch->getBlockID()))
+	{
+		return Result;
+	}
+
+	// Every label starts a block that the dispatch jumps to. Any other
+	// reachable way into it is the end of the case before it.
+	llvm::DenseMap<const clang::Stmt *, const clang::CFGBlock *> Labels;
+	for (const clang::CFGBlock *Succ : Dispatch->succs())
+	{
+		if (Succ && Succ->getLabel())
+		{
+			Labels[Succ->getLabel()] = Succ;
+		}
+	}
+
+	// The list is in reverse source order
+	for (const clang::SwitchCase *Case = S->getSwitchCaseList(); Case;
+		Case = Case->getNextSwitchCase())
+	{
+		const clang::CFGBlock *Block = Labels.lookup(Case);
+		if (!Block)
+		{
+			continue;
+		}
+
+		bool FallsThrough = llvm::any_of(Block->preds(),
+			[&](const clang::CFGBlock *Pred) {
+				return Pred && Pred != Dispatch &&
+					Reachable.test(Pred->getBlockID()) &&
+					!isStackedOrAnnotated(*Pred);
+			});
+		if (FallsThrough)
+		{
+			Result.push_back(Case);
+		}
+	}
+
+	std::reverse(Result.begin(), Result.end());
+	return Result;
+}
+
+// The return that ends Block, if it ends with one
+static const clang::ReturnStmt *getFinalReturn(const clang::CFGBlock &Block)
+{
+	for (const clang::CFGElement &E : llvm::reverse(Block))
+	{
+		if (std::optional<clang::CFGStmt> S = E.getAs<clang::CFGStmt>())
+		{
+			return llvm::dyn_cast<clang::ReturnStmt>(S->getStmt());
+		}
+	}
+
+	return nullptr;
+}
+
+std::vector<clang::SourceLocation> findMainReturnViolations(
+	const clang::FunctionDecl *Main, const clang::CFG &Graph,
+	const llvm::BitVector &Reachable, const clang::ASTContext &Ctx)
+{
+	std::vector<clang::SourceLocation> Result;
+
+	// A function-try-block has no compound body to end with
+	const auto *Body = llvm::dyn_cast_or_null<clang::CompoundStmt>(
+		Main->getBody());
+	if (!Main->isMain() || !Body)
+	{
+		return Result;
+	}
+
+	bool FallsOff = false;
+	for (const clang::CFGBlock *Pred : Graph.getExit().preds())
+	{
+		if (!Pred || !Reachable.test(Pred->getBlockID()))
+		{
+			continue;
+		}
+		// exit(), abort() and throw never get to the end of main
+		if (Pred->hasNoReturnElement() || llvm::isa_and_nonnull<
+			clang::CXXThrowExpr>(Pred->getTerminatorStmt()))
+		{
+			continue;
+		}
+
+		const clang::ReturnStmt *Return = getFinalReturn(*Pred);
+		if (!Return)
+		{
+			FallsOff = true;
+			continue;
+		}
+
+		// Only a constant exit code can be checked against [0, 128)
+		const clang::Expr *Value = Return->getRetValue();
+		std::optional<llvm::APSInt> Code;
+		if (Value && !Value->isValueDependent())
+		{
+			Code = Value->getIntegerConstantExpr(Ctx);
+		}
+		if (Code && (Code->isNegative() || Code->getExtValue() >= 128))
+		{
+			Result.push_back(Return->getBeginLoc());
+		}
+	}
+
+	const clang::SourceManager &SM = Ctx.getSourceManager();
+	llvm::sort(Result, [&](clang::SourceLocation A, clang::SourceLocation B) {
+		return SM.isBeforeInTranslationUnit(A, B);
+	});
+	if (FallsOff)
+	{
+		Result.push_back(Body->getRBracLoc());
+	}
+
+	return Result;
+}
+
+bool isResourceHandleType(clang::QualType T)
+{
+	if (!T->isPointerType())
+	{
+		return false;
+	}
+
+	// Through the typedef: FILE is struct _IO_FILE in glibc
+	const auto *Typedef = T->getPointeeType()->getAs<clang::TypedefType>();
+	if (!Typedef)
+	{
+		return false;
+	}
+
+	llvm::StringRef Name = Typedef->getDecl()->getName();
+	return Name == "FILE" || Name == "DIR";
+}
+
+bool isResourceAcquisition(const clang::Expr *E)
+{
+	const auto *Call = llvm::dyn_cast<clang::CallExpr>(E->IgnoreParenCasts());
+	const clang::FunctionDecl *Callee = Call ? Call->getDirectCallee() : nullptr;
+	const clang::IdentifierInfo *II = Callee ? Callee->getIdentifier() : nullptr;
+
+	// Only the C library functions, not e.g. a member called open
+	if (!II || !(Callee->isExternC() || Callee->isInStdNamespace()))
+	{
+		return false;
+	}
+
+	return llvm::StringSwitch<bool>(II->getName())
+		.Cases("malloc", "calloc", "realloc", "aligned_alloc", true)
+		.Cases("strdup", "strndup", true)
+		.Cases("fopen", "fdopen", "freopen", "popen", "tmpfile", true)
+		.Cases("opendir", "fdopendir", true)
+		.Cases("open", "openat", "creat", "dup", "dup2", true)
+		.Cases("socket", "accept", "accept4", true)
+		.Default(false);
+}
+
+bool isDeclaredAtStart(const clang::VarDecl *D, const clang::FunctionDecl *FD)
+{
+	const auto *Body = llvm::dyn_cast_or_null<clang::CompoundStmt>(
+		FD->getBody());
+	if (!Body)
+	{
+		return false;
+	}
+
+	for (const clang::Stmt *S : Body->body())
+	{
+		const auto *DS = llvm::dyn_cast<clang::DeclStmt>(S);
+		if (!DS)
+		{
+			return false;
+		}
+		if (llvm::is_contained(DS->decls(), D))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The variable S gives a new resource, if S is `Var = malloc(...)` and such
+static const clang::VarDecl *getAcquiringVar(const clang::Stmt *S)
+{
+	const auto *Assign = llvm::dyn_cast<clang::BinaryOperator>(S);
+	if (!Assign || !Assign->isAssignmentOp() ||
+		!isResourceAcquisition(Assign->getRHS()))
+	{
+		return nullptr;
+	}
+
+	const auto *Ref = llvm::dyn_cast<clang::DeclRefExpr>(
+		Assign->getLHS()->IgnoreParenImpCasts());
+	return Ref ? llvm::dyn_cast<clang::VarDecl>(Ref->getDecl()) : nullptr;
+}
+
+llvm::DenseSet<const clang::VarDecl *> findAssignedResources(
+	const clang::Stmt *Body)
+{
+	llvm::DenseSet<const clang::VarDecl *> Result;
+	llvm::SmallVector<const clang::Stmt *, 32> Worklist;
+	if (Body)
+	{
+		Worklist.push_back(Body);
+	}
+
+	while (!Worklist.empty())
+	{
+		const clang::Stmt *S = Worklist.pop_back_val();
+		if (const clang::VarDecl *Var = getAcquiringVar(S))
+		{
+			Result.insert(Var);
+		}
+		for (const clang::Stmt *Child : S->children())
+		{
+			if (Child)
+			{
+				Worklist.push_back(Child);
+			}
+		}
+	}
+
+	return Result;
+}
+
+llvm::DenseSet<const clang::VarDecl *> findAcquiringVars(
+	const clang::CFG &Graph, const llvm::BitVector &Reachable)
+{
+	llvm::DenseSet<const clang::VarDecl *> Result;
+
+	for (const clang::CFGBlock *Block : Graph)
+	{
+		if (!Reachable.test(Block->getBlockID()))
+		{
+			continue;
+		}
+
+		for (const clang::CFGElement &E : *Block)
+		{
+			std::optional<clang::CFGStmt> S = E.getAs<clang::CFGStmt>();
+			if (const clang::VarDecl *Var =
+				S ? getAcquiringVar(S->getStmt()) : nullptr)
+			{
+				Result.insert(Var);
+			}
+		}
+	}
+
+	return Result;
+}
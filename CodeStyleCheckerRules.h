@@ -0,0 +1,225 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerRules.h
+//
+// DESCRIPTION:
+//    Declares the rules reported by the CodeStyleChecker and the predicates
+//    behind them. The predicates are shared by the plugin (the visitor and
+//    CSCPPCallbacks) and by the clang-tidy module.
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_RULES_H
+#define CLANG_TUTOR_CSC_RULES_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang
+{
+class ASTContext;
+class CFG;
+class Expr;
+class FunctionDecl;
+class LangOptions;
+class MacroInfo;
+class NamedDecl;
+class Preprocessor;
+class QualType;
+class SwitchCase;
+class SwitchStmt;
+class VarDecl;
+}
+
+//-----------------------------------------------------------------------------
+// Rules
+//-----------------------------------------------------------------------------
+// Every diagnostic emitted by the checker belongs to exactly one rule. The rule
+// is what -summary counts and what -max-per-rule caps.
+enum class CSCRule : unsigned
+{
+	R1,			// control characters and '\t' in string literals (R1.1, R1.2)
+	R1_1,		// control characters anywhere else in the source
+	R3_2,		// English names only
+	R3_3,		// constants in SCREAMING_SNAKE_CASE
+	R3_4,		// variables and functions in snake_case
+	R3_6,		// types and tags in UpperCamelCase
+	R4_3,		// `int *p`, not `int* p` or `int * p`
+	R4_5_1,		// return type, name, `{` and `}` of a definition on own lines
+	R4_5_2,		// `f(void)`, not `f()`
+	R4_6_8,		// no falling through to the next case of a switch
+	R4_7_1,		// spaces around binary operators
+	R4_7_2,		// no spaces around `.`, `->`, `[`, `]`
+	R4_7_3,		// a space after `,` and after `;` in a for header
+	R4_7_4,		// no space between a unary operator and its operand
+	R4_7_5,		// no space between the callee and `(`
+	R4_7_6,		// no space after `(` and before `)`
+	R4_7_7,		// a space after the `)` of a cast
+	R5_2,		// integer constants via enum/constexpr, not #define or const
+	R5_3,		// <> for standard headers, "" for user headers
+	R5_4,		// diagnostics go to stderr
+	R5_5,		// a diagnostic message ends with a newline
+	R5_6,		// the output of the program ends with a newline
+	R5_7,		// main ends with return <exit code>
+	R5_8,		// functions that don't check for buffer overflow
+	R5_12,		// commented-out code
+	R5_17,		// resource handles defined at the start and initialized
+	R6_1,		// a module without main has a header of the same name
+	R6_2,		// header guards
+	R6_3,		// a module includes its own header
+	R6_4,		// what is used is declared by a header included directly
+	R6_5,		// a header includes only what it uses
+	Format,		// layout checked by clang-format (R2, the rest of R4)
+	NumRules
+};
+
+constexpr unsigned NumCSCRules = static_cast<unsigned>(CSCRule::NumRules);
+
+// A set of rules, bit N for rule N
+using CSCRuleMask = uint64_t;
+static_assert(NumCSCRules <= 64, "CSCRuleMask needs a bit per rule");
+
+constexpr CSCRuleMask ruleBit(CSCRule Rule)
+{
+	return CSCRuleMask(1) << static_cast<unsigned>(Rule);
+}
+
+constexpr CSCRuleMask AllCSCRules = ~CSCRuleMask(0) >> (64 - NumCSCRules);
+
+// Human readable rule tag, e.g. "R3.4"
+const char *getRuleName(CSCRule Rule);
+// The warning text of the rule. Rule messages take no arguments, so that
+// a violation is fully described by its rule and location. They are used as
+// diagnostic format strings as well as printed as is, so they contain no
+// '%'.
+const char *getRuleMessage(CSCRule Rule);
+
+//-----------------------------------------------------------------------------
+// Naming rules
+//-----------------------------------------------------------------------------
+// Each returns the name Name should have according to the rule - Name itself
+// if it is fine. FirstBad (if not null) receives the position of the first
+// offending character.
+
+// R3.3: SCREAMING_SNAKE_CASE
+std::string fixScreamingSnakeCase(llvm::StringRef Name,
+	size_t *FirstBad = nullptr);
+// R3.4: snake_case
+std::string fixSnakeCase(llvm::StringRef Name, size_t *FirstBad = nullptr);
+// R3.6: UpperCamelCase, no underscores
+std::string fixUpperCamelCase(llvm::StringRef Name,
+	size_t *FirstBad = nullptr);
+
+// Dispatches to one of the above, Rule must be a naming rule
+std::string fixName(CSCRule Rule, llvm::StringRef Name,
+	size_t *FirstBad = nullptr);
+
+// The naming rule D is checked against, if any
+std::optional<CSCRule> getNamingRule(const clang::NamedDecl *D);
+
+// R3.2: transliteration can't be told from English, but Cyrillic (or any
+// other non-ASCII letter) can
+bool isEnglishName(llvm::StringRef Name);
+
+//-----------------------------------------------------------------------------
+// Other rules
+//-----------------------------------------------------------------------------
+// R1: control characters, '\n' and '\r' are fine
+inline bool isControlChar(unsigned char C)
+{
+	return (C < 32 && C != '\n' && C != '\r') || C == 127;
+}
+
+// R1: the literal without its control characters (Str if it has none)
+std::string stripControlChars(llvm::StringRef Str);
+
+// R1.1: offsets of the control characters in [Begin, End) of Code, except
+// the ones in the sorted, disjoint [begin, end) ranges in Skip. Tabs are
+// layout: only with WithTabs, i.e. when no clang-format check replaces them.
+std::vector<unsigned> findControlChars(llvm::StringRef Code,
+	llvm::ArrayRef<std::pair<unsigned, unsigned>> Skip, bool WithTabs,
+	unsigned Begin = 0, unsigned End = ~0u);
+
+// R5.2: `const int N = 8;` - a const, non-constexpr integer variable
+// initialized with a constant expression
+bool isIntegerConstant(const clang::VarDecl *D, const clang::ASTContext &Ctx);
+// R5.2: an object-like macro that expands to an integer literal
+bool isIntegerConstantMacro(const clang::MacroInfo *MI,
+	const clang::Preprocessor &PP);
+
+// R5.3: the correctly delimited file name of an #include, std::nullopt if
+// the delimiters already match where the header search found the file
+std::optional<std::string> fixIncludeStyle(llvm::StringRef FileName,
+	bool IsAngled, clang::SrcMgr::CharacteristicKind FileType);
+
+// R5.8: gets, sprintf, strcpy, ... from the C library
+bool isForbiddenFunction(const clang::FunctionDecl *FD);
+
+// R5.12: whether Comment (the full text, delimiters included) is commented
+// out code rather than prose. A scan of the characters - non-ASCII text,
+// URLs, too few operators, no line ending in `;`, `{` or `}` - rejects most
+// comments; only the rest are raw-lexed and judged by their token classes.
+// Doc comments are never code.
+bool isCommentedOutCode(llvm::StringRef Comment,
+	const clang::LangOptions &LangOpts);
+
+// R6.2 applies to these
+bool isHeaderFile(llvm::StringRef Path);
+
+//-----------------------------------------------------------------------------
+// Flow rules
+//-----------------------------------------------------------------------------
+// These work on the CFG of a function body rather than on its statements.
+// Reachable has bit N set if block N of Graph can be reached from the entry:
+// code after a return or an endless loop is never judged.
+
+// The CFG the flow rules expect: every statement is an element. nullptr if
+// FD has no body or is a template pattern (dependent code has no reliable
+// flow).
+std::unique_ptr<clang::CFG> buildFunctionCFG(const clang::FunctionDecl *FD,
+	clang::ASTContext &Ctx);
+llvm::BitVector findReachableBlocks(const clang::CFG &Graph);
+
+// R4.6.8: the labels of S that the case before them falls through to, in
+// source order. Stacked labels (`case 1: case 2:`) and an explicit
+// [[fallthrough]] are fine.
+std::vector<const clang::SwitchCase *> findFallThroughs(
+	const clang::SwitchStmt *S, const clang::CFG &Graph,
+	const llvm::BitVector &Reachable);
+
+// R5.7: where `main` violates the rule, in source order - every reachable
+// return whose constant exit code is out of [0, 128), and the closing brace
+// if a path falls off the end of the body. Paths that end in exit() or
+// abort() don't return at all. Empty if Main is fine (or not main).
+std::vector<clang::SourceLocation> findMainReturnViolations(
+	const clang::FunctionDecl *Main, const clang::CFG &Graph,
+	const llvm::BitVector &Reachable, const clang::ASTContext &Ctx);
+
+// R5.17: FILE *, DIR * - a resource whatever the variable is initialized with
+bool isResourceHandleType(clang::QualType T);
+// R5.17: a call that acquires a resource - malloc, fopen, open, socket, ...
+bool isResourceAcquisition(const clang::Expr *E);
+// R5.17: whether D is defined by the declarations that open the body of FD,
+// before its first other statement
+bool isDeclaredAtStart(const clang::VarDecl *D, const clang::FunctionDecl *FD);
+// R5.17: the variables some assignment in Body gives a new resource,
+// reachable or not - a cheap superset of findAcquiringVars, no CFG needed
+llvm::DenseSet<const clang::VarDecl *> findAssignedResources(
+	const clang::Stmt *Body);
+// R5.17: the variables that a reachable assignment (`p = malloc(...)`) gives
+// a new resource
+llvm::DenseSet<const clang::VarDecl *> findAcquiringVars(
+	const clang::CFG &Graph, const llvm::BitVector &Reachable);
+
+#endif
@@ -0,0 +1,752 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerServer.cpp
+//
+// DESCRIPTION:
+//    Implements the language server mode of the standalone tool
+//
+// License: The Unlicense
+//==============================================================================
+#include "CodeStyleCheckerServer.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace clang;
+namespace json = llvm::json;
+
+namespace
+{
+//-----------------------------------------------------------------------------
+// Diagnostics
+//-----------------------------------------------------------------------------
+// A diagnostic in the main file, by offset, with its FixIts
+struct ServerDiagnostic
+{
+	struct Edit
+	{
+		unsigned Begin;
+		unsigned End;
+		std::string Text;
+	};
+
+	unsigned Begin;
+	unsigned End;
+	bool Error;
+	std::string Message;
+	// Empty if the FixIts can't all be applied to the main file
+	std::vector<Edit> Fixes;
+
+	bool operator<(const ServerDiagnostic &Other) const
+	{
+		return Begin < Other.Begin;
+	}
+};
+
+class DiagnosticCollector : public DiagnosticConsumer
+{
+public:
+	explicit DiagnosticCollector(std::vector<ServerDiagnostic> &Diagnostics)
+		: Diagnostics(Diagnostics) {}
+
+	void BeginSourceFile(const LangOptions &LO, const Preprocessor *) override
+	{
+		LangOpts = &LO;
+	}
+
+	void EndSourceFile() override
+	{
+		LangOpts = nullptr;
+	}
+
+	void HandleDiagnostic(DiagnosticsEngine::Level Level,
+		const Diagnostic &Info) override
+	{
+		DiagnosticConsumer::HandleDiagnostic(Level, Info);
+
+		if (Level < DiagnosticsEngine::Warning || !LangOpts ||
+			!Info.hasSourceManager() || Info.getLocation().isInvalid())
+		{
+			return;
+		}
+
+		const SourceManager &SM = Info.getSourceManager();
+		SourceLocation Loc = SM.getFileLoc(Info.getLocation());
+		if (!SM.isWrittenInMainFile(Loc))
+		{
+			return;
+		}
+
+		ServerDiagnostic Diag;
+		Diag.Begin = SM.getFileOffset(Loc);
+		Diag.End = Diag.Begin + Lexer::MeasureTokenLength(Loc, SM, *LangOpts);
+		Diag.Error = Level >= DiagnosticsEngine::Error;
+
+		SmallString<128> Message;
+		Info.FormatDiagnostic(Message);
+		Diag.Message = Message.str().str();
+
+		for (const FixItHint &Hint : Info.getFixItHints())
+		{
+			CharSourceRange Range =
+				Lexer::makeFileCharRange(Hint.RemoveRange, SM, *LangOpts);
+			if (Range.isInvalid() || Hint.InsertFromRange.isValid() ||
+				!SM.isWrittenInMainFile(Range.getBegin()))
+			{
+				Diag.Fixes.clear();
+				break;
+			}
+			Diag.Fixes.push_back({SM.getFileOffset(Range.getBegin()),
+				SM.getFileOffset(Range.getEnd()), Hint.CodeToInsert});
+		}
+
+		Diagnostics.push_back(std::move(Diag));
+	}
+
+private:
+	std::vector<ServerDiagnostic> &Diagnostics;
+	const LangOptions *LangOpts = nullptr;
+};
+
+//-----------------------------------------------------------------------------
+// Positions
+//-----------------------------------------------------------------------------
+// LSP positions are (line, UTF-16 code unit), the diagnostics have byte
+// offsets
+class LineTable
+{
+public:
+	explicit LineTable(llvm::StringRef Text) : Text(Text)
+	{
+		Starts.push_back(0);
+		for (size_t I = 0; I < Text.size(); ++I)
+		{
+			if (Text[I] == '\n')
+			{
+				Starts.push_back(I + 1);
+			}
+		}
+	}
+
+	json::Object position(unsigned Offset) const
+	{
+		Offset = std::min<size_t>(Offset, Text.size());
+		unsigned Line =
+			llvm::upper_bound(Starts, Offset) - Starts.begin() - 1;
+
+		unsigned Character = 0;
+		for (size_t I = Starts[Line]; I < Offset; I += sequenceLength(Text[I]))
+		{
+			Character += sequenceLength(Text[I]) == 4 ? 2 : 1;
+		}
+
+		return json::Object{{"line", Line}, {"character", Character}};
+	}
+
+	unsigned offset(const json::Object *Position) const
+	{
+		std::optional<int64_t> Line =
+			Position ? Position->getInteger("line") : std::nullopt;
+		std::optional<int64_t> Character =
+			Position ? Position->getInteger("character") : std::nullopt;
+		if (!Line || !Character || *Line < 0)
+		{
+			return 0;
+		}
+		if (*Line >= static_cast<int64_t>(Starts.size()))
+		{
+			return Text.size();
+		}
+
+		size_t I = Starts[*Line];
+		for (int64_t Units = 0; I < Text.size() && Text[I] != '\n' &&
+			Units < *Character; I += sequenceLength(Text[I]))
+		{
+			Units += sequenceLength(Text[I]) == 4 ? 2 : 1;
+		}
+
+		return std::min(I, Text.size());
+	}
+
+	json::Object range(unsigned Begin, unsigned End) const
+	{
+		return json::Object{{"start", position(Begin)}, {"end", position(End)}};
+	}
+
+private:
+	llvm::StringRef Text;
+	std::vector<size_t> Starts;
+
+	// Of the UTF-8 sequence that starts with Lead
+	static unsigned sequenceLength(char Lead)
+	{
+		unsigned char C = Lead;
+		return C < 0xC0 ? 1 : C < 0xE0 ? 2 : C < 0xF0 ? 3 : 4;
+	}
+};
+
+// file:///dir/a%20b.c -> /dir/a b.c
+std::string uriToPath(llvm::StringRef URI)
+{
+	if (!URI.consume_front("file://"))
+	{
+		return URI.str();
+	}
+
+	std::string Path;
+	for (size_t I = 0; I < URI.size(); ++I)
+	{
+		if (URI[I] == '%' && I + 2 < URI.size() &&
+			llvm::isHexDigit(URI[I + 1]) && llvm::isHexDigit(URI[I + 2]))
+		{
+			Path += static_cast<char>(llvm::hexFromNibbles(URI[I + 1],
+				URI[I + 2]));
+			I += 2;
+			continue;
+		}
+		Path += URI[I];
+	}
+
+	return Path;
+}
+
+//-----------------------------------------------------------------------------
+// Frontend action
+//-----------------------------------------------------------------------------
+class ServerAction : public ASTFrontendAction
+{
+public:
+	explicit ServerAction(const CodeStyleCheckerOptions &Opts) : Opts(Opts) {}
+
+	std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+		llvm::StringRef) override
+	{
+		auto Consumer = std::make_unique<CodeStyleCheckerASTConsumer>(
+			&CI.getASTContext(), Opts, CI.getSourceManager());
+		CI.getPreprocessor().addPPCallbacks(
+			Consumer->create_pp_callbacks(CI.getPreprocessor()));
+
+		return Consumer;
+	}
+
+private:
+	const CodeStyleCheckerOptions &Opts;
+};
+
+//-----------------------------------------------------------------------------
+// Server
+//-----------------------------------------------------------------------------
+class LanguageServer
+{
+public:
+	LanguageServer(
+		const tooling::CompilationDatabase &Compilations,
+		const CodeStyleCheckerOptions &BaseOpts,
+		llvm::StringRef FormatStyle,
+		llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS, bool Log)
+		: Compilations(Compilations), FormatStyle(FormatStyle.str()),
+		FS(std::move(FS)), Log(Log),
+		PCHOps(std::make_shared<PCHContainerOperations>())
+	{
+		// Only the rules - the diagnostics go to the client
+		Opts.MainTUOnly = true;
+		Opts.MaxPerRule = BaseOpts.MaxPerRule;
+	}
+
+	int run();
+
+private:
+	struct Document
+	{
+		std::string Path;
+		std::string Directory;
+		std::string Text;
+		int64_t Version = 0;
+		// nullptr if the compile command is broken
+		std::shared_ptr<CompilerInvocation> Invocation;
+		std::unique_ptr<format::FormatStyle> Style;
+		std::optional<PrecompiledPreamble> Preamble;
+		// The violations inside the preamble, from the full check after it
+		// was built
+		std::vector<ServerDiagnostic> PreambleDiagnostics;
+		// As last published
+		std::vector<ServerDiagnostic> Diagnostics;
+	};
+
+	const tooling::CompilationDatabase &Compilations;
+	CodeStyleCheckerOptions Opts;
+	std::string FormatStyle;
+	llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS;
+	// -lsp-log: a line on stderr per check
+	bool Log;
+	std::shared_ptr<PCHContainerOperations> PCHOps;
+
+	// By URI
+	std::map<std::string, Document> Documents;
+	bool ShutdownRequested = false;
+
+	void handle(llvm::StringRef Method, const json::Object *Params,
+		const json::Value *Id);
+	void open(const std::string &URI, std::string Text, int64_t Version);
+	void check(Document &Doc);
+	// One parse of Buffer, on top of the preamble of Doc if WithPreamble
+	std::vector<ServerDiagnostic> parse(Document &Doc,
+		const llvm::MemoryBuffer &Buffer, bool WithPreamble);
+	void publish(const std::string &URI, const Document &Doc);
+	json::Array code_actions(const std::string &URI, const Document &Doc,
+		const json::Object *Range) const;
+
+	static json::Object to_json(const ServerDiagnostic &Diag,
+		const LineTable &Lines);
+	static std::optional<std::string> receive();
+	static void send(json::Value Message);
+	static void notify(llvm::StringRef Method, json::Value Params);
+};
+
+int LanguageServer::run()
+{
+	while (std::optional<std::string> Body = receive())
+	{
+		llvm::Expected<json::Value> Message = json::parse(*Body);
+		if (auto E = Message.takeError())
+		{
+			llvm::errs() << "csc: " << toString(std::move(E)) << '\n';
+			continue;
+		}
+
+		const json::Object *Object = Message->getAsObject();
+		std::optional<llvm::StringRef> Method =
+			Object ? Object->getString("method") : std::nullopt;
+		// Responses - the server sends no requests
+		if (!Method)
+		{
+			continue;
+		}
+
+		if (*Method == "exit")
+		{
+			return ShutdownRequested ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		handle(*Method, Object->getObject("params"), Object->get("id"));
+	}
+
+	// The client went away without `exit`
+	return EXIT_FAILURE;
+}
+
+void LanguageServer::handle(llvm::StringRef Method,
+	const json::Object *Params, const json::Value *Id)
+{
+	auto Reply = [&](json::Value Result) {
+		if (Id)
+		{
+			send(json::Object{{"jsonrpc", "2.0"}, {"id", *Id},
+				{"result", std::move(Result)}});
+		}
+	};
+
+	const json::Object *TextDocument =
+		Params ? Params->getObject("textDocument") : nullptr;
+	std::optional<llvm::StringRef> URI =
+		TextDocument ? TextDocument->getString("uri") : std::nullopt;
+	std::optional<int64_t> Version =
+		TextDocument ? TextDocument->getInteger("version") : std::nullopt;
+
+	if (Method == "initialize")
+	{
+		Reply(json::Object{
+			{"capabilities", json::Object{
+				// Full: the whole text with every change
+				{"textDocumentSync", json::Object{
+					{"openClose", true},
+					{"change", 1}}},
+				{"codeActionProvider", json::Object{
+					{"codeActionKinds", json::Array{"quickfix"}}}}}},
+			{"serverInfo", json::Object{
+				{"name", "ct-code-style-checker"}}}});
+	}
+	else if (Method == "shutdown")
+	{
+		ShutdownRequested = true;
+		Reply(nullptr);
+	}
+	else if (Method == "textDocument/didOpen" && URI)
+	{
+		std::optional<llvm::StringRef> Text = TextDocument->getString("text");
+		open(URI->str(), Text ? Text->str() : std::string(),
+			Version.value_or(0));
+	}
+	else if (Method == "textDocument/didChange" && URI)
+	{
+		auto It = Documents.find(URI->str());
+		const json::Array *Changes = Params->getArray("contentChanges");
+		if (It == Documents.end() || !Changes || Changes->empty())
+		{
+			return;
+		}
+
+		// Full sync: the last change has the whole text
+		const json::Object *Change = Changes->back().getAsObject();
+		std::optional<llvm::StringRef> Text =
+			Change ? Change->getString("text") : std::nullopt;
+		if (!Text)
+		{
+			return;
+		}
+		It->second.Text = Text->str();
+		It->second.Version = Version.value_or(It->second.Version + 1);
+		check(It->second);
+		publish(It->first, It->second);
+	}
+	else if (Method == "textDocument/didClose" && URI)
+	{
+		Documents.erase(URI->str());
+		notify("textDocument/publishDiagnostics",
+			json::Object{{"uri", *URI}, {"diagnostics", json::Array()}});
+	}
+	else if (Method == "textDocument/codeAction" && URI)
+	{
+		auto It = Documents.find(URI->str());
+		Reply(It == Documents.end() ? json::Array()
+			: code_actions(It->first, It->second, Params->getObject("range")));
+	}
+	else if (Id)
+	{
+		send(json::Object{{"jsonrpc", "2.0"}, {"id", *Id},
+			{"error", json::Object{
+				{"code", -32601},
+				{"message", ("unsupported method " + Method).str()}}}});
+	}
+}
+
+void LanguageServer::open(const std::string &URI, std::string Text,
+	int64_t Version)
+{
+	Document &Doc = Documents[URI];
+	Doc = Document();
+	Doc.Path = uriToPath(URI);
+	Doc.Text = std::move(Text);
+	Doc.Version = Version;
+
+	// The compile command is looked up once per document
+	std::vector<tooling::CompileCommand> Commands =
+		Compilations.getCompileCommands(Doc.Path);
+	tooling::CompileCommand Command = Commands.empty()
+		? tooling::CompileCommand(llvm::sys::path::parent_path(Doc.Path),
+			Doc.Path, {"clang", Doc.Path}, "")
+		: Commands.front();
+	Doc.Directory = Command.Directory;
+
+	tooling::CommandLineArguments Args =
+		tooling::getClangSyntaxOnlyAdjuster()(Command.CommandLine, Doc.Path);
+	Args = tooling::getClangStripOutputAdjuster()(Args, Doc.Path);
+	// As ClangTool does: the builtin headers next to the tool
+	static int StaticSymbol;
+	if (llvm::none_of(Args, [](const std::string &Arg) {
+			return llvm::StringRef(Arg).starts_with("-resource-dir");
+		}))
+	{
+		Args.push_back("-resource-dir=" + CompilerInvocation::GetResourcesPath(
+			"ct-code-style-checker", &StaticSymbol));
+	}
+
+	std::vector<const char *> Argv;
+	for (const std::string &Arg : Args)
+	{
+		Argv.push_back(Arg.c_str());
+	}
+
+	IgnoringDiagConsumer Ignore;
+	CreateInvocationOptions CIOpts;
+	// The engine owns the options
+	CIOpts.Diags = CompilerInstance::createDiagnostics(new DiagnosticOptions,
+		&Ignore, /*ShouldOwnClient=*/false);
+	CIOpts.VFS = FS;
+	FS->setCurrentWorkingDirectory(Doc.Directory);
+	Doc.Invocation = createInvocation(Argv, CIOpts);
+
+	if (FormatStyle != "none")
+	{
+		llvm::Expected<format::FormatStyle> StyleOrErr = format::getStyle(
+			FormatStyle, Doc.Path, "none", Doc.Text, FS.get());
+		if (auto E = StyleOrErr.takeError())
+		{
+			llvm::errs() << "csc: " << toString(std::move(E)) << '\n';
+		}
+		else
+		{
+			Doc.Style =
+				std::make_unique<format::FormatStyle>(std::move(*StyleOrErr));
+		}
+	}
+
+	check(Doc);
+	publish(URI, Doc);
+}
+
+void LanguageServer::check(Document &Doc)
+{
+	Doc.Diagnostics.clear();
+	if (!Doc.Invocation)
+	{
+		if (Log)
+		{
+			llvm::errs() << "csc: no usable compile command for " << Doc.Path
+				<< '\n';
+		}
+		return;
+	}
+
+	auto Start = std::chrono::steady_clock::now();
+	FS->setCurrentWorkingDirectory(Doc.Directory);
+
+	std::unique_ptr<llvm::MemoryBuffer> Buffer =
+		llvm::MemoryBuffer::getMemBufferCopy(Doc.Text, Doc.Path);
+	PreambleBounds Bounds = ComputePreambleBounds(
+		Doc.Invocation->getLangOpts(), Buffer->getMemBufferRef(), 0);
+
+	bool Reused = Doc.Preamble &&
+		Doc.Preamble->CanReuse(*Doc.Invocation, Buffer->getMemBufferRef(),
+			Bounds, *FS);
+	if (Reused)
+	{
+		// The preamble is unchanged, so are the violations in it
+		Doc.Diagnostics = Doc.PreambleDiagnostics;
+		for (ServerDiagnostic &Diag : parse(Doc, *Buffer, true))
+		{
+			if (Diag.Begin >= Bounds.Size)
+			{
+				Doc.Diagnostics.push_back(std::move(Diag));
+			}
+		}
+	}
+	else
+	{
+		Doc.Preamble.reset();
+		Doc.PreambleDiagnostics.clear();
+
+		// A file without #include has nothing worth precompiling
+		if (Bounds.Size != 0)
+		{
+			IgnoringDiagConsumer Ignore;
+			llvm::IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+				CompilerInstance::createDiagnostics(
+					&Doc.Invocation->getDiagnosticOpts(), &Ignore,
+					/*ShouldOwnClient=*/false);
+			PreambleCallbacks Callbacks;
+			llvm::ErrorOr<PrecompiledPreamble> Built =
+				PrecompiledPreamble::Build(*Doc.Invocation, Buffer.get(),
+					Bounds, *Diags, FS, PCHOps, /*StoreInMemory=*/true,
+					/*StoragePath=*/"", Callbacks);
+			if (Built)
+			{
+				Doc.Preamble = std::move(*Built);
+			}
+		}
+
+		Doc.Diagnostics = parse(Doc, *Buffer, false);
+		for (const ServerDiagnostic &Diag : Doc.Diagnostics)
+		{
+			if (Diag.Begin < Bounds.Size)
+			{
+				Doc.PreambleDiagnostics.push_back(Diag);
+			}
+		}
+	}
+	llvm::stable_sort(Doc.Diagnostics);
+
+	if (Log)
+	{
+		auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - Start);
+		llvm::errs() << "csc: " << Doc.Path << ": " << Doc.Diagnostics.size()
+			<< " diagnostic(s) in " << Elapsed.count() << " ms"
+			<< (Reused ? "" : " (new preamble)") << '\n';
+	}
+}
+
+std::vector<ServerDiagnostic> LanguageServer::parse(Document &Doc,
+	const llvm::MemoryBuffer &Buffer, bool WithPreamble)
+{
+	std::vector<ServerDiagnostic> Result;
+	DiagnosticCollector Collector(Result);
+
+	auto CI = std::make_shared<CompilerInvocation>(*Doc.Invocation);
+	CI->getFrontendOpts().DisableFree = false;
+
+	// The text of the editor, not the one on disk. The remapped buffer is
+	// only a view of Buffer, freed with the compiler instance.
+	llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS = FS;
+	std::unique_ptr<llvm::MemoryBuffer> Main = llvm::MemoryBuffer::getMemBuffer(
+		Buffer.getMemBufferRef(), /*RequiresNullTerminator=*/false);
+	if (WithPreamble)
+	{
+		Doc.Preamble->AddImplicitPreamble(*CI, VFS, Main.get());
+	}
+	CI->getPreprocessorOpts().addRemappedFile(Doc.Path, Main.release());
+
+	CodeStyleCheckerOptions CheckOpts = Opts;
+	CheckOpts.Style = Doc.Style.get();
+
+	{
+		CompilerInstance Clang(PCHOps);
+		Clang.setInvocation(std::move(CI));
+		Clang.createDiagnostics(&Collector, /*ShouldOwnClient=*/false);
+		Clang.createFileManager(VFS);
+
+		ServerAction Action(CheckOpts);
+		Clang.ExecuteAction(Action);
+	}
+
+	return Result;
+}
+
+void LanguageServer::publish(const std::string &URI, const Document &Doc)
+{
+	LineTable Lines(Doc.Text);
+
+	json::Array Diagnostics;
+	for (const ServerDiagnostic &Diag : Doc.Diagnostics)
+	{
+		Diagnostics.push_back(to_json(Diag, Lines));
+	}
+
+	notify("textDocument/publishDiagnostics", json::Object{
+		{"uri", URI},
+		{"version", Doc.Version},
+		{"diagnostics", std::move(Diagnostics)}});
+}
+
+json::Array LanguageServer::code_actions(const std::string &URI,
+	const Document &Doc, const json::Object *Range) const
+{
+	LineTable Lines(Doc.Text);
+	unsigned Begin = Lines.offset(Range ? Range->getObject("start") : nullptr);
+	unsigned End = Lines.offset(Range ? Range->getObject("end") : nullptr);
+
+	json::Array Actions;
+	for (const ServerDiagnostic &Diag : Doc.Diagnostics)
+	{
+		if (Diag.Fixes.empty() || Diag.End < Begin || Diag.Begin > End)
+		{
+			continue;
+		}
+
+		json::Array Edits;
+		for (const ServerDiagnostic::Edit &Edit : Diag.Fixes)
+		{
+			Edits.push_back(json::Object{
+				{"range", Lines.range(Edit.Begin, Edit.End)},
+				{"newText", Edit.Text}});
+		}
+
+		Actions.push_back(json::Object{
+			{"title", "Fix: " + Diag.Message},
+			{"kind", "quickfix"},
+			{"diagnostics", json::Array{to_json(Diag, Lines)}},
+			{"edit", json::Object{
+				{"changes", json::Object{{URI, std::move(Edits)}}}}}});
+	}
+
+	return Actions;
+}
+
+json::Object LanguageServer::to_json(const ServerDiagnostic &Diag,
+	const LineTable &Lines)
+{
+	return json::Object{
+		{"range", Lines.range(Diag.Begin, Diag.End)},
+		// 1 - error, 2 - warning
+		{"severity", Diag.Error ? 1 : 2},
+		{"source", "csc"},
+		{"message", Diag.Message}};
+}
+
+std::optional<std::string> LanguageServer::receive()
+{
+	size_t Length = 0;
+	bool HaveLength = false;
+	char Line[256];
+
+	// Headers up to an empty line
+	while (std::fgets(Line, sizeof(Line), stdin))
+	{
+		llvm::StringRef Header = llvm::StringRef(Line).rtrim("\r\n");
+		if (Header.empty())
+		{
+			if (HaveLength)
+			{
+				break;
+			}
+			continue;
+		}
+		if (Header.consume_front_insensitive("Content-Length:"))
+		{
+			HaveLength = !Header.trim().getAsInteger(10, Length);
+		}
+	}
+	if (!HaveLength)
+	{
+		return std::nullopt;
+	}
+
+	std::string Body(Length, '\0');
+	if (std::fread(Body.data(), 1, Length, stdin) != Length)
+	{
+		return std::nullopt;
+	}
+
+	return Body;
+}
+
+void LanguageServer::send(json::Value Message)
+{
+	std::string Body;
+	llvm::raw_string_ostream(Body) << Message;
+
+	llvm::outs() << "Content-Length: " << Body.size() << "\r\n\r\n" << Body;
+	llvm::outs().flush();
+}
+
+void LanguageServer::notify(llvm::StringRef Method, json::Value Params)
+{
+	send(json::Object{{"jsonrpc", "2.0"}, {"method", Method},
+		{"params", std::move(Params)}});
+}
+} // namespace
+
+int runLanguageServer(
+	const tooling::CompilationDatabase &Compilations,
+	const CodeStyleCheckerOptions &Opts,
+	llvm::StringRef FormatStyle,
+	llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS, bool Log)
+{
+	LanguageServer Server(Compilations, Opts, FormatStyle, std::move(FS),
+		Log);
+
+	return Server.run();
+}
@@ -0,0 +1,45 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerServer.h
+//
+// DESCRIPTION:
+//    Declares the language server mode of the standalone tool (-lsp): the
+//    rules are run on the documents open in an editor as they are edited,
+//    and reported as LSP diagnostics with their FixIts as code actions
+//
+// License: The Unlicense
+//==============================================================================
+#ifndef CLANG_TUTOR_CSC_SERVER_H
+#define CLANG_TUTOR_CSC_SERVER_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include "CodeStyleChecker.h"
+
+//-----------------------------------------------------------------------------
+// Language server
+//-----------------------------------------------------------------------------
+// Speaks LSP (JSON-RPC with Content-Length framing) on stdin/stdout until the
+// client sends `exit`. Documents are synchronized in full.
+//
+// Every open document keeps a precompiled preamble - the #include and #define
+// block at its top, i.e. nearly all of what a student's file costs to parse.
+// An edit below it reparses only the rest of the file against the preamble;
+// an edit of the preamble itself rebuilds it. The preprocessor does not see
+// the preamble again when it is reused, so the violations inside it (R5.2,
+// R5.3, R5.12) are kept from the full check that follows each rebuild.
+//
+// Compilations gives the flags of a document, Opts the rules to run (the
+// output options are ignored). FormatStyle is -format-style, looked up per
+// document. Log writes the time of every check to stderr, which the editor
+// usually shows in its log of the server. Returns the exit code of the tool.
+int runLanguageServer(
+	const clang::tooling::CompilationDatabase &Compilations,
+	const CodeStyleCheckerOptions &Opts,
+	llvm::StringRef FormatStyle,
+	llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS, bool Log);
+
+#endif
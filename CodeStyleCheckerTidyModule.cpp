@@ -0,0 +1,517 @@
+//==============================================================================
+// FILE:
+//    CodeStyleCheckerTidyModule.cpp
+//
+// DESCRIPTION:
+//    A subset of the CMC-OS rules as a loadable clang-tidy module. The checks
+//    run in the same parse and MatchFinder pass as the other clang-tidy
+//    checks and reuse the predicates of CodeStyleCheckerRules.h, so for the
+//    rules they cover they report what the CSC plugin reports:
+//
+//      cmcos-control-chars         R1, R1.1
+//      cmcos-english-names         R3.2
+//      cmcos-naming-constants      R3.3
+//      cmcos-naming-variables      R3.4
+//      cmcos-naming-types          R3.6
+//      cmcos-integer-constants     R5.2
+//      cmcos-include-style         R5.3
+//      cmcos-main-return           R5.7
+//      cmcos-forbidden-functions   R5.8
+//      cmcos-header-guard          R6.2
+//
+//    The naming checks are built on clang-tidy's RenamerClangTidyCheck, which
+//    renames every reference in the TU, like the plugin's FixIts. Not
+//    covered - only the plugin checks them: the layout rules (R2, R4.x, left
+//    to clang-format here), R4.6.8, R5.4-R5.6, R5.12, R5.17 and section 6
+//    apart from R6.2.
+//
+// USAGE:
+//      * clang-tidy -load ./libStyleCheckerTidy.so -checks='-*,cmcos-*' '\'
+//        input-file.c --
+//
+// License: The Unlicense
+//==============================================================================
+#include "clang-tidy/ClangTidyCheck.h"
+#include "clang-tidy/ClangTidyModule.h"
+#include "clang-tidy/ClangTidyModuleRegistry.h"
+#include "clang-tidy/utils/RenamerClangTidyCheck.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Analysis/CFG.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+
+#include "CodeStyleCheckerIO.h"
+#include "CodeStyleCheckerRules.h"
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace clang::ast_matchers;
+
+namespace clang::tidy::cmcos
+{
+namespace
+{
+
+// Whether Loc is in a file the user wrote: not in a system header, nor in
+// <built-in> or <command line> (the predefined and -D macros), which
+// clang-tidy does not filter out
+bool isUserLocation(const SourceManager &SM, SourceLocation Loc)
+{
+	return Loc.isValid() && !SM.isInSystemHeader(Loc) &&
+		SM.getFileEntryRefForID(SM.getFileID(SM.getExpansionLoc(Loc)));
+}
+
+//-----------------------------------------------------------------------------
+// R1, R1.1
+//-----------------------------------------------------------------------------
+class ControlCharsCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerMatchers(MatchFinder *Finder) override
+	{
+		Finder->addMatcher(stringLiteral().bind("literal"), this);
+	}
+
+	void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
+		Preprocessor *ModuleExpanderPP) override
+	{
+		this->SM = &SM;
+	}
+
+	void check(const MatchFinder::MatchResult &Result) override
+	{
+		const auto *SL = Result.Nodes.getNodeAs<StringLiteral>("literal");
+		if (SL->getCharByteWidth() != 1)
+		{
+			return;
+		}
+
+		StringRef Str = SL->getString();
+		std::string Hint = stripControlChars(Str);
+		if (Hint.size() == Str.size())
+		{
+			return;
+		}
+
+		// The control characters of the literal are reported once
+		const SourceManager &Sources = *Result.SourceManager;
+		SourceLocation End = Lexer::getLocForEndOfToken(SL->getEndLoc(), 0,
+			Sources, Result.Context->getLangOpts());
+		if (SL->getBeginLoc().isFileID() && End.isValid() &&
+			Sources.isWrittenInMainFile(SL->getBeginLoc()))
+		{
+			FlaggedLiterals.emplace_back(
+				Sources.getFileOffset(SL->getBeginLoc()),
+				Sources.getFileOffset(End));
+		}
+
+		diag(SL->getBeginLoc(), getRuleMessage(CSCRule::R1))
+			<< FixItHint::CreateReplacement(
+				SourceRange(SL->getBeginLoc(), SL->getEndLoc()),
+				"\"" + Hint + "\"");
+	}
+
+	void onEndOfTranslationUnit() override
+	{
+		if (!SM)
+		{
+			return;
+		}
+
+		FileID FID = SM->getMainFileID();
+		bool Invalid = false;
+		StringRef Code = SM->getBufferData(FID, &Invalid);
+		if (Invalid)
+		{
+			return;
+		}
+
+		SourceLocation Start = SM->getLocForStartOfFile(FID);
+
+		// No clang-format check runs here, so tabs are reported as well
+		llvm::sort(FlaggedLiterals);
+		for (unsigned Offset : findControlChars(Code, FlaggedLiterals,
+			/*WithTabs=*/true))
+		{
+			SourceLocation Loc = Start.getLocWithOffset(Offset);
+			diag(Loc, getRuleMessage(CSCRule::R1_1))
+				<< FixItHint::CreateRemoval(
+					CharSourceRange::getCharRange(Loc, Loc.getLocWithOffset(1)));
+		}
+
+		FlaggedLiterals.clear();
+	}
+
+private:
+	const SourceManager *SM = nullptr;
+	// Main file offsets [begin, end) of the literals reported by R1
+	std::vector<std::pair<unsigned, unsigned>> FlaggedLiterals;
+};
+
+//-----------------------------------------------------------------------------
+// R3.2
+//-----------------------------------------------------------------------------
+class EnglishNamesCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerMatchers(MatchFinder *Finder) override
+	{
+		Finder->addMatcher(namedDecl(anyOf(varDecl(), functionDecl(),
+			tagDecl(), enumConstantDecl())).bind("decl"), this);
+	}
+
+	void check(const MatchFinder::MatchResult &Result) override
+	{
+		const auto *D = Result.Nodes.getNodeAs<NamedDecl>("decl");
+		if (D->getIdentifier() && !isEnglishName(D->getName()))
+		{
+			diag(D->getLocation(), getRuleMessage(CSCRule::R3_2));
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// R3.3, R3.4, R3.6
+//-----------------------------------------------------------------------------
+class NamingCheck : public RenamerClangTidyCheck
+{
+public:
+	NamingCheck(StringRef Name, ClangTidyContext *Context, CSCRule Rule)
+		: RenamerClangTidyCheck(Name, Context), Rule(Rule) {}
+
+private:
+	CSCRule Rule;
+
+	std::optional<FailureInfo> getDeclFailureInfo(const NamedDecl *Decl,
+		const SourceManager &SM) const override
+	{
+		if (SM.isInSystemHeader(Decl->getLocation()) ||
+			getNamingRule(Decl) != Rule)
+		{
+			return std::nullopt;
+		}
+
+		// Changing the case can't make a non-English name right (R3.2)
+		StringRef Name = Decl->getName();
+		std::string Fixup = fixName(Rule, Name);
+		if (!isEnglishName(Name) || Fixup == Name)
+		{
+			return std::nullopt;
+		}
+
+		return FailureInfo{getRuleName(Rule), std::move(Fixup)};
+	}
+
+	std::optional<FailureInfo> getMacroFailureInfo(const Token &MacroNameTok,
+		const SourceManager &SM) const override
+	{
+		return std::nullopt;
+	}
+
+	DiagInfo getDiagInfo(const NamingCheckId &ID,
+		const NamingCheckFailure &Failure) const override
+	{
+		return {getRuleMessage(Rule), [](DiagnosticBuilder &) {}};
+	}
+};
+
+//-----------------------------------------------------------------------------
+// R5.2
+//-----------------------------------------------------------------------------
+class IntegerConstantsCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerMatchers(MatchFinder *Finder) override
+	{
+		Finder->addMatcher(varDecl(hasType(isConstQualified())).bind("var"),
+			this);
+	}
+
+	void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
+		Preprocessor *ModuleExpanderPP) override
+	{
+		PP->addPPCallbacks(std::make_unique<Callbacks>(*this, *PP));
+	}
+
+	void check(const MatchFinder::MatchResult &Result) override
+	{
+		const auto *VD = Result.Nodes.getNodeAs<VarDecl>("var");
+		if (isIntegerConstant(VD, *Result.Context))
+		{
+			diag(VD->getLocation(), getRuleMessage(CSCRule::R5_2));
+		}
+	}
+
+private:
+	class Callbacks : public PPCallbacks
+	{
+	public:
+		Callbacks(IntegerConstantsCheck &Check, const Preprocessor &PP)
+			: Check(Check), PP(PP) {}
+
+		void MacroDefined(const Token &MacroNameTok,
+			const MacroDirective *MD) override
+		{
+			if (isUserLocation(PP.getSourceManager(),
+					MacroNameTok.getLocation()) &&
+				isIntegerConstantMacro(MD->getMacroInfo(), PP))
+			{
+				Check.diag(MacroNameTok.getLocation(),
+					getRuleMessage(CSCRule::R5_2));
+			}
+		}
+
+	private:
+		IntegerConstantsCheck &Check;
+		const Preprocessor &PP;
+	};
+};
+
+//-----------------------------------------------------------------------------
+// R5.3
+//-----------------------------------------------------------------------------
+class IncludeStyleCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
+		Preprocessor *ModuleExpanderPP) override
+	{
+		PP->addPPCallbacks(std::make_unique<Callbacks>(*this));
+	}
+
+private:
+	class Callbacks : public PPCallbacks
+	{
+	public:
+		explicit Callbacks(IncludeStyleCheck &Check) : Check(Check) {}
+
+		void InclusionDirective(SourceLocation HashLoc,
+			const Token &IncludeTok, StringRef FileName, bool IsAngled,
+			CharSourceRange FilenameRange, OptionalFileEntryRef File,
+			StringRef SearchPath, StringRef RelativePath,
+			const Module *SuggestedModule, bool ModuleImported,
+			SrcMgr::CharacteristicKind FileType) override
+		{
+			std::optional<std::string> Hint;
+			if (File)
+			{
+				Hint = fixIncludeStyle(FileName, IsAngled, FileType);
+			}
+			if (Hint)
+			{
+				Check.diag(FilenameRange.getBegin(),
+					getRuleMessage(CSCRule::R5_3))
+					<< FixItHint::CreateReplacement(FilenameRange, *Hint);
+			}
+		}
+
+	private:
+		IncludeStyleCheck &Check;
+	};
+};
+
+//-----------------------------------------------------------------------------
+// R5.7
+//-----------------------------------------------------------------------------
+class MainReturnCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerMatchers(MatchFinder *Finder) override
+	{
+		Finder->addMatcher(functionDecl(isMain(), isDefinition()).bind("main"),
+			this);
+	}
+
+	void check(const MatchFinder::MatchResult &Result) override
+	{
+		const auto *Main = Result.Nodes.getNodeAs<FunctionDecl>("main");
+		std::unique_ptr<CFG> Graph = buildFunctionCFG(Main, *Result.Context);
+		if (!Graph)
+		{
+			return;
+		}
+
+		for (SourceLocation Loc : findMainReturnViolations(Main, *Graph,
+			findReachableBlocks(*Graph), *Result.Context))
+		{
+			diag(Loc, getRuleMessage(CSCRule::R5_7));
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// R5.8
+//-----------------------------------------------------------------------------
+class ForbiddenFunctionsCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerMatchers(MatchFinder *Finder) override
+	{
+		Finder->addMatcher(callExpr(callee(functionDecl().bind("callee")))
+			.bind("call"), this);
+	}
+
+	void check(const MatchFinder::MatchResult &Result) override
+	{
+		const auto *Callee = Result.Nodes.getNodeAs<FunctionDecl>("callee");
+		const auto *Call = Result.Nodes.getNodeAs<CallExpr>("call");
+		if (isForbiddenFunction(Callee))
+		{
+			diag(Call->getExprLoc(), getRuleMessage(CSCRule::R5_8));
+		}
+
+		// scanf("%s", ...) - parsed here, the module has no per-TU state
+		std::optional<CSCIOCall> IO = classifyIOCall(Call);
+		if (!IO || IO->Function != CSCIOCall::Scan || !IO->Text ||
+			IO->Text->getCharByteWidth() != 1)
+		{
+			return;
+		}
+
+		CSCFormatString Format =
+			parseFormatString(IO->Text->getString(), CSCFormatKind::Scanf);
+		for (const CSCFormatSpec &Spec : Format.Specs)
+		{
+			if (Spec.is_unbounded_string())
+			{
+				diag(IO->Text->getLocationOfByte(Spec.Offset,
+					*Result.SourceManager, getLangOpts(),
+					Result.Context->getTargetInfo()),
+					getRuleMessage(CSCRule::R5_8));
+			}
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// R6.2
+//-----------------------------------------------------------------------------
+class HeaderGuardCheck : public ClangTidyCheck
+{
+public:
+	using ClangTidyCheck::ClangTidyCheck;
+
+	void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
+		Preprocessor *ModuleExpanderPP) override
+	{
+		this->PP = PP;
+		PP->addPPCallbacks(std::make_unique<Callbacks>(*this));
+	}
+
+	// A main file that is itself a header is never exited
+	void onEndOfTranslationUnit() override
+	{
+		if (PP)
+		{
+			check_header_guard(PP->getSourceManager().getMainFileID());
+		}
+		GuardChecked.clear();
+	}
+
+private:
+	class Callbacks : public PPCallbacks
+	{
+	public:
+		explicit Callbacks(HeaderGuardCheck &Check) : Check(Check) {}
+
+		// The controlling macro of the file being left is already known here
+		void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+			SrcMgr::CharacteristicKind FileType, FileID PrevFID) override
+		{
+			if (Reason == ExitFile && PrevFID.isValid())
+			{
+				Check.check_header_guard(PrevFID);
+			}
+		}
+
+	private:
+		HeaderGuardCheck &Check;
+	};
+
+	Preprocessor *PP = nullptr;
+	llvm::DenseSet<const FileEntry *> GuardChecked;
+
+	void check_header_guard(FileID FID)
+	{
+		const SourceManager &SM = PP->getSourceManager();
+
+		OptionalFileEntryRef FE = SM.getFileEntryRefForID(FID);
+		if (!FE || !isHeaderFile(FE->getName()) ||
+			SM.isInSystemHeader(SM.getLocForStartOfFile(FID)) ||
+			!GuardChecked.insert(&FE->getFileEntry()).second)
+		{
+			return;
+		}
+
+		if (!PP->getHeaderSearchInfo().isFileMultipleIncludeGuarded(*FE))
+		{
+			diag(SM.getLocForStartOfFile(FID), getRuleMessage(CSCRule::R6_2));
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Module
+//-----------------------------------------------------------------------------
+class CMCOSModule : public ClangTidyModule
+{
+public:
+	void addCheckFactories(ClangTidyCheckFactories &CheckFactories) override
+	{
+		CheckFactories.registerCheck<ControlCharsCheck>("cmcos-control-chars");
+		CheckFactories.registerCheck<EnglishNamesCheck>("cmcos-english-names");
+		registerNamingCheck(CheckFactories, "cmcos-naming-constants",
+			CSCRule::R3_3);
+		registerNamingCheck(CheckFactories, "cmcos-naming-variables",
+			CSCRule::R3_4);
+		registerNamingCheck(CheckFactories, "cmcos-naming-types",
+			CSCRule::R3_6);
+		CheckFactories.registerCheck<IntegerConstantsCheck>(
+			"cmcos-integer-constants");
+		CheckFactories.registerCheck<IncludeStyleCheck>("cmcos-include-style");
+		CheckFactories.registerCheck<MainReturnCheck>("cmcos-main-return");
+		CheckFactories.registerCheck<ForbiddenFunctionsCheck>(
+			"cmcos-forbidden-functions");
+		CheckFactories.registerCheck<HeaderGuardCheck>("cmcos-header-guard");
+	}
+
+private:
+	static void registerNamingCheck(ClangTidyCheckFactories &CheckFactories,
+		StringRef CheckName, CSCRule Rule)
+	{
+		CheckFactories.registerCheckFactory(CheckName,
+			[Rule](StringRef Name, ClangTidyContext *Context) {
+				return std::make_unique<NamingCheck>(Name, Context, Rule);
+			});
+	}
+};
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// Registration
+//-----------------------------------------------------------------------------
+static ClangTidyModuleRegistry::Add<CMCOSModule>
+	X("cmcos-module", "Adds the CMC-OS code style checks.");
+
+} // namespace clang::tidy::cmcos
@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+#==============================================================================
+# FILE:
+#    bench.py
+#
+# DESCRIPTION:
+#    End-to-end throughput benchmark of ct-code-style-checker. Runs the tool
+#    over fixed corpora - the samples of the repo and synthetic sets built by
+#    concatenating independent copies of them - serially and with -j, and
+#    records for every run:
+#
+#       <corpus> <config> files=<n> bytes=<n> wall=<s> cpu=<s> rss=<KiB>
+#           diags=<n>
+#
+#    The results are compared with a stored baseline. A run is a regression
+#    when its wall or CPU time, or its peak RSS, exceeds the baseline by more
+#    than the tolerance, or when its diagnostics count differs at all (the
+#    corpora are fixed, so a different count is a behaviour change).
+#
+# USAGE:
+#    * python3 bench.py --tool ./ct-code-style-checker
+#    * python3 bench.py --tool ./ct-code-style-checker --update-baseline
+#    * python3 bench.py --tool ./ct-code-style-checker -j 16 --tolerance 0.05
+#
+# License: The Unlicense
+#==============================================================================
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO = os.path.dirname(os.path.abspath(__file__))
+SAMPLES = ["bad_code.cpp", "good_code.cpp", "turned_good.cpp", "test.cpp"]
+
+# (name, number of files, copies of the samples per file)
+CORPORA = [
+    ("samples", 0, 0),
+    ("small-x256", 256, 1),
+    ("large-x32", 32, 16),
+]
+
+FIELDS = ["files", "bytes", "wall", "cpu", "rss", "diags"]
+# Checked against the tolerance, the rest must match exactly. Differences
+# below the noise floor (seconds, KiB) never count.
+TIMED = {"wall": 0.05, "cpu": 0.05, "rss": 1024}
+
+
+#------------------------------------------------------------------------------
+# Corpora
+#------------------------------------------------------------------------------
+ERROR = re.compile(r"^(.*?):\d+:\d+: (?:fatal )?error: ", re.MULTILINE)
+
+
+def split_sample(text):
+    """The #include lines of a sample and its code, in chunks: a sample that
+    is several files glued together (turned_good.cpp) starts a new chunk at
+    each block of #includes after some code."""
+    includes = []
+    chunks = [[]]
+    for line in text.split("\n"):
+        if line.startswith("#include"):
+            if line not in includes:
+                includes.append(line)
+            if any(l.strip() for l in chunks[-1]):
+                chunks.append([])
+            continue
+        chunks[-1].append(line)
+    return includes, ["\n".join(c) for c in chunks
+                      if any(l.strip() for l in c)]
+
+
+def read_samples():
+    samples = []
+    for sample in SAMPLES:
+        with open(os.path.join(REPO, sample), encoding="utf-8",
+                  errors="replace") as f:
+            samples.append(split_sample(f.read()))
+    return samples
+
+
+def synthesize(samples, i, copies):
+    """File I of a corpus: copies samples, starting with sample I mod 4. The
+    #includes go to the top, every chunk of a copy gets a namespace of its
+    own and main() is renamed, so that the copies don't redefine each other's
+    functions and types."""
+    includes = []
+    parts = []
+    for c in range(copies):
+        sample_includes, chunks = samples[(i + c) % len(samples)]
+        includes += [l for l in sample_includes if l not in includes]
+        for k, chunk in enumerate(chunks):
+            parts.append("namespace copy_%d_%d_%d\n{\n%s\n}\n" % (
+                i, c, k, chunk.replace("main(", "main_%d_%d(" % (i, c))))
+    return "\n".join(includes + parts)
+
+
+def write_files(directory, texts):
+    os.makedirs(directory)
+    paths = []
+    for i, text in enumerate(texts):
+        path = os.path.join(directory, "f%04d.cpp" % i)
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(text)
+        paths.append(path)
+    return paths
+
+
+def build_corpus(name, files, copies, root):
+    if files == 0:
+        return [os.path.join(REPO, s) for s in SAMPLES]
+
+    samples = read_samples()
+    return write_files(os.path.join(root, name),
+                       [synthesize(samples, i, copies) for i in range(files)])
+
+
+def count_errors(tool, paths, jobs):
+    """Compile errors per file, as the tool reports them"""
+    proc = subprocess.run(
+        [tool, "-compact", "-format-style=none", "-j", str(jobs)] + paths +
+        ["--", "-ferror-limit=0"],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True, errors="replace")
+    counts = dict.fromkeys(paths, 0)
+    for match in ERROR.finditer(proc.stdout):
+        path = os.path.abspath(match.group(1))
+        if path in counts:
+            counts[path] += 1
+    return counts
+
+
+def check_corpus(tool, name, files, copies, paths, root, jobs):
+    """A synthetic file must compile as well as its samples do on their own:
+    some samples have errors of their own, gluing copies of them together
+    must not add any (e.g. redefinitions)"""
+    if files == 0:
+        return
+
+    # Every sample alone, in the same form as in the corpus
+    samples = read_samples()
+    alone = write_files(os.path.join(root, name + "-alone"),
+                        [synthesize(samples, s, 1)
+                         for s in range(len(samples))])
+    counts = count_errors(tool, alone, jobs)
+    own = [counts[path] for path in alone]
+
+    counts = count_errors(tool, paths, jobs)
+    for i, path in enumerate(paths):
+        expected = sum(own[(i + c) % len(own)] for c in range(copies))
+        if counts[path] != expected:
+            sys.exit("%s: %s has %d compile errors, its samples alone %d" % (
+                name, path, counts[path], expected))
+
+
+#------------------------------------------------------------------------------
+# Runs
+#------------------------------------------------------------------------------
+def run(tool, paths, jobs, extra):
+    # No error limit, so that a sample with errors is still parsed to the end
+    cmd = ([tool, "-compact", "-j", str(jobs)] + extra + paths +
+           ["--", "-ferror-limit=0"])
+
+    # wait4() gives the usage of this child alone. The output goes to a file,
+    # so that waiting can't block the tool on a full pipe.
+    with tempfile.TemporaryFile(mode="w+", errors="replace") as out:
+        start = time.monotonic()
+        proc = subprocess.Popen(cmd, stdout=out, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.monotonic() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+
+        # A file with violations is not a failure, a crash is
+        if proc.returncode < 0:
+            sys.exit("%s crashed (signal %d)" % (tool, -proc.returncode))
+
+        out.seek(0)
+        diags = out.read().count(": warning: ")
+
+    return {
+        "files": len(paths),
+        "bytes": sum(os.path.getsize(p) for p in paths),
+        "wall": wall,
+        "cpu": usage.ru_utime + usage.ru_stime,
+        "rss": usage.ru_maxrss,     # KiB on Linux
+        "diags": diags,
+    }
+
+
+def format_result(key, result):
+    return "%s %s files=%d bytes=%d wall=%.3f cpu=%.3f rss=%d diags=%d" % (
+        key[0], key[1], result["files"], result["bytes"], result["wall"],
+        result["cpu"], result["rss"], result["diags"])
+
+
+def parse_results(path):
+    results = {}
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 2 + len(FIELDS) or line.startswith("#"):
+                continue
+            values = dict(field.split("=", 1) for field in fields[2:])
+            results[(fields[0], fields[1])] = {
+                name: float(values[name]) for name in FIELDS}
+    return results
+
+
+#------------------------------------------------------------------------------
+# Comparison
+#------------------------------------------------------------------------------
+def compare(results, baseline, tolerance):
+    regressions = 0
+    for key, result in results.items():
+        if key not in baseline:
+            print("%s %s: not in the baseline" % key)
+            continue
+
+        base = baseline[key]
+        problems = []
+        for name, noise in TIMED.items():
+            if (base[name] > 0 and result[name] - base[name] > noise and
+                    result[name] > base[name] * (1 + tolerance)):
+                problems.append("%s %.3f -> %.3f (+%.1f%%)" % (
+                    name, base[name], result[name],
+                    100 * (result[name] / base[name] - 1)))
+        if result["diags"] != base["diags"]:
+            problems.append("diags %d -> %d" % (base["diags"],
+                                                 result["diags"]))
+
+        if problems:
+            regressions += 1
+            print("%s %s: REGRESSION %s" % (key + ("; ".join(problems),)))
+        else:
+            print("%s %s: ok (%.1f files/s, %.2f MB/s)" % (
+                key[0], key[1], result["files"] / max(result["wall"], 1e-9),
+                result["bytes"] / max(result["wall"], 1e-9) / 1e6))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Throughput benchmark of ct-code-style-checker")
+    parser.add_argument("--tool", default="./ct-code-style-checker",
+                        help="the ct-code-style-checker binary")
+    parser.add_argument("-j", type=int, default=os.cpu_count() or 1,
+                        help="threads of the parallel configuration")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="runs per configuration, the fastest is kept")
+    parser.add_argument("--results", default="bench_output.txt",
+                        help="where the results of this run are written")
+    parser.add_argument("--baseline", default="bench_baseline.txt",
+                        help="the stored results to compare with")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed slowdown/growth, 0.10 = 10%%")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="store the results as the new baseline")
+    parser.add_argument("extra", nargs="*",
+                        help="more flags for the tool, after --")
+    args = parser.parse_args()
+
+    configs = [("serial", 1)]
+    if args.j > 1:
+        configs.append(("j%d" % args.j, args.j))
+
+    results = {}
+    with tempfile.TemporaryDirectory(prefix="csc-bench-") as root:
+        for name, files, copies in CORPORA:
+            paths = build_corpus(name, files, copies, root)
+            check_corpus(args.tool, name, files, copies, paths, root,
+                         args.j)
+            for config, jobs in configs:
+                runs = [run(args.tool, paths, jobs, args.extra)
+                        for _ in range(max(args.repeat, 1))]
+                best = min(runs, key=lambda r: r["wall"])
+                results[(name, config)] = best
+                print(format_result((name, config), best))
+
+    lines = ["# csc-bench 1"] + [format_result(k, r) for k, r in
+                                 results.items()]
+    with open(args.results, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines) + "\n")
+
+    if args.update_baseline:
+        with open(args.baseline, "w", encoding="utf-8") as f:
+            f.write("\n".join(lines) + "\n")
+        print("baseline written to %s" % args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print("no baseline (%s), run with --update-baseline" % args.baseline)
+        return 0
+
+    return 1 if compare(results, parse_results(args.baseline),
+                        args.tolerance) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())